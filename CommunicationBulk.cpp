@@ -0,0 +1,487 @@
+/************************************************************************
+ * CommunicationBulk implementation
+ *
+ */
+#ifndef COMMUNICATION_TEST_ENV
+#include "Arduino.h"
+#endif
+#include "CommunicationBulk.h"
+#include <string.h>
+
+CommunicationBulk::CommunicationBulk() {
+	cm = nullptr;
+	dataId = 0;
+	ackId = 0;
+	txStatus = TP_IDLE;
+	txData = nullptr;
+	txSource = nullptr;
+	txContext = nullptr;
+	txLength = 0;
+	txFrames = 0;
+	txFirst = 0;
+	txStarted = false;
+	txBase = 0;
+	txNext = 0;
+	txAcked = 0;
+	txResend = 0;
+	txStartAt = 0;
+	txProgressAt = 0;
+	txRetryAt = 0;
+	txRetransmits = 0;
+	rxStatus = TP_IDLE;
+	rxSink = nullptr;
+	rxContext = nullptr;
+	rxLength = 0;
+	rxFrames = 0;
+	rxBase = 0;
+	rxReceived = 0;
+	rxUnacked = 0;
+	rxAckAt = 0;
+	rxAckPending = false;
+	rxAbortPending = false;
+}
+
+bool CommunicationBulk::BeginSender(unsigned int dataId, unsigned int ackId) {
+	if ((dataId >= COMMUNICATION_STD_IDS) || (ackId >= COMMUNICATION_STD_IDS)) {
+		COMMUNICATION_DEBUG_PRINT("[");
+		COMMUNICATION_DEBUG_PRINT(millis(), DEC);
+		COMMUNICATION_DEBUG_PRINT("] CommunicationBulk: Failed to BeginSender() with Can Id ");
+		COMMUNICATION_DEBUG_PRINT(dataId, HEX);
+		COMMUNICATION_DEBUG_PRINT(" / ");
+		COMMUNICATION_DEBUG_PRINT(ackId, HEX);
+		COMMUNICATION_DEBUG_PRINTLN(", Can ID exceeds 11 bit!");
+		return false;
+	}
+
+	CommunicationManager* manager = CommunicationManager::GetInstance();
+	if (!manager->SubscribeFrames(ackId, AckHandler, this)) {
+		/* Failed: to many subscribers */
+		return false;
+	}
+
+	cm = manager;
+	this->dataId = dataId;
+	this->ackId = ackId;
+
+	/* Success */
+	return true;
+}
+
+bool CommunicationBulk::BeginReceiver(unsigned int dataId, unsigned int ackId, COMMUNICATION_TP_SINK sink, void* context) {
+	if ((dataId >= COMMUNICATION_STD_IDS) || (ackId >= COMMUNICATION_STD_IDS)) {
+		COMMUNICATION_DEBUG_PRINT("[");
+		COMMUNICATION_DEBUG_PRINT(millis(), DEC);
+		COMMUNICATION_DEBUG_PRINT("] CommunicationBulk: Failed to BeginReceiver() with Can Id ");
+		COMMUNICATION_DEBUG_PRINT(dataId, HEX);
+		COMMUNICATION_DEBUG_PRINT(" / ");
+		COMMUNICATION_DEBUG_PRINT(ackId, HEX);
+		COMMUNICATION_DEBUG_PRINTLN(", Can ID exceeds 11 bit!");
+		return false;
+	}
+
+	if (nullptr == sink) {
+		/* Failed: Nowhere to put the data */
+		return false;
+	}
+
+	CommunicationManager* manager = CommunicationManager::GetInstance();
+	if (!manager->SubscribeFrames(dataId, DataHandler, this)) {
+		/* Failed: to many subscribers */
+		return false;
+	}
+
+	cm = manager;
+	this->dataId = dataId;
+	this->ackId = ackId;
+	rxSink = sink;
+	rxContext = context;
+
+	/* Success */
+	return true;
+}
+
+bool CommunicationBulk::Send(const void* data, uint32_t length, uint32_t offset) {
+	if (TP_BUSY == txStatus) {
+		/* Failed: Transfer in progress */
+		return false;
+	}
+
+	txData = (const unsigned char*)data;
+	txSource = nullptr;
+	txContext = nullptr;
+	return Start(length, offset);
+}
+
+bool CommunicationBulk::Send(uint32_t length, COMMUNICATION_TP_SOURCE source, void* context, uint32_t offset) {
+	if (TP_BUSY == txStatus) {
+		/* Failed: Transfer in progress */
+		return false;
+	}
+
+	txData = nullptr;
+	txSource = source;
+	txContext = context;
+	return Start(length, offset);
+}
+
+bool CommunicationBulk::Start(uint32_t length, uint32_t offset) {
+	if (nullptr == cm) {
+		COMMUNICATION_DEBUG_PRINT("[");
+		COMMUNICATION_DEBUG_PRINT(millis(), DEC);
+		COMMUNICATION_DEBUG_PRINTLN("] CommunicationBulk: in Send() BeginSender() was not called!");
+
+		/* Failed: No identifiers */
+		return false;
+	}
+
+	if ((0 == length) || (length > COMMUNICATION_BULK_MAX_LENGTH) || (offset >= length)) {
+		COMMUNICATION_DEBUG_PRINT("[");
+		COMMUNICATION_DEBUG_PRINT(millis(), DEC);
+		COMMUNICATION_DEBUG_PRINT("] CommunicationBulk: in Send() length ");
+		COMMUNICATION_DEBUG_PRINT(length, DEC);
+		COMMUNICATION_DEBUG_PRINTLN(" or offset out of range!");
+
+		/* Failed: Nothing to send */
+		return false;
+	}
+
+	txLength = length;
+	txFrames = (length + COMMUNICATION_BULK_FRAME_BYTES - 1) / COMMUNICATION_BULK_FRAME_BYTES;
+	txBase = offset / COMMUNICATION_BULK_FRAME_BYTES;
+	txRetransmits = 0;
+	return Resume();
+}
+
+bool CommunicationBulk::Resume() {
+	if ((nullptr == cm) || (0 == txFrames) || (TP_BUSY == txStatus) || (txBase >= txFrames)) {
+		/* Failed: Nothing to continue */
+		return false;
+	}
+
+	/* The receiver answers START with the frame it expects next */
+	uint32_t now = micros();
+	txStatus = TP_BUSY;
+	txStarted = false;
+	txFirst = txBase;
+	txNext = txBase;
+	txAcked = 0;
+	txProgressAt = now;
+	txStartAt = now - COMMUNICATION_BULK_RETRY_MICROS;
+	if (SendStart()) {
+		txStartAt = now;
+	}
+
+	/* Success */
+	return true;
+}
+
+void CommunicationBulk::Abort() {
+	if (TP_BUSY == txStatus) {
+		txStatus = TP_ERROR_ABORTED;
+	}
+	if (TP_BUSY == rxStatus) {
+		rxStatus = TP_ERROR_ABORTED;
+		rxAbortPending = true;
+	}
+}
+
+uint32_t CommunicationBulk::GetAckedOffset() {
+	uint32_t offset = txBase * COMMUNICATION_BULK_FRAME_BYTES;
+	return (offset < txLength) ? offset : txLength;
+}
+
+uint32_t CommunicationBulk::GetRxOffset() {
+	uint32_t offset = rxBase * COMMUNICATION_BULK_FRAME_BYTES;
+	return (offset < rxLength) ? offset : rxLength;
+}
+
+unsigned long CommunicationBulk::GetRetransmits() {
+	return txRetransmits;
+}
+
+COMMUNICATION_TP_STATUS CommunicationBulk::GetTxStatus() {
+	return txStatus;
+}
+
+COMMUNICATION_TP_STATUS CommunicationBulk::GetRxStatus() {
+	return rxStatus;
+}
+
+void CommunicationBulk::Update() {
+	if (nullptr == cm) {
+		return;
+	}
+
+	uint32_t now = micros();
+
+	// Receiver: answers which did not fit into the frame queue, late acknowledgement
+	if (rxAbortPending) {
+		unsigned char frame = COMMUNICATION_BULK_ABORT;
+		if (cm->SendFrame(ackId, &frame, 1)) {
+			rxAbortPending = false;
+		}
+	}
+	if ((TP_BUSY == rxStatus) && (rxUnacked > 0) && ((now - rxAckAt) >= COMMUNICATION_BULK_ACK_MICROS)) {
+		rxAckPending = true;
+	}
+	if (rxAckPending) {
+		SendAck();
+	}
+
+	if (TP_BUSY != txStatus) {
+		return;
+	}
+
+	if ((now - txProgressAt) >= COMMUNICATION_BULK_TIMEOUT_MICROS) {
+		txStatus = TP_ERROR_TIMEOUT;
+		return;
+	}
+
+	if (!txStarted) {
+		if (((now - txStartAt) >= COMMUNICATION_BULK_RETRY_MICROS) && SendStart()) {
+			txStartAt = now;
+		}
+		return;
+	}
+
+	// No progress: the frames missing in the window are sent again
+	if ((txBase < txNext) && ((now - txProgressAt) >= COMMUNICATION_BULK_RETRY_MICROS) &&
+	    ((now - txRetryAt) >= COMMUNICATION_BULK_RETRY_MICROS)) {
+		txResend = txBase;
+		txRetryAt = now;
+	}
+	while (txResend < txNext) {
+		if (!(txAcked & (1ULL << (txResend - txBase)))) {
+			if (!SendData(txResend)) {
+				return;
+			}
+			txRetransmits += 1;
+		}
+		txResend += 1;
+	}
+
+	// New frames while the window and the frame queue allow
+	while ((txNext < txFrames) && ((txNext - txBase) < COMMUNICATION_BULK_WINDOW)) {
+		if (!SendData(txNext)) {
+			return;
+		}
+		txNext += 1;
+		txResend = txNext;
+	}
+}
+
+bool CommunicationBulk::SendStart() {
+	unsigned char frame[7];
+	frame[0] = COMMUNICATION_BULK_START;
+	Put24(&frame[1], txLength);
+	Put24(&frame[4], txFirst);
+
+	return cm->SendFrame(dataId, frame, sizeof(frame));
+}
+
+bool CommunicationBulk::SendData(uint32_t frame) {
+	if (cm->GetFrameQueueSpace() <= COMMUNICATION_BULK_QUEUE_RESERVE) {
+		/* Failed: Frame queue full, try again later */
+		return false;
+	}
+
+	unsigned char data[8];
+	unsigned int bytes = FrameBytes(txLength, frame);
+	uint32_t offset = frame * COMMUNICATION_BULK_FRAME_BYTES;
+
+	data[0] = frame & COMMUNICATION_BULK_SEQUENCE_MASK;
+	if (txSource) {
+		if (!txSource(txContext, offset, &data[1], bytes)) {
+			txStatus = TP_ERROR_ABORTED;
+
+			/* Failed: Source gave up */
+			return false;
+		}
+	}
+	else {
+		memcpy(&data[1], txData + offset, bytes);
+	}
+
+	cm->SendFrame(dataId, data, 1 + bytes);
+
+	/* Success */
+	return true;
+}
+
+bool CommunicationBulk::SendAck() {
+	unsigned char frame[8];
+	uint32_t bitmap = (uint32_t)(rxReceived >> 1);
+	frame[0] = COMMUNICATION_BULK_ACK;
+	Put24(&frame[1], rxBase);
+	frame[4] = bitmap >> 24;
+	frame[5] = bitmap >> 16;
+	frame[6] = bitmap >> 8;
+	frame[7] = bitmap;
+
+	if (!cm->SendFrame(ackId, frame, sizeof(frame))) {
+		/* Failed: Frame queue full, Update() tries again */
+		return false;
+	}
+
+	rxAckPending = false;
+	rxUnacked = 0;
+	rxAckAt = micros();
+
+	/* Success */
+	return true;
+}
+
+unsigned int CommunicationBulk::FrameBytes(uint32_t length, uint32_t frame) {
+	uint32_t left = length - frame * COMMUNICATION_BULK_FRAME_BYTES;
+	return (left < COMMUNICATION_BULK_FRAME_BYTES) ? left : COMMUNICATION_BULK_FRAME_BYTES;
+}
+
+void CommunicationBulk::DataHandler(void* context, uint32_t canId, const unsigned char* data, unsigned int len) {
+	(void)canId;
+	((CommunicationBulk*)context)->HandleData(data, len);
+}
+
+void CommunicationBulk::AckHandler(void* context, uint32_t canId, const unsigned char* data, unsigned int len) {
+	(void)canId;
+	((CommunicationBulk*)context)->HandleAck(data, len);
+}
+
+void CommunicationBulk::HandleData(const unsigned char* data, unsigned int len) {
+	if (0 == len) {
+		return;
+	}
+
+	if (COMMUNICATION_BULK_START == data[0]) {
+		if (len < 7) {
+			return;
+		}
+		uint32_t length = Get24(&data[1]);
+		uint32_t first = Get24(&data[4]);
+		uint32_t frames = (length + COMMUNICATION_BULK_FRAME_BYTES - 1) / COMMUNICATION_BULK_FRAME_BYTES;
+		if ((0 == length) || (first >= frames)) {
+			return;
+		}
+
+		/* The same transfer again keeps the position, the sender continues
+		 * where the receiver is
+		 */
+		bool known = ((TP_BUSY == rxStatus) || (TP_DONE == rxStatus)) && (length == rxLength) && (first <= rxBase);
+		if (!known) {
+			rxLength = length;
+			rxFrames = frames;
+			rxBase = first;
+			rxReceived = 0;
+			rxStatus = TP_BUSY;
+		}
+		rxAckPending = true;
+		SendAck();
+		return;
+	}
+
+	if ((data[0] > COMMUNICATION_BULK_SEQUENCE_MASK) || (TP_BUSY != rxStatus)) {
+		return;
+	}
+
+	/* Window position from the sequence number, older frames are repeats */
+	uint32_t slot = (data[0] - rxBase) & COMMUNICATION_BULK_SEQUENCE_MASK;
+	uint32_t frame = rxBase + slot;
+	if ((slot >= COMMUNICATION_BULK_WINDOW) || (frame >= rxFrames) || (rxReceived & (1ULL << slot))) {
+		return;
+	}
+	unsigned int bytes = FrameBytes(rxLength, frame);
+	if (len < 1 + bytes) {
+		return;
+	}
+
+	rxUnacked += 1;
+	if (slot > 0) {
+		memcpy(rxWindow[frame % COMMUNICATION_BULK_WINDOW], &data[1], bytes);
+		rxReceived |= (1ULL << slot);
+	}
+	else {
+		/* Next frame in order, it releases the ones waiting behind it */
+		const unsigned char* in = &data[1];
+		do {
+			if (!rxSink(rxContext, rxLength, rxBase * COMMUNICATION_BULK_FRAME_BYTES, in, FrameBytes(rxLength, rxBase))) {
+				rxStatus = TP_ERROR_ABORTED;
+				rxAbortPending = true;
+				return;
+			}
+			rxBase += 1;
+			rxReceived >>= 1;
+			in = rxWindow[rxBase % COMMUNICATION_BULK_WINDOW];
+		} while (rxReceived & 1);
+	}
+
+	if (rxBase >= rxFrames) {
+		rxStatus = TP_DONE;
+		rxAckPending = true;
+	}
+	else if (rxUnacked >= COMMUNICATION_BULK_ACK_FRAMES) {
+		rxAckPending = true;
+	}
+	if (rxAckPending) {
+		SendAck();
+	}
+}
+
+void CommunicationBulk::HandleAck(const unsigned char* data, unsigned int len) {
+	if ((0 == len) || (TP_BUSY != txStatus)) {
+		return;
+	}
+
+	if (COMMUNICATION_BULK_ABORT == data[0]) {
+		txStatus = TP_ERROR_ABORTED;
+		return;
+	}
+
+	if ((COMMUNICATION_BULK_ACK == data[0]) && (len >= 8)) {
+		uint32_t bitmap = ((uint32_t)data[4] << 24) | ((uint32_t)data[5] << 16) | ((uint32_t)data[6] << 8) | data[7];
+		Acknowledge(Get24(&data[1]), bitmap);
+	}
+}
+
+void CommunicationBulk::Acknowledge(uint32_t base, uint32_t bitmap) {
+	if (!txStarted) {
+		/* Answer to START: the receiver's position, resumes there */
+		if (base > txFrames) {
+			return;
+		}
+		txStarted = true;
+		txBase = base;
+		txNext = base;
+		txResend = base;
+		txAcked = 0;
+		txProgressAt = micros();
+		txRetryAt = txProgressAt;
+	}
+	else if ((base < txBase) || (base > txNext)) {
+		/* Outdated or not a reply to this transfer */
+		return;
+	}
+
+	if (base > txBase) {
+		uint32_t shift = base - txBase;
+		txAcked = (shift < 64) ? (txAcked >> shift) : 0;
+		txBase = base;
+		txProgressAt = micros();
+	}
+	txAcked |= ((uint64_t)bitmap << 1);
+	if (txResend < txBase) {
+		txResend = txBase;
+	}
+
+	if (txBase >= txFrames) {
+		txStatus = TP_DONE;
+	}
+}
+
+uint32_t CommunicationBulk::Get24(const unsigned char* in) {
+	return ((uint32_t)in[0] << 16) | ((uint32_t)in[1] << 8) | in[2];
+}
+
+void CommunicationBulk::Put24(unsigned char* out, uint32_t value) {
+	out[0] = value >> 16;
+	out[1] = value >> 8;
+	out[2] = value;
+}
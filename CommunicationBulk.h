@@ -0,0 +1,159 @@
+/************************************************************************
+ * CommunicationBulk class
+ *
+ * Bulk channel for large data dumps on top of the CommunicationManager.
+ * Data frames are sent back to back through all TX mailboxes, the receiver
+ * acknowledges a sliding window of frames with a bitmap, so only the frames
+ * lost are sent again. It keeps its position, a transfer resumes at the
+ * last acknowledged frame after a disturbance.
+ *
+ *   data id: START  0x80, length (3 bytes), first frame (3 bytes)
+ *            DATA   sequence (0x00..0x7F), up to 7 data bytes
+ *   ack id:  ACK    0x81, next expected frame (3 bytes), bitmap of the
+ *                   following 32 frames (4 bytes, bit 0 = next + 1)
+ *            ABORT  0x82
+ *
+ * Frame k carries the data bytes at offset 7 * k, all numbers big endian.
+ *
+ */
+ #ifndef __COMMUNICATION_BULK_H__
+ #define __COMMUNICATION_BULK_H__
+
+ #include "CommunicationManager.h"
+ #include "CommunicationTransport.h"
+
+ #define COMMUNICATION_BULK_MAX_LENGTH 0xFFFFFFUL
+ #define COMMUNICATION_BULK_FRAME_BYTES 7
+
+ /* Frames in flight, at most half the sequence number space. It has to
+  * cover the frames waiting in the frame queue and the mailboxes plus the
+  * acknowledgement interval, or the sender stalls.
+  */
+ #define COMMUNICATION_BULK_WINDOW 64
+ /* Frame queue entries left to other users of the manager */
+ #define COMMUNICATION_BULK_QUEUE_RESERVE 2
+ /* The receiver acknowledges after this many new frames, or after
+  * ACK_MICROS if fewer arrived.
+  */
+ #define COMMUNICATION_BULK_ACK_FRAMES 24
+ #define COMMUNICATION_BULK_ACK_MICROS 5000UL
+ /* Without progress of the acknowledged frames for RETRY_MICROS the frames
+  * missing in the window are sent again, after TIMEOUT_MICROS the transfer
+  * stops (TP_ERROR_TIMEOUT) until Resume() is called.
+  */
+ #define COMMUNICATION_BULK_RETRY_MICROS 20000UL
+ #define COMMUNICATION_BULK_TIMEOUT_MICROS 500000UL
+
+ #define COMMUNICATION_BULK_START 0x80
+ #define COMMUNICATION_BULK_ACK 0x81
+ #define COMMUNICATION_BULK_ABORT 0x82
+ #define COMMUNICATION_BULK_SEQUENCE_MASK 0x7F
+
+ #if COMMUNICATION_BULK_WINDOW > 64
+ #error "COMMUNICATION_BULK_WINDOW must fit into the sequence numbers and window bitmaps"
+ #endif
+
+ class CommunicationBulk {
+ #ifdef COMMUNICATION_TEST_ENV
+ 	friend class CommunicationBenchmark;
+ #endif
+
+ private:
+ 	CommunicationManager* cm;
+
+ 	unsigned int dataId;
+ 	unsigned int ackId;
+
+ 	/* Sender: frames below txBase are acknowledged, bit i of txAcked stands
+ 	 * for frame txBase + i. Acknowledgements only cover 32 frames after
+ 	 * txBase, the rest of the window counts as missing until then.
+ 	 */
+ 	COMMUNICATION_TP_STATUS txStatus;
+ 	const unsigned char* txData;
+ 	COMMUNICATION_TP_SOURCE txSource;
+ 	void* txContext;
+ 	uint32_t txLength;
+ 	uint32_t txFrames;
+ 	uint32_t txFirst;
+ 	bool txStarted;
+ 	uint32_t txBase;
+ 	uint32_t txNext;
+ 	uint64_t txAcked;
+ 	uint32_t txResend;
+ 	uint32_t txStartAt;
+ 	uint32_t txProgressAt;
+ 	uint32_t txRetryAt;
+ 	unsigned long txRetransmits;
+
+ 	/* Receiver: frames below rxBase are delivered, the others of the
+ 	 * window wait in rxWindow
+ 	 */
+ 	COMMUNICATION_TP_STATUS rxStatus;
+ 	COMMUNICATION_TP_SINK rxSink;
+ 	void* rxContext;
+ 	uint32_t rxLength;
+ 	uint32_t rxFrames;
+ 	uint32_t rxBase;
+ 	uint64_t rxReceived;
+ 	unsigned char rxWindow[COMMUNICATION_BULK_WINDOW][COMMUNICATION_BULK_FRAME_BYTES];
+ 	unsigned int rxUnacked;
+ 	uint32_t rxAckAt;
+ 	bool rxAckPending;
+ 	bool rxAbortPending;
+
+ 	bool Start(uint32_t length, uint32_t offset);
+ 	bool SendStart();
+ 	bool SendData(uint32_t frame);
+ 	bool SendAck();
+ 	unsigned int FrameBytes(uint32_t length, uint32_t frame);
+
+ 	void HandleData(const unsigned char* data, unsigned int len);
+ 	void HandleAck(const unsigned char* data, unsigned int len);
+ 	void Acknowledge(uint32_t base, uint32_t bitmap);
+
+ 	static void DataHandler(void* context, uint32_t canId, const unsigned char* data, unsigned int len);
+ 	static void AckHandler(void* context, uint32_t canId, const unsigned char* data, unsigned int len);
+ 	static uint32_t Get24(const unsigned char* in);
+ 	static void Put24(unsigned char* out, uint32_t value);
+
+ public:
+ 	CommunicationBulk();
+
+ 	/* A sender sends data on dataId and receives acknowledgements on ackId,
+ 	 * a receiver the other way round. ackId should be the more urgent one.
+ 	 * Both have to be standard (11 bit) Can IDs.
+ 	 */
+ 	bool BeginSender(unsigned int dataId, unsigned int ackId);
+
+ 	bool BeginReceiver(unsigned int dataId, unsigned int ackId, COMMUNICATION_TP_SINK sink, void* context);
+
+ 	/* The data is read while it is sent and must stay valid until the
+ 	 * transfer is finished, frames may be read more than once
+ 	 */
+ 	bool Send(const void* data, uint32_t length, uint32_t offset = 0);
+
+ 	bool Send(uint32_t length, COMMUNICATION_TP_SOURCE source, void* context, uint32_t offset = 0);
+
+ 	/* Continues a stopped transfer at the last acknowledged frame */
+ 	bool Resume();
+
+ 	void Abort();
+
+ 	/* Data bytes the receiver acknowledged / delivered in order */
+ 	uint32_t GetAckedOffset();
+
+ 	uint32_t GetRxOffset();
+
+ 	unsigned long GetRetransmits();
+
+ 	COMMUNICATION_TP_STATUS GetTxStatus();
+
+ 	COMMUNICATION_TP_STATUS GetRxStatus();
+
+ 	/* Fills the frame queue and handles the timers, call after
+ 	 * CommunicationManager::Update()
+ 	 */
+ 	void Update();
+ };
+
+ #endif
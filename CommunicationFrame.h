@@ -0,0 +1,171 @@
+/************************************************************************
+ * CommunicationFrame class
+ *
+ * Compile time frame layouts: the members of a struct are mapped to bit
+ * fields of a frame by template parameters. Pack() and Unpack() compile to
+ * one shift and mask per field on two 64 bit words, overlapping fields and
+ * fields beyond the frame are compile errors. Both are constexpr, constant
+ * frames are packed at compile time.
+ *
+ *   struct Motor { uint16_t speed; int8_t current; bool enable; };
+ *
+ *   typedef CommunicationFrame<Motor, 4,
+ *     COMMUNICATION_FIELD(Motor, speed, 0, 16, ORDER_LSB),
+ *     COMMUNICATION_FIELD(Motor, current, 23, 8, ORDER_MSB),
+ *     COMMUNICATION_FIELD(Motor, enable, 24, 1, ORDER_LSB)> MotorFrame;
+ *
+ *   cm->Publish<MotorFrame>(&motor, 0x120, &txFlag, CYCLE_10);
+ *
+ * Start bits and byte orders as for CommunicationManager::PublishSignal(),
+ * values which do not fit into their field are saturated.
+ *
+ */
+ #ifndef __COMMUNICATION_FRAME_H__
+ #define __COMMUNICATION_FRAME_H__
+
+ #include "CommunicationManager.h"
+ #include <type_traits>
+
+ #define COMMUNICATION_FIELD(S, member, startBit, length, byteOrder) \
+ 	CommunicationField<S, decltype(S::member), &S::member, startBit, length, byteOrder>
+
+ typedef struct COMMUNICATION_fieldLayout_t {
+ 	unsigned char startBit;
+ 	unsigned char length;
+ 	COMMUNICATION_BYTE_ORDER byteOrder;
+ 	/* Least significant bit in the frame word, see COMMUNICATION_signal_t */
+ 	unsigned char shift;
+ 	/* Bits of the frame (big endian 64 bit word) taken by the field */
+ 	uint64_t mask;
+ } COMMUNICATION_fieldLayout_t;
+
+ template <typename S, typename T, T S::*Member, unsigned char StartBit, unsigned char Length, COMMUNICATION_BYTE_ORDER ByteOrder>
+ class CommunicationField {
+ 	static_assert(std::is_integral<T>::value, "Fields have to be integers");
+ 	static_assert((Length > 0) && (Length <= 8 * sizeof(T)), "Field length exceeds the type of the member");
+ 	static_assert(StartBit < 64, "Start bit outside the frame");
+
+ public:
+ 	static constexpr int shift = (ORDER_MSB == ByteOrder) ? (56 - 8 * (StartBit >> 3) + (StartBit & 7) - (Length - 1)) : StartBit;
+
+ 	static_assert((shift >= 0) && (shift + Length <= 64), "Field exceeds the frame");
+
+ 	static constexpr uint64_t raw = ~0ULL >> (64 - Length);
+ 	static constexpr uint64_t mask = (ORDER_MSB == ByteOrder) ? (raw << shift) : __builtin_bswap64(raw << shift);
+ 	/* Frame bytes the field needs */
+ 	static constexpr unsigned int bytes = (ORDER_MSB == ByteOrder) ? (8 - (shift >> 3)) : (((shift + Length - 1) >> 3) + 1);
+
+ 	static constexpr COMMUNICATION_fieldLayout_t Layout() {
+ 		return { StartBit, Length, ByteOrder, (unsigned char)shift, mask };
+ 	}
+
+ 	/* Range checks vanish for fields as wide as the member */
+ 	static constexpr T Saturate(T value) {
+ 		if (Length >= 8 * sizeof(T)) {
+ 			return value;
+ 		}
+ 		if (std::is_signed<T>::value) {
+ 			const int64_t max = (int64_t)(raw >> 1);
+ 			if ((int64_t)value < -max - 1) {
+ 				return (T)(-max - 1);
+ 			}
+ 			if ((int64_t)value > max) {
+ 				return (T)max;
+ 			}
+ 		}
+ 		else if ((uint64_t)value > raw) {
+ 			return (T)raw;
+ 		}
+ 		return value;
+ 	}
+
+ 	static constexpr void Pack(const S& values, uint64_t& motorola, uint64_t& intel) {
+ 		uint64_t value = ((uint64_t)Saturate(values.*Member) & raw) << shift;
+ 		if (ORDER_MSB == ByteOrder) {
+ 			motorola |= value;
+ 		}
+ 		else {
+ 			intel |= value;
+ 		}
+ 	}
+
+ 	static constexpr void Unpack(S& values, uint64_t motorola, uint64_t intel) {
+ 		uint64_t value = ((ORDER_MSB == ByteOrder) ? motorola : intel) >> shift;
+ 		if (std::is_signed<T>::value) {
+ 			/* Sign extension by an arithmetic shift */
+ 			values.*Member = (T)((int64_t)(value << (64 - Length)) >> (64 - Length));
+ 		}
+ 		else {
+ 			values.*Member = (T)(value & raw);
+ 		}
+ 	}
+ };
+
+ template <typename S, unsigned int Bytes, typename... Fields>
+ class CommunicationFrame {
+ 	static constexpr bool Disjoint() {
+ 		const uint64_t masks[] = { Fields::mask... };
+ 		uint64_t used = 0;
+ 		for (unsigned int i = 0; i < sizeof...(Fields); i++) {
+ 			if (used & masks[i]) {
+ 				return false;
+ 			}
+ 			used |= masks[i];
+ 		}
+ 		return true;
+ 	}
+
+ 	static constexpr unsigned int Needed() {
+ 		const unsigned int needed[] = { Fields::bytes... };
+ 		unsigned int result = 0;
+ 		for (unsigned int i = 0; i < sizeof...(Fields); i++) {
+ 			result = (needed[i] > result) ? needed[i] : result;
+ 		}
+ 		return result;
+ 	}
+
+ 	static_assert(sizeof...(Fields) > 0, "A frame needs at least one field");
+ 	static_assert((Bytes > 0) && (Bytes <= 8), "Frames carry 1 to 8 bytes");
+ 	static_assert(Disjoint(), "Fields overlap");
+ 	static_assert(Needed() <= Bytes, "Field exceeds the frame length");
+
+ public:
+ 	typedef S Values;
+
+ 	static constexpr unsigned int bytes = Bytes;
+ 	static constexpr unsigned int fields = sizeof...(Fields);
+ 	static constexpr COMMUNICATION_fieldLayout_t layout[sizeof...(Fields)] = { Fields::Layout()... };
+
+ 	static constexpr void Pack(const S& values, uint32_t* words) {
+ 		uint64_t motorola = 0;
+ 		uint64_t intel = 0;
+ 		/* Expands to the fields one after another */
+ 		int expand[] = { (Fields::Pack(values, motorola, intel), 0)... };
+ 		(void)expand;
+
+ 		uint64_t frame = motorola | __builtin_bswap64(intel);
+ 		words[0] = frame >> 32;
+ 		words[1] = (uint32_t)frame;
+ 	}
+
+ 	static constexpr void Unpack(const uint32_t* words, S& values) {
+ 		uint64_t motorola = ((uint64_t)words[0] << 32) | words[1];
+ 		uint64_t intel = __builtin_bswap64(motorola);
+ 		int expand[] = { (Fields::Unpack(values, motorola, intel), 0)... };
+ 		(void)expand;
+ 	}
+
+ 	/* Entry points for the CommunicationManager */
+ 	static void PackRef(const void* val, uint32_t* words) {
+ 		Pack(*(const S*)val, words);
+ 	}
+
+ 	static void UnpackRef(void* val, const uint32_t* words) {
+ 		Unpack(words, *(S*)val);
+ 	}
+ };
+
+ template <typename S, unsigned int Bytes, typename... Fields>
+ constexpr COMMUNICATION_fieldLayout_t CommunicationFrame<S, Bytes, Fields...>::layout[sizeof...(Fields)];
+
+ #endif
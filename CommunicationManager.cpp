@@ -7,21 +7,102 @@
  */
 #ifndef COMMUNICATION_TEST_ENV
 #include "Arduino.h"
-#include "CommunicationManager.h"
 #include "FlexCAN.h"
-#include <Metro.h>
+#endif
+#include "CommunicationManager.h"
+#include <string.h>
+#include <math.h>
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "Payload conversion expects a little endian target"
+#endif
+
+#ifdef COMMUNICATION_TEST_ENV
+/* Host stand-in for the mailbox registers */
+static void COMMUNICATION_testMsg(CAN_test_msg_t* msg, uint16_t msgID, const uint32_t* words, uint8_t lengthOfData) {
+	msg->ext = 0;
+	msg->id = msgID;
+	msg->len = lengthOfData;
+	msg->timeout = 0;
+	for (int i = 0; i < 8; i++) {
+		msg->buf[i] = words[i >> 2] >> (24 - 8 * (i & 3));
+	}
+}
 #endif
 
-static Metro COMMUNICATION_cycle10 = Metro(10);
-static Metro COMMUNICATION_cycle20 = Metro(20);
-static Metro COMMUNICATION_cycle40 = Metro(40);
-static Metro COMMUNICATION_cycle80 = Metro(80);
-static Metro COMMUNICATION_cycle100 = Metro(100);
+/************************************************************************
+ * Payload conversion between the mailbox data words (byte 0 of the frame is
+ * the most significant byte of word 0) and a value of N bytes in memory.
+ */
+template <unsigned int N>
+static inline void COMMUNICATION_unpack(const uint32_t* words, unsigned char* out, COMMUNICATION_BYTE_ORDER byteOrder) {
+	if (ORDER_MSB == byteOrder) {
+		/* Frame byte 0 is the most significant byte of the value */
+		uint64_t value = (((uint64_t)words[0] << 32) | words[1]) >> (64 - 8 * N);
+		memcpy(out, &value, N);
+	}
+	else {
+		uint32_t value[2] = { __builtin_bswap32(words[0]), __builtin_bswap32(words[1]) };
+		memcpy(out, value, N);
+	}
+}
+
+template <unsigned int N>
+static inline void COMMUNICATION_pack(const unsigned char* in, uint32_t* words, COMMUNICATION_BYTE_ORDER byteOrder) {
+	if (ORDER_MSB == byteOrder) {
+		uint64_t value = 0;
+		memcpy(&value, in, N);
+		value <<= 64 - 8 * N;
+		words[0] = value >> 32;
+		words[1] = (uint32_t)value;
+	}
+	else {
+		uint32_t value[2] = { 0, 0 };
+		memcpy(value, in, N);
+		words[0] = __builtin_bswap32(value[0]);
+		words[1] = __builtin_bswap32(value[1]);
+	}
+}
 
 CommunicationManager::CommunicationManager() {
+#if COMMUNICATION_STATIC_TABLES
+	producers = nullptr;
+	consumers = nullptr;
+	signals = nullptr;
+#endif
 	nProducers = 0;
+	nQueueIds = 0;
+	nEvents = 0;
 	nConsumers = 0;
+	nInterruptConsumers = 0;
+	nSignals = 0;
+	emergencyHead = 0;
 	nEmergencies = 0;
+	reservedId = 0;
+	preemptMailbox = -1;
+	abortedFrames = 0;
+	txMailboxMask = 0;
+	abortMailbox = -1;
+	frameHead = 0;
+	nFrames = 0;
+	frameMailboxMask = 0;
+	messagesSent = 0;
+	maxMessagesSent = 0;
+	rxMode = RX_POLLING;
+	txMode = TX_QUEUE;
+	scheduleStart = 0;
+	InitWheel();
+	InitPhaseLoad();
+	baud = 500000;
+	projectedBits = 0;
+	updateMicros = 0;
+	InitLoad();
+	nRxFilters = 0;
+	nCachedFrames = 0;
+	initialized = false;
+	InitRxRing();
+	InitList();
+	InitDispatch();
 }
 
 CommunicationManager* CommunicationManager::GetInstance() {
@@ -29,21 +110,120 @@ CommunicationManager* CommunicationManager::GetInstance() {
 	return &instance;
 }
 
-void CommunicationManager::Initialize(uint32_t baud, COMMUNICATION_BYTE_ORDER byteOrder) {
+void CommunicationManager::Initialize(uint32_t baud, COMMUNICATION_BYTE_ORDER byteOrder, COMMUNICATION_RX_MODE rxMode, COMMUNICATION_TX_MODE txMode) {
+	this->rxMode = rxMode;
+	this->txMode = txMode;
+	this->baud = baud;
+	InitRxRing();
 	InitCan(baud);
+	preemptMailbox = -1;
+	txMailboxMask = 0;
+	abortMailbox = -1;
+	frameHead = 0;
+	nFrames = 0;
+	frameMailboxMask = 0;
 	InitNodes();
 	InitList();
 	this->byteOrder = byteOrder;
+
+	/* Cycles start now */
+	scheduleStart = micros();
+	InitWheel();
+	for (unsigned int i = 0; i < nProducers; i++) {
+		InitSchedule(i);
+	}
+
+	/* Projection of the producers registered so far, Publish() adds the
+	 * ones registered later.
+	 */
+	projectedBits = 0;
+	for (unsigned int i = 0; i < nProducers; i++) {
+		projectedBits += (FrameBits(producers[i].bytes) * 1000000UL) / producers[i].cycle;
+	}
+	InitLoad();
+	ResetLatency();
+
+	/* Acceptance filters of the subscriptions so far, Subscribe() adds the
+	 * ones registered later.
+	 */
+	UpdateRxFilters();
+	ApplyRxFilters();
+	initialized = true;
+}
+
+#if COMMUNICATION_STATIC_TABLES
+void CommunicationManager::Initialize(const COMMUNICATION_tables_t &tables, uint32_t baud, COMMUNICATION_BYTE_ORDER byteOrder, COMMUNICATION_RX_MODE rxMode, COMMUNICATION_TX_MODE txMode) {
+	producers = tables.producers;
+	consumers = tables.consumers;
+	nConsumers = tables.nConsumers;
+	stdDispatch = tables.stdDispatch;
+	extDispatch = tables.extDispatch;
+	this->baud = baud;
+
+	/* Phases are chosen in table order, like a series of Publish() calls.
+	 * The producers end at the first invalid entry.
+	 */
+	nProducers = 0;
+	nQueueIds = 0;
+	nCachedFrames = 0;
+	InitPhaseLoad();
+	while (nProducers < tables.nProducers) {
+		const COMMUNICATION_producer_t &producer = producers[nProducers];
+		uint32_t phase = producer.phase;
+
+		if ((nProducers >= COMMUNICATION_MAX_PRODUCERS) || (producer.canId >= COMMUNICATION_STD_IDS) || (producer.bytes > 8) ||
+			(0 == producer.cycle) || (nullptr == producer.txFlag) || ((COMMUNICATION_PHASE_AUTO != phase) && (phase >= producer.cycle))) {
+			COMMUNICATION_DEBUG_PRINT("[");
+			COMMUNICATION_DEBUG_PRINT(millis(), DEC);
+			COMMUNICATION_DEBUG_PRINT("] CommunicationManager: Failed to register Publisher with Can Id ");
+			COMMUNICATION_DEBUG_PRINT(producer.canId, HEX);
+			COMMUNICATION_DEBUG_PRINTLN(", invalid table entry!");
+			break;
+		}
+
+		timers[nProducers].phase = (COMMUNICATION_PHASE_AUTO == phase) ? AutoPhase(producer.cycle) : phase;
+		AddPhaseLoad(nProducers);
+		AddQueueBucket(nProducers);
+#if COMMUNICATION_TX_STATISTICS
+		coalesced[nProducers] = 0;
+#endif
+		if (producer.dirty && !AddCacheSlot(nProducers)) {
+			COMMUNICATION_DEBUG_PRINT("[");
+			COMMUNICATION_DEBUG_PRINT(millis(), DEC);
+			COMMUNICATION_DEBUG_PRINT("] CommunicationManager: Failed to register Publisher with Can Id ");
+			COMMUNICATION_DEBUG_PRINT(producer.canId, HEX);
+			COMMUNICATION_DEBUG_PRINTLN(", frame cache full!");
+			break;
+		}
+
+		*producer.txFlag = 0;
+		if (producer.dirty) {
+			*producer.dirty = 1;
+		}
+		nProducers += 1;
+	}
+
+	nInterruptConsumers = 0;
+	for (unsigned int i = 0; i < nConsumers; i++) {
+		if (consumers[i].rxFlag) {
+			*consumers[i].rxFlag = 0;
+		}
+		if (consumers[i].snapshot) {
+			((COMMUNICATION_snapshot_t*)consumers[i].ref)->sequence = 0;
+		}
+		if (consumers[i].interrupt) {
+			nInterruptConsumers += 1;
+		}
+	}
+
+	Initialize(baud, byteOrder, rxMode, txMode);
 }
+#endif
 
 bool CommunicationManager::Fire(unsigned int canId) {
 	for (unsigned int i = 0; i < nProducers; i++) {
 		if (producers[i].canId == canId) {
-			return Fire(
-				producers[i].ref,
-				producers[i].bytes,
-				producers[i].canId
-			);
+			return FireProducer(producers[i]);
 		}
 	}
 
@@ -58,19 +238,54 @@ bool CommunicationManager::Fire(unsigned int canId) {
 }
 
 bool CommunicationManager::Fire(void* val, unsigned int bytes, unsigned int canId) {
-	if (bytes > 8) {
+	COMMUNICATION_producer_t producer;
+	producer.ref = val;
+	producer.bytes = (bytes > 0xFF) ? 0xFF : bytes;
+	producer.signals = COMMUNICATION_NO_SIGNAL;
+	producer.event = COMMUNICATION_NO_EVENT;
+	producer.pack = nullptr;
+	producer.canId = canId;
+	producer.txFlag = nullptr;
+	producer.dirty = nullptr;
+	producer.cycle = 0;
+	producer.phase = 0;
+
+	return FireProducer(producer);
+}
+
+bool CommunicationManager::FireProducer(COMMUNICATION_producer_t producer) {
+	unsigned int canId = producer.canId;
+
+	if (producer.bytes > 8) {
 		COMMUNICATION_DEBUG_PRINT("[");
 		COMMUNICATION_DEBUG_PRINT(millis(), DEC);
 		COMMUNICATION_DEBUG_PRINT("] CommunicationManager: in Fire(void* val, unsigned int bytes, unsigned int canId=");
 		COMMUNICATION_DEBUG_PRINT(canId, HEX);
 		COMMUNICATION_DEBUG_PRINTLN(") message size truncated to 8 byte!");
-		bytes = 8;
+		producer.bytes = 8;
+	}
+
+	if (canId >= COMMUNICATION_STD_IDS) {
+		COMMUNICATION_DEBUG_PRINT("[");
+		COMMUNICATION_DEBUG_PRINT(millis(), DEC);
+		COMMUNICATION_DEBUG_PRINT("] CommunicationManager: in Fire(void* val, unsigned int bytes, unsigned int canId=");
+		COMMUNICATION_DEBUG_PRINT(canId, HEX);
+		COMMUNICATION_DEBUG_PRINTLN(") Can ID exceeds 11 bit!");
+
+		/* Failed: Only standard identifiers can be sent */
+		return false;
 	}
 
-	if (COMMUNICATION_FIRE_STACK_SIZE > nEmergencies) {
-		emergencies[nEmergencies].ref = (unsigned char*)val;
-		emergencies[nEmergencies].bytes = bytes;
-		emergencies[nEmergencies].canId = canId;
+	/* Every Fire() is an event of its own and sent, also in TX_COALESCE */
+	if (COMMUNICATION_FIRE_QUEUE_SIZE > nEmergencies) {
+		unsigned int i = (emergencyHead + nEmergencies) % COMMUNICATION_FIRE_QUEUE_SIZE;
+		/* Snapshot of the value, val may go out of scope */
+		PackProducer(producer, emergencies[i].words);
+		emergencies[i].queued = micros();
+		emergencies[i].canId = canId;
+		emergencies[i].bytes = producer.bytes;
+		emergencies[i].source = FindProducer(canId);
+		emergencies[i].next = COMMUNICATION_NO_NODE;
 		nEmergencies += 1;
 
 		/* Success */
@@ -83,29 +298,103 @@ bool CommunicationManager::Fire(void* val, unsigned int bytes, unsigned int canI
 	COMMUNICATION_DEBUG_PRINT(canId, HEX);
 	COMMUNICATION_DEBUG_PRINTLN(") Emergency queue is full!");
 
-	/* Failed: Emergency stack full */
+	/* Failed: Emergency queue full */
 	return false;
 }
 
-bool CommunicationManager::Publish(void* val, unsigned int bytes, unsigned int canId, unsigned char* txFlag, COMMUNICATION_CYCLE cycle) {
+bool CommunicationManager::Publish(void* val, unsigned int bytes, unsigned int canId, unsigned char* txFlag, uint32_t cycle, uint32_t phase) {
+	return AddProducer(val, bytes, canId, txFlag, cycle, phase, nullptr);
+}
+
+#if COMMUNICATION_STATIC_TABLES
+bool CommunicationManager::AddProducer(void*, unsigned int, unsigned int canId, unsigned char*, uint32_t, uint32_t, COMMUNICATION_PACKER) {
+	COMMUNICATION_DEBUG_PRINT("[");
+	COMMUNICATION_DEBUG_PRINT(millis(), DEC);
+	COMMUNICATION_DEBUG_PRINT("] CommunicationManager: Failed to register Publisher with Can Id ");
+	COMMUNICATION_DEBUG_PRINT(canId, HEX);
+	COMMUNICATION_DEBUG_PRINTLN(", tables are static!");
+
+	/* Failed: Producers are taken from the static tables */
+	return false;
+}
+#else
+bool CommunicationManager::AddProducer(void* val, unsigned int bytes, unsigned int canId, unsigned char* txFlag, uint32_t cycle, uint32_t phase, COMMUNICATION_PACKER pack) {
 	if (bytes > 8) {
 		COMMUNICATION_DEBUG_PRINT("[");
 		COMMUNICATION_DEBUG_PRINT(millis(), DEC);
 		COMMUNICATION_DEBUG_PRINT("] CommunicationManager: in Publish(void* val, unsigned int bytes, unsigned int canId=");
 		COMMUNICATION_DEBUG_PRINT(canId, HEX);
-		COMMUNICATION_DEBUG_PRINTLN(", unsigned char* txFlag, COMMUNICATION_CYCLE cycle) message size truncated to 8 byte!");
+		COMMUNICATION_DEBUG_PRINTLN(", unsigned char* txFlag, uint32_t cycle) message size truncated to 8 byte!");
 		bytes = 8;
 	}
 
+	if (canId >= COMMUNICATION_STD_IDS) {
+		COMMUNICATION_DEBUG_PRINT("[");
+		COMMUNICATION_DEBUG_PRINT(millis(), DEC);
+		COMMUNICATION_DEBUG_PRINT("] CommunicationManager: Failed to register Publisher with Can Id ");
+		COMMUNICATION_DEBUG_PRINT(canId, HEX);
+		COMMUNICATION_DEBUG_PRINTLN(", Can ID exceeds 11 bit!");
+
+		/* Failed: Only standard identifiers can be sent */
+		return false;
+	}
+
+	if (0 == cycle) {
+		COMMUNICATION_DEBUG_PRINT("[");
+		COMMUNICATION_DEBUG_PRINT(millis(), DEC);
+		COMMUNICATION_DEBUG_PRINT("] CommunicationManager: Failed to register Publisher with Can Id ");
+		COMMUNICATION_DEBUG_PRINT(canId, HEX);
+		COMMUNICATION_DEBUG_PRINTLN(", cycle time is zero!");
+
+		/* Failed: No cycle time */
+		return false;
+	}
+
+	if (COMMUNICATION_PHASE_AUTO == phase) {
+		phase = AutoPhase(cycle);
+	}
+	else if (phase >= cycle) {
+		COMMUNICATION_DEBUG_PRINT("[");
+		COMMUNICATION_DEBUG_PRINT(millis(), DEC);
+		COMMUNICATION_DEBUG_PRINT("] CommunicationManager: Failed to register Publisher with Can Id ");
+		COMMUNICATION_DEBUG_PRINT(canId, HEX);
+		COMMUNICATION_DEBUG_PRINTLN(", phase exceeds cycle time!");
+
+		/* Failed: Phase out of range */
+		return false;
+	}
+
 	if (COMMUNICATION_MAX_PRODUCERS > nProducers) {
-		producers[nProducers].ref = (unsigned char*)val;
+		producers[nProducers].ref = val;
 		producers[nProducers].bytes = bytes;
+		producers[nProducers].signals = COMMUNICATION_NO_SIGNAL;
+		producers[nProducers].event = COMMUNICATION_NO_EVENT;
+		producers[nProducers].pack = pack;
 		producers[nProducers].canId = canId;
 		producers[nProducers].cycle = cycle;
+		producers[nProducers].phase = phase;
 		producers[nProducers].txFlag = txFlag;
+		producers[nProducers].dirty = nullptr;
 		*txFlag = 0;
+#if COMMUNICATION_TX_STATISTICS
+		coalesced[nProducers] = 0;
+#endif
+		ResetLatency(nProducers);
+		timers[nProducers].phase = phase;
+		InitSchedule(nProducers);
+		AddPhaseLoad(nProducers);
+		AddQueueBucket(nProducers);
 		nProducers += 1;
 
+		projectedBits += (FrameBits(bytes) * 1000000UL) / cycle;
+		if (projectedBits > baud) {
+			COMMUNICATION_DEBUG_PRINT("[");
+			COMMUNICATION_DEBUG_PRINT(millis(), DEC);
+			COMMUNICATION_DEBUG_PRINT("] CommunicationManager: Publisher with Can Id ");
+			COMMUNICATION_DEBUG_PRINT(canId, HEX);
+			COMMUNICATION_DEBUG_PRINTLN(" exceeds the bus capacity (projected load > 100%)!");
+		}
+
 		/* Success */
 		return true;
 	}
@@ -119,309 +408,2125 @@ bool CommunicationManager::Publish(void* val, unsigned int bytes, unsigned int c
 	/* Failed: To many publishers */
 	return false;
 }
+#endif
 
-bool CommunicationManager::Subscribe(void* val, unsigned int bytes, unsigned int canId, unsigned char* rxFlag) {
-	if (COMMUNICATION_MAX_CONSUMERS > nConsumers) {
-		consumers[nConsumers].ref = (unsigned char*)val;
-		consumers[nConsumers].bytes = bytes;
-		consumers[nConsumers].canId = canId;
-		consumers[nConsumers].rxFlag = rxFlag;
-		*rxFlag = 0;
-		nConsumers += 1;
-
-		/* Success */
-		return true;
-	}
-
-	COMMUNICATION_DEBUG_PRINT("[");
-	COMMUNICATION_DEBUG_PRINT(millis(), DEC);
-	COMMUNICATION_DEBUG_PRINT("] CommunicationManager: Failed to register Subscriber with Can Id ");
-	COMMUNICATION_DEBUG_PRINT(canId, HEX);
-	COMMUNICATION_DEBUG_PRINTLN(", not enough memory allocated!");
+bool CommunicationManager::PublishOnChange(void* val, unsigned int bytes, unsigned int canId, unsigned char* txFlag, uint32_t inhibit, uint32_t heartbeat) {
+	COMMUNICATION_event_t event = {};
+	event.numeric = false;
 
-	/* Failed: to many subscribers */
-	return false;
+	return AddEventProducer(val, bytes, canId, txFlag, inhibit, heartbeat, event);
 }
 
-void CommunicationManager::Update() {
-	// Handle incomming messages
-	uint32_t inId;
-	unsigned char inBuf[8];
-	while (ReceiveCanMessage(&inId, inBuf, 8)) {
-		// Look for consumers
-		for (unsigned int i = 0; i < nConsumers; i++) {
-			if (consumers[i].canId == inId) {
-				unsigned char* outData = (uint8_t*)consumers[i].ref;
-				unsigned int bytes = consumers[i].bytes;
-
-				// Restore byte order
-				if(ORDER_MSB == byteOrder) {
-					for(unsigned int n=0; n<bytes; n++) {
-						outData[(bytes-1)-n] = inBuf[n];
-					}
-				}
-				else {
-					for(unsigned int n=0; n<bytes; n++) {
-						outData[n] = inBuf[n];
-					}
-				}
-
-				// Indicate arrival of a message
-				*(consumers[i].rxFlag) = 1;
-			}
-		}
-	}
+bool CommunicationManager::PublishOnChange(void* val, COMMUNICATION_SIGNAL_TYPE type, unsigned int canId, unsigned char* txFlag, float deadband, uint32_t inhibit, uint32_t heartbeat) {
+	COMMUNICATION_event_t event = {};
+	event.numeric = true;
+	event.type = type;
+	event.deadband = fabsf(deadband);
 
-	// Handle emergency messages
-	while (nEmergencies > 0) {
-		unsigned int i = nEmergencies - 1;
-		if (!ListAdd(emergencies[i])) {
-			COMMUNICATION_DEBUG_PRINT("[");
-			COMMUNICATION_DEBUG_PRINT(millis(), DEC);
-			COMMUNICATION_DEBUG_PRINT("] CommunicationManager: ");
-			COMMUNICATION_DEBUG_PRINT(emergencies[i].canId, HEX);
-			COMMUNICATION_DEBUG_PRINTLN(" Queue failed (Emergency)!");
-		}
-		nEmergencies -= 1;
+	unsigned int bytes = 4;
+	if ((SIGNAL_UINT8 == type) || (SIGNAL_INT8 == type)) {
+		bytes = 1;
 	}
-
-	// Handle message queuing
-	uint8_t cycleFlags[] = {
-	  COMMUNICATION_cycle10.check(),
-	  COMMUNICATION_cycle20.check(),
-	  COMMUNICATION_cycle40.check(),
-	  COMMUNICATION_cycle80.check(),
-	  COMMUNICATION_cycle100.check()
-	};
-
-	for (unsigned int j = 0; j < nProducers; j++) {
-		if (1 == cycleFlags[(uint32_t)producers[j].cycle]) {
-			if (!ListAdd(producers[j])) {
-				COMMUNICATION_DEBUG_PRINT("[");
-				COMMUNICATION_DEBUG_PRINT(millis(), DEC);
-				COMMUNICATION_DEBUG_PRINT("] CommunicationManager: ");
-				COMMUNICATION_DEBUG_PRINT(producers[j].canId, HEX);
-				COMMUNICATION_DEBUG_PRINTLN(" Queue failed!");
-			}
-			else {
-				// Indicate transmission of a message
-				*(producers[j].txFlag) = 1;
-			}
-		}
+	else if ((SIGNAL_UINT16 == type) || (SIGNAL_INT16 == type)) {
+		bytes = 2;
 	}
 
-
-	// Handle message transmission
-	if (!ListEmpty()) {
-		COMMUNICATION_producer_t producer = ListGetHead();
-		unsigned int outId = producer.canId;
-		unsigned char* data = producer.ref;
-		unsigned char bytes = producer.bytes;
-		uint8_t dataOut[8];
-
-		// Restore byte order
-		if(ORDER_MSB == byteOrder) {
-			for(uint8_t i=0; i<bytes; i++) {
-				dataOut[(bytes-1)-i] = data[i];
-			}
-		}
-		else {
-			for(uint8_t i=0; i<bytes; i++) {
-				dataOut[i] = data[i];
-			}
-		}
-
-		// Send data
-		if (SendCanMessage(outId, dataOut, bytes)) {
-			// Free storage
-			ListRemoveHead();
-		}
-		else {
-		}
-	}
+	return AddEventProducer(val, bytes, canId, txFlag, inhibit, heartbeat, event);
 }
 
-unsigned int CommunicationManager::GetMessageUtilization() {
-	return nNodes;
+#if COMMUNICATION_STATIC_TABLES
+bool CommunicationManager::AddEventProducer(void* val, unsigned int bytes, unsigned int canId, unsigned char* txFlag, uint32_t inhibit, uint32_t, const COMMUNICATION_event_t &) {
+	/* Producers are taken from the static tables, AddProducer() fails */
+	return AddProducer(val, bytes, canId, txFlag, inhibit, COMMUNICATION_PHASE_AUTO, nullptr);
 }
 
-unsigned int CommunicationManager::GetMaxMessageUtilization() {
-	return maxNodesUsed;
+bool CommunicationManager::EventDue(unsigned char) {
+	return true;
 }
+#else
+bool CommunicationManager::AddEventProducer(void* val, unsigned int bytes, unsigned int canId, unsigned char* txFlag, uint32_t inhibit, uint32_t heartbeat, const COMMUNICATION_event_t &event) {
+	if ((heartbeat > 0) && (heartbeat < inhibit)) {
+		COMMUNICATION_DEBUG_PRINT("[");
+		COMMUNICATION_DEBUG_PRINT(millis(), DEC);
+		COMMUNICATION_DEBUG_PRINT("] CommunicationManager: Failed to register Publisher with Can Id ");
+		COMMUNICATION_DEBUG_PRINT(canId, HEX);
+		COMMUNICATION_DEBUG_PRINTLN(", heartbeat below inhibit time!");
 
-void CommunicationManager::InitCan(uint32_t baud) {
-  #ifndef COMMUNICATION_TEST_ENV
-	CAN_Can0 = FlexCAN(baud);
-	//Set recive CAN_filter
-	CAN_filter.id = 0;
-	CAN_filter.ext = 0;
-	CAN_filter.rtr = 0;
-	CAN_Can0.begin(CAN_filter);
-  #endif
-}
+		/* Failed: Heartbeat can not be kept */
+		return false;
+	}
 
-int CommunicationManager::SendCanMessage(uint16_t msgID, uint8_t *data, uint8_t lengthOfData) {
-	/* Array index */
-	int i;
+	if (COMMUNICATION_MAX_EVENT_PRODUCERS <= nEvents) {
+		COMMUNICATION_DEBUG_PRINT("[");
+		COMMUNICATION_DEBUG_PRINT(millis(), DEC);
+		COMMUNICATION_DEBUG_PRINT("] CommunicationManager: Failed to register Publisher with Can Id ");
+		COMMUNICATION_DEBUG_PRINT(canId, HEX);
+		COMMUNICATION_DEBUG_PRINTLN(", not enough memory allocated!");
 
+		/* Failed: To many event publishers */
+		return false;
+	}
 
-	#ifdef COMMUNICATION_TEST_ENV
-	CAN_test_msg_t CAN_outMsg;
-	#endif
+	/* The timer checks the value every inhibit time */
+	if (!AddProducer(val, bytes, canId, txFlag, inhibit, COMMUNICATION_PHASE_AUTO, nullptr)) {
+		/* Failed: Producer not registered */
+		return false;
+	}
 
-	CAN_outMsg.ext = 0;
-	CAN_outMsg.id = msgID;
+	/* Heartbeat rounded down to whole checks */
+	uint32_t checks = heartbeat / inhibit;
+	events[nEvents] = event;
+	events[nEvents].heartbeat = (checks > 0xFFFF) ? 0xFFFF : checks;
+	events[nEvents].silent = 0;
+	events[nEvents].sent = false;
+	producers[nProducers - 1].event = nEvents;
+	nEvents += 1;
+
+	/* Success */
+	return true;
+}
 
-	if (lengthOfData > 8) {
-		lengthOfData = 8;
-	}
+bool CommunicationManager::EventDue(unsigned char producer) {
+	COMMUNICATION_event_t &event = events[producers[producer].event];
+	const unsigned char* ref = (const unsigned char*)producers[producer].ref;
+	unsigned int bytes = producers[producer].bytes;
+	bool due = !event.sent;
 
-	for (i = 0; i < lengthOfData; i++) {
-			CAN_outMsg.buf[i] = data[i];
+	if (event.silent < 0xFFFF) {
+		event.silent += 1;
 	}
 
-	CAN_outMsg.len = i;
-
-	/* Dissable timeout (0ms) */
-	CAN_outMsg.timeout = 0;
+	float value = 0.0f;
+	if (event.numeric) {
+		value = EventValue(ref, (COMMUNICATION_SIGNAL_TYPE)event.type);
+		due = due || (fabsf(value - event.lastValue) > event.deadband);
+	}
+	else {
+		due = due || (0 != memcmp(ref, event.last, bytes));
+	}
 
-	#ifndef COMMUNICATION_TEST_ENV
-	/* send CAN message */
-	return CAN_Can0.write(CAN_outMsg);
-	#else
-	return Test_send(CAN_outMsg);
-	#endif
-}
+	if (!due && ((0 == event.heartbeat) || (event.silent < event.heartbeat))) {
+		/* Unchanged and no heartbeat due */
+		return false;
+	}
 
-int CommunicationManager::ReceiveCanMessage(uint32_t *id, uint8_t *buf, int n) {
-	#ifdef COMMUNICATION_TEST_ENV
-	CAN_test_msg_t CAN_inMsg;
-	int result = Test_receive(CAN_inMsg);
-	#else
-	int result = CAN_Can0.read(CAN_inMsg);
-	#endif
-	if (result) {
-		// Get id
-		*id = CAN_inMsg.id;
-		// Copy data
-		for (int i = 0; i < n; i++) {
-			buf[i] = CAN_inMsg.buf[i];
-		}
+	/* Deadband and comparison refer to the value of this frame */
+	if (event.numeric) {
+		event.lastValue = value;
 	}
-	return result;
+	else {
+		memcpy(event.last, ref, bytes);
+	}
+	event.silent = 0;
+	event.sent = true;
+	return true;
 }
+#endif
 
-void CommunicationManager::InitNodes() {
-	nNodes = 0;
-	maxNodesUsed = 0;
-	for (uint16_t i = 0; i < COMMUNICATION_MAX_LIST_NODES; i++) {
-		freeNodes[i] = &nodes[i];
+float CommunicationManager::EventValue(const void* val, COMMUNICATION_SIGNAL_TYPE type) {
+	switch (type) {
+		case SIGNAL_UINT8: return *(const uint8_t*)val;
+		case SIGNAL_INT8: return *(const int8_t*)val;
+		case SIGNAL_UINT16: return *(const uint16_t*)val;
+		case SIGNAL_INT16: return *(const int16_t*)val;
+		case SIGNAL_UINT32: return (float)*(const uint32_t*)val;
+		case SIGNAL_INT32: return (float)*(const int32_t*)val;
+		default: return *(const float*)val;
 	}
 }
 
-COMMUNICATION_listNode_t* CommunicationManager::NewNode() {
-	if (nNodes < COMMUNICATION_MAX_LIST_NODES) {
-		COMMUNICATION_listNode_t* result = freeNodes[nNodes++];
+#if COMMUNICATION_STATIC_TABLES
+bool CommunicationManager::CacheFrame(unsigned int canId, unsigned char*) {
+	COMMUNICATION_DEBUG_PRINT("[");
+	COMMUNICATION_DEBUG_PRINT(millis(), DEC);
+	COMMUNICATION_DEBUG_PRINT("] CommunicationManager: Failed to cache Publisher with Can Id ");
+	COMMUNICATION_DEBUG_PRINT(canId, HEX);
+	COMMUNICATION_DEBUG_PRINTLN(", tables are static!");
 
-		/* Keep track of maximal usage.
-		 */
-		if (nNodes > maxNodesUsed) {
-			maxNodesUsed = nNodes;
-		}
-		if (maxNodesUsed == COMMUNICATION_MAX_LIST_NODES) {
-			maxNodesUsed = 0;
-		}
+	/* Failed: COMMUNICATION_CACHED_PRODUCER in the static tables */
+	return false;
+}
+#else
+bool CommunicationManager::CacheFrame(unsigned int canId, unsigned char* dirty) {
+	unsigned char producer = FindProducer(canId);
 
-		return result;
+	if ((COMMUNICATION_NO_PRODUCER == producer) || (nullptr == dirty)) {
+		COMMUNICATION_DEBUG_PRINT("[");
+		COMMUNICATION_DEBUG_PRINT(millis(), DEC);
+		COMMUNICATION_DEBUG_PRINT("] CommunicationManager: Failed to cache Publisher with Can Id ");
+		COMMUNICATION_DEBUG_PRINT(canId, HEX);
+		COMMUNICATION_DEBUG_PRINTLN(", unknown Can ID or no dirty flag!");
+
+		/* Failed: No such producer */
+		return false;
 	}
 
-	return nullptr;
-}
+	if ((nullptr == producers[producer].dirty) && !AddCacheSlot(producer)) {
+		COMMUNICATION_DEBUG_PRINT("[");
+		COMMUNICATION_DEBUG_PRINT(millis(), DEC);
+		COMMUNICATION_DEBUG_PRINT("] CommunicationManager: Failed to cache Publisher with Can Id ");
+		COMMUNICATION_DEBUG_PRINT(canId, HEX);
+		COMMUNICATION_DEBUG_PRINTLN(", single value or cache full!");
 
-void CommunicationManager::DeleteNode(COMMUNICATION_listNode_t* node) {
-	nNodes -= 1;
-	freeNodes[nNodes] = node;
-}
+		/* Failed: Packed on every frame */
+		return false;
+	}
 
-void CommunicationManager::InitList() {
-	nodeList = nullptr;
-}
+	/* The next frame fills the cache */
+	producers[producer].dirty = dirty;
+	*dirty = 1;
 
-bool CommunicationManager::ListAdd(COMMUNICATION_producer_t producer) {
-	COMMUNICATION_listNode_t* newNode = NewNode();
+	/* Success */
+	return true;
+}
+#endif
 
-	if (newNode) {
-		newNode->left = nullptr;
-		newNode->right = nullptr;
-		newNode->producer = producer;
+bool CommunicationManager::Subscribe(void* val, unsigned int bytes, unsigned int canId, unsigned char* rxFlag) {
+	COMMUNICATION_consumer_t consumer = NewConsumer(val, bytes, canId);
+	consumer.rxFlag = rxFlag;
 
-		ListAdd(newNode);
+	if (AddConsumer(consumer)) {
+		*rxFlag = 0;
 
 		/* Success */
 		return true;
 	}
 
-	/* Failed: List full */
+	/* Failed: to many subscribers */
 	return false;
 }
 
-void CommunicationManager::ListAdd(COMMUNICATION_listNode_t* newNode) {
-	if (ListEmpty()) {
-		nodeList = newNode;
-		return;
+bool CommunicationManager::Subscribe(void* val, unsigned int bytes, unsigned int canId, COMMUNICATION_CALLBACK callback, void* context, COMMUNICATION_CALLBACK_MODE mode) {
+	if (nullptr == callback) {
+		COMMUNICATION_DEBUG_PRINT("[");
+		COMMUNICATION_DEBUG_PRINT(millis(), DEC);
+		COMMUNICATION_DEBUG_PRINT("] CommunicationManager: Failed to register Subscriber with Can Id ");
+		COMMUNICATION_DEBUG_PRINT(canId, HEX);
+		COMMUNICATION_DEBUG_PRINTLN(", no callback!");
+
+		/* Failed: Nothing to call */
+		return false;
 	}
 
-	if (newNode->producer.canId > nodeList->producer.canId) {
-		/* Go right */
-		COMMUNICATION_listNode_t* currentNode = nodeList;
-		do {
-			COMMUNICATION_listNode_t* rightNode = currentNode->right;
+	COMMUNICATION_consumer_t consumer = NewConsumer(val, bytes, canId);
+	consumer.interrupt = (CALLBACK_INTERRUPT == mode);
+	consumer.callback = callback;
+	consumer.context = context;
 
-			if (nullptr == rightNode) {
-				/* New elememt has the highest id in the complete list */
-				currentNode->right = newNode;
-				newNode->left = currentNode;
-				return;
-			}
-			currentNode = rightNode;
+	return AddConsumer(consumer);
+}
 
-		} while (newNode->producer.canId > currentNode->producer.canId);
+bool CommunicationManager::SubscribeFrames(unsigned int canId, COMMUNICATION_FRAME_HANDLER handler, void* context) {
+	COMMUNICATION_consumer_t consumer = NewConsumer(nullptr, 8, canId);
+	consumer.handler = handler;
+	consumer.context = context;
 
-		/* New node must be pasted inbetween existing nodes */
-		COMMUNICATION_listNode_t* oldLeftNode = currentNode->left;
-		currentNode->left = newNode;
-		oldLeftNode->right = newNode;
-		newNode->right = currentNode;
-		newNode->left = oldLeftNode;
+	return AddConsumer(consumer);
+}
 
+bool CommunicationManager::SubscribeSnapshot(COMMUNICATION_snapshot_t* snapshot, unsigned int bytes, unsigned int canId) {
+	if ((nullptr == snapshot) || (bytes > 8)) {
+		COMMUNICATION_DEBUG_PRINT("[");
+		COMMUNICATION_DEBUG_PRINT(millis(), DEC);
+		COMMUNICATION_DEBUG_PRINT("] CommunicationManager: Failed to register Subscriber with Can Id ");
+		COMMUNICATION_DEBUG_PRINT(canId, HEX);
+		COMMUNICATION_DEBUG_PRINTLN(", snapshots hold up to 8 bytes!");
+
+		/* Failed: Invalid snapshot */
+		return false;
+	}
+
+	snapshot->sequence = 0;
+	snapshot->words[0] = 0;
+	snapshot->words[1] = 0;
+
+	COMMUNICATION_consumer_t consumer = NewConsumer(snapshot, bytes, canId);
+	consumer.snapshot = true;
+	consumer.interrupt = true;
+
+	return AddConsumer(consumer);
+}
+
+bool CommunicationManager::PublishFrame(unsigned int bytes, unsigned int canId, unsigned char* txFlag, uint32_t cycle, uint32_t phase) {
+	/* A producer without ref is built from its signals */
+	return Publish(nullptr, bytes, canId, txFlag, cycle, phase);
+}
+
+bool CommunicationManager::PublishPacked(void* val, unsigned int bytes, unsigned int canId, unsigned char* txFlag, uint32_t cycle, uint32_t phase, COMMUNICATION_PACKER pack) {
+	return AddProducer(val, bytes, canId, txFlag, cycle, phase, pack);
+}
+
+bool CommunicationManager::SubscribePacked(void* val, unsigned int bytes, unsigned int canId, unsigned char* rxFlag, COMMUNICATION_UNPACKER unpack) {
+	COMMUNICATION_consumer_t consumer = NewConsumer(val, bytes, canId);
+	consumer.rxFlag = rxFlag;
+	consumer.unpack = unpack;
+
+	if (AddConsumer(consumer)) {
+		*rxFlag = 0;
+
+		/* Success */
+		return true;
+	}
+
+	/* Failed: to many subscribers */
+	return false;
+}
+
+#if COMMUNICATION_STATIC_TABLES
+bool CommunicationManager::PublishSignal(void*, COMMUNICATION_SIGNAL_TYPE, unsigned int canId, unsigned char, unsigned char, COMMUNICATION_BYTE_ORDER, float, float) {
+	COMMUNICATION_DEBUG_PRINT("[");
+	COMMUNICATION_DEBUG_PRINT(millis(), DEC);
+	COMMUNICATION_DEBUG_PRINT("] CommunicationManager: Failed to register Signal with Can Id ");
+	COMMUNICATION_DEBUG_PRINT(canId, HEX);
+	COMMUNICATION_DEBUG_PRINTLN(", tables are static!");
+
+	/* Failed: Signal frames are not available, see CommunicationFrame */
+	return false;
+}
+#else
+bool CommunicationManager::PublishSignal(void* val, COMMUNICATION_SIGNAL_TYPE type, unsigned int canId, unsigned char startBit, unsigned char length, COMMUNICATION_BYTE_ORDER byteOrder, float factor, float offset) {
+	unsigned char producer = FindProducer(canId);
+	if ((COMMUNICATION_NO_PRODUCER == producer) || (nullptr != producers[producer].ref)) {
+		COMMUNICATION_DEBUG_PRINT("[");
+		COMMUNICATION_DEBUG_PRINT(millis(), DEC);
+		COMMUNICATION_DEBUG_PRINT("] CommunicationManager: Failed to register Signal with Can Id ");
+		COMMUNICATION_DEBUG_PRINT(canId, HEX);
+		COMMUNICATION_DEBUG_PRINTLN(", no frame published with PublishFrame()!");
+
+		/* Failed: No signal frame */
+		return false;
+	}
+
+	unsigned char signal = AddSignal(val, type, canId, startBit, length, byteOrder, factor, offset);
+	if (COMMUNICATION_NO_SIGNAL == signal) {
+		/* Failed: Invalid layout or to many signals */
+		return false;
+	}
+
+	/* Has to fit into the frame next to the other signals */
+	uint64_t mask = SignalMask(signals[signal]);
+	bool overlaps = false;
+	unsigned char* link = &producers[producer].signals;
+	while (COMMUNICATION_NO_SIGNAL != *link) {
+		overlaps = overlaps || (0 != (mask & SignalMask(signals[*link])));
+		link = &signals[*link].next;
+	}
+
+	if (overlaps || (signals[signal].bytes > producers[producer].bytes)) {
+		COMMUNICATION_DEBUG_PRINT("[");
+		COMMUNICATION_DEBUG_PRINT(millis(), DEC);
+		COMMUNICATION_DEBUG_PRINT("] CommunicationManager: Failed to register Signal with Can Id ");
+		COMMUNICATION_DEBUG_PRINT(canId, HEX);
+		COMMUNICATION_DEBUG_PRINTLN(", signal exceeds the frame or overlaps another signal!");
+
+		/* Failed: Layout conflict, the signal is not used */
+		nSignals -= 1;
+		return false;
+	}
+
+	*link = signal;
+
+	/* Success */
+	return true;
+}
+#endif
+
+bool CommunicationManager::SubscribeSignal(void* val, COMMUNICATION_SIGNAL_TYPE type, unsigned int canId, unsigned char startBit, unsigned char length, COMMUNICATION_BYTE_ORDER byteOrder, unsigned char* rxFlag, float factor, float offset) {
+	unsigned char signal = AddSignal(val, type, canId, startBit, length, byteOrder, factor, offset);
+	if (COMMUNICATION_NO_SIGNAL == signal) {
+		/* Failed: Invalid layout or to many signals */
+		return false;
+	}
+
+	COMMUNICATION_consumer_t consumer = NewConsumer(val, signals[signal].bytes, canId);
+	consumer.signal = signal;
+	consumer.rxFlag = rxFlag;
+
+	if (AddConsumer(consumer)) {
+		*rxFlag = 0;
+
+		/* Success */
+		return true;
+	}
+
+	/* Failed: to many subscribers, the signal is not used */
+	nSignals -= 1;
+	return false;
+}
+
+COMMUNICATION_consumer_t CommunicationManager::NewConsumer(void* val, unsigned int bytes, unsigned int canId) {
+	COMMUNICATION_consumer_t consumer;
+	consumer.ref = val;
+	consumer.bytes = bytes;
+	consumer.signal = COMMUNICATION_NO_SIGNAL;
+	consumer.next = COMMUNICATION_NO_CONSUMER;
+	consumer.snapshot = false;
+	consumer.interrupt = false;
+	consumer.unpack = nullptr;
+	consumer.canId = canId;
+	consumer.rxFlag = nullptr;
+	consumer.handler = nullptr;
+	consumer.context = nullptr;
+	consumer.callback = nullptr;
+
+	return consumer;
+}
+
+#if COMMUNICATION_STATIC_TABLES
+bool CommunicationManager::AddConsumer(const COMMUNICATION_consumer_t &consumer) {
+	COMMUNICATION_DEBUG_PRINT("[");
+	COMMUNICATION_DEBUG_PRINT(millis(), DEC);
+	COMMUNICATION_DEBUG_PRINT("] CommunicationManager: Failed to register Subscriber with Can Id ");
+	COMMUNICATION_DEBUG_PRINT(consumer.canId, HEX);
+	COMMUNICATION_DEBUG_PRINTLN(", tables are static!");
+
+	/* Failed: Consumers are taken from the static tables */
+	return false;
+}
+#else
+bool CommunicationManager::AddConsumer(const COMMUNICATION_consumer_t &consumer) {
+	unsigned int canId = consumer.canId;
+	unsigned char* slot = nullptr;
+
+	if (COMMUNICATION_MAX_CONSUMERS > nConsumers) {
+		slot = DispatchSlot(canId, true);
+	}
+
+	if (slot) {
+		consumers[nConsumers] = consumer;
+		consumers[nConsumers].next = COMMUNICATION_NO_CONSUMER;
+		if (consumer.interrupt) {
+			nInterruptConsumers += 1;
+		}
+
+		/* Append to the consumers of this Can ID, keeps registration order */
+		bool first = (COMMUNICATION_NO_CONSUMER == *slot);
+		while (COMMUNICATION_NO_CONSUMER != *slot) {
+			slot = &consumers[*slot].next;
+		}
+		*slot = nConsumers;
+
+		nConsumers += 1;
+
+		/* The controller stops receiving while the filters are written, so
+		 * this only happens here and in Initialize(), never in Update()
+		 */
+		if (first) {
+			AddRxFilter(canId);
+			if (initialized) {
+				ApplyRxFilters();
+			}
+		}
+
+		/* Success */
+		return true;
+	}
+
+	COMMUNICATION_DEBUG_PRINT("[");
+	COMMUNICATION_DEBUG_PRINT(millis(), DEC);
+	COMMUNICATION_DEBUG_PRINT("] CommunicationManager: Failed to register Subscriber with Can Id ");
+	COMMUNICATION_DEBUG_PRINT(canId, HEX);
+	COMMUNICATION_DEBUG_PRINTLN(", not enough memory allocated!");
+
+	/* Failed: to many subscribers */
+	return false;
+}
+#endif
+
+void CommunicationManager::Update() {
+	updateMicros = micros();
+
+	// Move the bus load window to the current time
+	AdvanceLoad(updateMicros);
+
+	// Handle incomming messages
+	uint32_t inId;
+	uint8_t inLen;
+	const volatile uint32_t* inWords;
+	while (PeekCanMessage(&inId, &inLen, &inWords)) {
+		CountFrame(rxBits, inId, inWords, inLen);
+
+		// Look up consumers
+		unsigned char i = DispatchFirst(inId);
+
+		while (COMMUNICATION_NO_CONSUMER != i) {
+			if (consumers[i].handler) {
+				// Frame level subscriber, bytes in frame order
+				unsigned char data[8];
+				UnpackFrame(inWords, inLen, data, 8, ORDER_LSB);
+				consumers[i].handler(consumers[i].context, inId, data, (inLen > 8) ? 8 : inLen);
+			}
+			else if (consumers[i].unpack) {
+				// Compile time layout, only frames which contain all fields
+				if (inLen >= consumers[i].bytes) {
+					uint32_t frame[2] = { inWords[0], inWords[1] };
+					consumers[i].unpack(consumers[i].ref, frame);
+
+					*(consumers[i].rxFlag) = 1;
+				}
+			}
+			else if (COMMUNICATION_NO_SIGNAL != consumers[i].signal) {
+				// Signal subscriber, only frames which contain the signal
+				const COMMUNICATION_signal_t& signal = signals[consumers[i].signal];
+				if (inLen >= signal.bytes) {
+					uint64_t frame = ((uint64_t)inWords[0] << 32) | inWords[1];
+					if (ORDER_LSB == signal.byteOrder) {
+						frame = __builtin_bswap64(frame);
+					}
+					SignalStore(signal, (uint32_t)(frame >> signal.shift));
+
+					*(consumers[i].rxFlag) = 1;
+				}
+			}
+			else if (consumers[i].callback) {
+				// Interrupt callbacks were called when the frame arrived
+				if (!consumers[i].interrupt || (RX_INTERRUPT != rxMode)) {
+					UnpackFrame(inWords, inLen, (unsigned char*)consumers[i].ref, consumers[i].bytes, byteOrder);
+					consumers[i].callback(consumers[i].context, consumers[i].ref);
+				}
+			}
+			else if (consumers[i].snapshot) {
+				// Written when the frame arrived (RX_INTERRUPT)
+				if (RX_INTERRUPT != rxMode) {
+					StoreSnapshot(consumers[i], inWords, inLen);
+				}
+			}
+			else {
+				// Restore byte order, straight from the frame into the subscriber
+				UnpackFrame(inWords, inLen, (unsigned char*)consumers[i].ref, consumers[i].bytes, byteOrder);
+
+				// Indicate arrival of a message
+				*(consumers[i].rxFlag) = 1;
+			}
+
+			i = consumers[i].next;
+		}
+
+		ReleaseCanMessage();
+	}
+
+	// Handle emergency messages in the order they were fired
+	messagesSent = 0;
+	while (nEmergencies > 0) {
+		unsigned int i = emergencyHead;
+		if (!SendEmergency(emergencies[i])) {
+			// Waits for the reserved mailbox
+			break;
+		}
+
+		RecordLatency(emergencies[i].source, updateMicros - emergencies[i].queued);
+		emergencyHead = (emergencyHead + 1) % COMMUNICATION_FIRE_QUEUE_SIZE;
+		nEmergencies -= 1;
+		messagesSent += 1;
+	}
+
+	// Handle message queuing: only the producers which are due
+	unsigned char expired = WheelExpire(updateMicros);
+
+	while (COMMUNICATION_NO_TIMER != expired) {
+		unsigned char j = expired;
+		expired = timers[j].next;
+
+		// One frame for any number of missed cycles, the next one is due on
+		// the phase grid after now (like InitSchedule())
+		uint32_t cycle = producers[j].cycle;
+		timers[j].due += cycle;
+		if ((int32_t)(updateMicros - timers[j].due) >= 0) {
+			timers[j].due += ((updateMicros - timers[j].due) / cycle + 1) * cycle;
+		}
+		WheelInsert(j);
+
+		// Producers sent on change skip the checks without a change
+		if ((COMMUNICATION_NO_EVENT != producers[j].event) && !EventDue(j)) {
+			continue;
+		}
+
+		if ((TX_COALESCE == txMode) && ListRefresh(j)) {
+			// Pending frame is sent instead, it carries the value of that time
+#if COMMUNICATION_TX_STATISTICS
+			coalesced[j] += 1;
+#endif
+			*(producers[j].txFlag) = 1;
+		}
+		else if (!ListAdd(j, updateMicros)) {
+			COMMUNICATION_DEBUG_PRINT("[");
+			COMMUNICATION_DEBUG_PRINT(millis(), DEC);
+			COMMUNICATION_DEBUG_PRINT("] CommunicationManager: ");
+			COMMUNICATION_DEBUG_PRINT(producers[j].canId, HEX);
+			COMMUNICATION_DEBUG_PRINTLN(" Queue failed!");
+		}
+		else {
+			// Indicate transmission of a message
+			*(producers[j].txFlag) = 1;
+		}
+	}
+
+
+	// Handle message transmission: fill free mailboxes in priority order,
+	// the frame queue takes its turn by Can ID
+	bool framesWait = false;
+	while (true) {
+		int first;
+		bool frameReady = !framesWait && FrameReady(&first);
+		if (!frameReady && ListEmpty()) {
+			break;
+		}
+
+		if (frameReady && (ListEmpty() || (frameQueue[frameHead].canId < ListHeadId()))) {
+			if (SendQueuedFrame(first)) {
+				messagesSent += 1;
+			}
+			else if (first > 0) {
+				// No mailbox above the pending frames of this Can ID
+				framesWait = true;
+			}
+			else {
+				// All mailboxes are occupied
+				break;
+			}
+			continue;
+		}
+
+		// TX_QUEUE: payload was packed when the frame was queued,
+		// TX_COALESCE: the frame takes the value of its producer now
+		COMMUNICATION_listNode_t* head = ListGetHead();
+		unsigned int outId = head->canId;
+		unsigned char bytes = head->bytes;
+		if (TX_COALESCE == txMode) {
+			ProducerWords(head->source, head->words);
+		}
+
+		// Send data
+		int mailbox = SendCanMessage(outId, head->words, bytes);
+		if (mailbox >= 0) {
+			CountFrame(txBits, outId, head->words, bytes);
+			RecordLatency(head->source, updateMicros - head->queued);
+
+			txMailboxes[mailbox].words[0] = head->words[0];
+			txMailboxes[mailbox].words[1] = head->words[1];
+			txMailboxes[mailbox].queued = head->queued;
+			txMailboxes[mailbox].canId = outId;
+			txMailboxes[mailbox].bytes = bytes;
+			txMailboxes[mailbox].source = head->source;
+			txMailboxMask |= (1U << mailbox);
+			frameMailboxMask &= ~(1U << mailbox);
+
+			// Free storage
+			ListRemoveHead();
+			messagesSent += 1;
+		}
+		else {
+			// All mailboxes are occupied, the controller sends the pending
+			// frame with the lowest Can ID first
+			break;
+		}
+	}
+
+	if (messagesSent > maxMessagesSent) {
+		maxMessagesSent = messagesSent;
+	}
+}
+
+bool CommunicationManager::SendEmergency(const COMMUNICATION_listNode_t &emergency) {
+	const uint32_t* words = emergency.words;
+
+	if (SendReservedCanMessage(emergency.canId, words, emergency.bytes) >= 0) {
+		reservedId = emergency.canId;
+	}
+	else {
+		/* Reserved mailbox busy: only a more urgent frame may take over a
+		 * queued frame's mailbox, one at a time so that the controller
+		 * never has to order two of them by mailbox number.
+		 */
+		if ((emergency.canId >= reservedId) || ((preemptMailbox >= 0) && TxPending(preemptMailbox))) {
+			return false;
+		}
+
+		/* An abort still waiting for the bus is settled first */
+		if ((abortMailbox >= 0) && !FinishAbort()) {
+			return false;
+		}
+
+		uint8_t aborted;
+		uint32_t abortedId;
+		/* Only list frames are aborted, they can be queued again */
+		int mailbox = PreemptCanMessage(emergency.canId, words, emergency.bytes, &aborted, &abortedId, (uint16_t)~txMailboxMask);
+		if (mailbox < 0) {
+			/* Everything pending is more urgent */
+			return false;
+		}
+		if (2 == aborted) {
+			/* The frame to abort is on the bus, the emergency is sent once
+			 * FinishAbort() freed the mailbox
+			 */
+			abortMailbox = mailbox;
+			return false;
+		}
+		preemptMailbox = mailbox;
+
+		if (aborted) {
+			abortedFrames += 1;
+			Requeue(mailbox);
+		}
+		txMailboxMask &= ~(1U << mailbox);
+		frameMailboxMask &= ~(1U << mailbox);
+	}
+
+	CountFrame(txBits, emergency.canId, words, emergency.bytes);
+
+	/* Success */
+	return true;
+}
+
+void CommunicationManager::Requeue(int mailbox) {
+	/* Only list frames end up in mailboxes that can be aborted, the frame
+	 * is queued again with the payload it was queued with.
+	 */
+	const COMMUNICATION_txMailbox_t &frame = txMailboxes[mailbox];
+	if (COMMUNICATION_NO_PRODUCER == frame.source) {
+		return;
+	}
+
+	if ((TX_COALESCE == txMode) && (COMMUNICATION_NO_NODE != queueTails[queueBuckets[frame.source]])) {
+		/* A newer frame of this Can ID is pending */
+#if COMMUNICATION_TX_STATISTICS
+		coalesced[frame.source] += 1;
+#endif
+		return;
+	}
+
+	COMMUNICATION_listNode_t* node = NewNode();
+	if (!node) {
+		COMMUNICATION_DEBUG_PRINT("[");
+		COMMUNICATION_DEBUG_PRINT(millis(), DEC);
+		COMMUNICATION_DEBUG_PRINT("] CommunicationManager: ");
+		COMMUNICATION_DEBUG_PRINT(frame.canId, HEX);
+		COMMUNICATION_DEBUG_PRINTLN(" Queue failed (Aborted)!");
+		return;
+	}
+
+	node->words[0] = frame.words[0];
+	node->words[1] = frame.words[1];
+	node->queued = frame.queued;
+	node->canId = frame.canId;
+	node->bytes = frame.bytes;
+	node->source = frame.source;
+	ListAdd(node, true);
+}
+
+bool CommunicationManager::FinishAbort() {
+	int result = AbortCanMessage(abortMailbox);
+	if (result < 0) {
+		/* Still on the bus */
+		return false;
+	}
+
+	if (result > 0) {
+		abortedFrames += 1;
+		Requeue(abortMailbox);
+	}
+	txMailboxMask &= ~(1U << abortMailbox);
+	abortMailbox = -1;
+
+	/* Success: mailbox is free */
+	return true;
+}
+
+bool CommunicationManager::FrameReady(int *first) {
+	if (0 == nFrames) {
+		return false;
+	}
+
+	/* Lowest mailbox above the pending frames with the same Can ID */
+	unsigned int canId = frameQueue[frameHead].canId;
+	uint16_t mask = frameMailboxMask;
+	*first = 0;
+	while (mask) {
+		int mailbox = __builtin_ctz(mask);
+		mask &= mask - 1;
+		if (!TxPending(mailbox)) {
+			frameMailboxMask &= ~(1U << mailbox);
+		}
+		else if (txMailboxes[mailbox].canId == canId) {
+			*first = mailbox + 1;
+		}
+	}
+	return true;
+}
+
+bool CommunicationManager::SendQueuedFrame(int first) {
+	COMMUNICATION_frame_t* frame = &frameQueue[frameHead];
+
+	int mailbox = SendCanMessage(frame->canId, frame->words, frame->bytes, first);
+	if (mailbox < 0) {
+		/* Failed: No free mailbox */
+		return false;
+	}
+
+	CountFrame(txBits, frame->canId, frame->words, frame->bytes);
+	txMailboxes[mailbox].canId = frame->canId;
+	txMailboxes[mailbox].source = COMMUNICATION_NO_PRODUCER;
+	txMailboxMask &= ~(1U << mailbox);
+	frameMailboxMask |= (1U << mailbox);
+
+	frameHead = (frameHead + 1) % COMMUNICATION_FRAME_QUEUE_SIZE;
+	nFrames -= 1;
+
+	/* Success */
+	return true;
+}
+
+bool CommunicationManager::SendFrame(unsigned int canId, const void* data, unsigned int len) {
+	if (len > 8) {
+		COMMUNICATION_DEBUG_PRINT("[");
+		COMMUNICATION_DEBUG_PRINT(millis(), DEC);
+		COMMUNICATION_DEBUG_PRINT("] CommunicationManager: in SendFrame(unsigned int canId=");
+		COMMUNICATION_DEBUG_PRINT(canId, HEX);
+		COMMUNICATION_DEBUG_PRINTLN(", const void* data, unsigned int len) frame size truncated to 8 byte!");
+		len = 8;
+	}
+
+	if (canId >= COMMUNICATION_STD_IDS) {
+		COMMUNICATION_DEBUG_PRINT("[");
+		COMMUNICATION_DEBUG_PRINT(millis(), DEC);
+		COMMUNICATION_DEBUG_PRINT("] CommunicationManager: in SendFrame(unsigned int canId=");
+		COMMUNICATION_DEBUG_PRINT(canId, HEX);
+		COMMUNICATION_DEBUG_PRINTLN(", const void* data, unsigned int len) Can ID exceeds 11 bit!");
+
+		/* Failed: Only standard identifiers can be sent */
+		return false;
+	}
+
+	if (COMMUNICATION_FRAME_QUEUE_SIZE > nFrames) {
+		COMMUNICATION_frame_t* frame = &frameQueue[(frameHead + nFrames) % COMMUNICATION_FRAME_QUEUE_SIZE];
+		/* Frame order is little endian memory order */
+		Pack((const unsigned char*)data, frame->words, len, ORDER_LSB);
+		frame->canId = canId;
+		frame->bytes = len;
+		nFrames += 1;
+
+		/* Success */
+		return true;
+	}
+
+	/* Failed: Frame queue full, the caller retries */
+	return false;
+}
+
+unsigned int CommunicationManager::GetFrameQueueSpace() {
+	return COMMUNICATION_FRAME_QUEUE_SIZE - nFrames;
+}
+
+unsigned long CommunicationManager::GetAbortedFrames() {
+	return abortedFrames;
+}
+
+unsigned int CommunicationManager::GetMessageUtilization() {
+	return nNodes;
+}
+
+unsigned int CommunicationManager::GetMaxMessageUtilization() {
+	return maxNodesUsed;
+}
+
+float CommunicationManager::GetTxLoad() {
+	AdvanceLoad(micros());
+	return WindowLoad(txBits);
+}
+
+float CommunicationManager::GetRxLoad() {
+	AdvanceLoad(micros());
+	return WindowLoad(rxBits);
+}
+
+float CommunicationManager::GetProjectedLoad() {
+	return (100.0f * projectedBits) / baud;
+}
+
+unsigned int CommunicationManager::GetMessagesSent() {
+	return messagesSent;
+}
+
+unsigned int CommunicationManager::GetMaxMessagesSent() {
+	return maxMessagesSent;
+}
+
+bool CommunicationManager::GetLatencyHistogram(unsigned int canId, unsigned long* buckets) {
+	bool found = false;
+
+	for (unsigned int k = 0; k < COMMUNICATION_LATENCY_BUCKETS; k++) {
+		buckets[k] = 0;
+	}
+#if COMMUNICATION_TX_STATISTICS
+	for (unsigned int i = 0; i < nProducers; i++) {
+		if (producers[i].canId == canId) {
+			for (unsigned int k = 0; k < COMMUNICATION_LATENCY_BUCKETS; k++) {
+				buckets[k] += latencyBuckets[i][k];
+			}
+			found = true;
+		}
+	}
+#else
+	(void)canId;
+#endif
+	return found;
+}
+
+bool CommunicationManager::GetCycleLatencyHistogram(uint32_t cycle, unsigned long* buckets) {
+	bool found = false;
+
+	for (unsigned int k = 0; k < COMMUNICATION_LATENCY_BUCKETS; k++) {
+		buckets[k] = 0;
+	}
+#if COMMUNICATION_TX_STATISTICS
+	for (unsigned int i = 0; i < nProducers; i++) {
+		if (producers[i].cycle == cycle) {
+			for (unsigned int k = 0; k < COMMUNICATION_LATENCY_BUCKETS; k++) {
+				buckets[k] += latencyBuckets[i][k];
+			}
+			found = true;
+		}
+	}
+#else
+	(void)cycle;
+#endif
+	return found;
+}
+
+uint32_t CommunicationManager::GetMaxLatency(unsigned int canId) {
+	uint32_t result = 0;
+#if COMMUNICATION_TX_STATISTICS
+	for (unsigned int i = 0; i < nProducers; i++) {
+		if ((producers[i].canId == canId) && (latencyMax[i] > result)) {
+			result = latencyMax[i];
+		}
+	}
+#else
+	(void)canId;
+#endif
+	return result;
+}
+
+void CommunicationManager::ResetLatency() {
+	for (unsigned int i = 0; i < nProducers; i++) {
+		ResetLatency(i);
+	}
+}
+
+unsigned long CommunicationManager::GetCoalesced(unsigned int canId) {
+	unsigned long result = 0;
+#if COMMUNICATION_TX_STATISTICS
+	for (unsigned int i = 0; i < nProducers; i++) {
+		if (producers[i].canId == canId) {
+			result += coalesced[i];
+		}
+	}
+#else
+	(void)canId;
+#endif
+	return result;
+}
+
+uint32_t CommunicationManager::GetPhase(unsigned int canId) {
+	for (unsigned int i = 0; i < nProducers; i++) {
+		if (producers[i].canId == canId) {
+			return timers[i].phase;
+		}
+	}
+	return 0;
+}
+
+unsigned long CommunicationManager::GetRxOverruns() {
+	return rxRingOverruns;
+}
+
+unsigned int CommunicationManager::GetMaxRxRingUtilization() {
+	return rxRingMaxUsed;
+}
+
+unsigned int CommunicationManager::GetRxFilters(COMMUNICATION_rxFilter_t* filters) {
+	for (unsigned int i = 0; i < nRxFilters; i++) {
+		filters[i] = rxFilters[i];
+	}
+	return nRxFilters;
+}
+
+void CommunicationManager::InitCan(uint32_t baud) {
+  #ifndef COMMUNICATION_TEST_ENV
+	CAN_Can0 = FlexCAN(baud);
+	//Set recive CAN_filter
+	CAN_filter.id = 0;
+	CAN_filter.ext = 0;
+	CAN_filter.rtr = 0;
+	CAN_Can0.begin(CAN_filter);
+	// Fire() frames go to the reserved mailbox
+	CAN_Can0.reserveTx();
+
+	if (RX_INTERRUPT == rxMode) {
+		CAN_Can0.attachRxInterrupt(RxInterrupt);
+	}
+	else {
+		CAN_Can0.detachRxInterrupt();
+	}
+  #else
+	(void)baud;
+	Test_attachRxInterrupt((RX_INTERRUPT == rxMode) ? RxInterrupt : nullptr);
+  #endif
+}
+
+int CommunicationManager::SendCanMessage(uint16_t msgID, const uint32_t *words, uint8_t lengthOfData, int first) {
+	if (lengthOfData > 8) {
+		lengthOfData = 8;
+	}
+
+	#ifndef COMMUNICATION_TEST_ENV
+	/* send CAN message, never waits for a mailbox */
+	return CAN_Can0.writeWords(msgID, 0, lengthOfData, words, first);
+	#else
+	CAN_test_msg_t CAN_outMsg;
+	COMMUNICATION_testMsg(&CAN_outMsg, msgID, words, lengthOfData);
+	return Test_send(CAN_outMsg, first);
+	#endif
+}
+
+bool CommunicationManager::PeekCanMessage(uint32_t *id, uint8_t *len, const volatile uint32_t **words) {
+	if (RX_INTERRUPT == rxMode) {
+		return RxRingPeek(id, len, words);
+	}
+
+	uint8_t ext;
+	#ifndef COMMUNICATION_TEST_ENV
+	if (!CAN_Can0.peek(*id, ext, *len)) {
+		return false;
+	}
+	*words = CAN_Can0.peekWords();
+	#else
+	if (!Test_peek(*id, ext, *len)) {
+		return false;
+	}
+	*words = Test_peekWords();
+	#endif
+	return true;
+}
+
+void CommunicationManager::ReleaseCanMessage() {
+	if (RX_INTERRUPT == rxMode) {
+		RxRingRelease();
+		return;
+	}
+
+	#ifndef COMMUNICATION_TEST_ENV
+	CAN_Can0.release();
+	#else
+	Test_release();
+	#endif
+}
+
+int CommunicationManager::SendReservedCanMessage(uint16_t msgID, const uint32_t *words, uint8_t lengthOfData) {
+	if (lengthOfData > 8) {
+		lengthOfData = 8;
+	}
+
+	#ifndef COMMUNICATION_TEST_ENV
+	return CAN_Can0.writeReserved(msgID, 0, lengthOfData, words);
+	#else
+	CAN_test_msg_t CAN_outMsg;
+	COMMUNICATION_testMsg(&CAN_outMsg, msgID, words, lengthOfData);
+	return Test_sendReserved(CAN_outMsg);
+	#endif
+}
+
+int CommunicationManager::PreemptCanMessage(uint16_t msgID, const uint32_t *words, uint8_t lengthOfData, uint8_t *aborted, uint32_t *abortedId, uint16_t keep) {
+	if (lengthOfData > 8) {
+		lengthOfData = 8;
+	}
+
+	#ifndef COMMUNICATION_TEST_ENV
+	return CAN_Can0.preempt(msgID, 0, lengthOfData, words, *aborted, *abortedId, keep);
+	#else
+	CAN_test_msg_t CAN_outMsg;
+	COMMUNICATION_testMsg(&CAN_outMsg, msgID, words, lengthOfData);
+	return Test_preempt(CAN_outMsg, *aborted, *abortedId, keep);
+	#endif
+}
+
+int CommunicationManager::AbortCanMessage(int mailbox) {
+	#ifndef COMMUNICATION_TEST_ENV
+	return CAN_Can0.abort(mailbox);
+	#else
+	return Test_abort(mailbox);
+	#endif
+}
+
+bool CommunicationManager::TxPending(int mailbox) {
+	#ifndef COMMUNICATION_TEST_ENV
+	return CAN_Can0.txPending(mailbox);
+	#else
+	return Test_txPending(mailbox);
+	#endif
+}
+
+int CommunicationManager::ReadCanMessage(uint32_t *id, uint32_t *words, uint8_t *len) {
+	#ifndef COMMUNICATION_TEST_ENV
+	uint8_t ext;
+	return CAN_Can0.readWords(*id, ext, *len, words);
+	#else
+	CAN_test_msg_t CAN_inMsg;
+	int result = Test_receive(CAN_inMsg);
+	if (result) {
+		*id = CAN_inMsg.id;
+		*len = CAN_inMsg.len;
+		/* Like the mailbox: byte 0 is the most significant byte of word 0,
+		 * bytes beyond the length read as zero
+		 */
+		words[0] = 0;
+		words[1] = 0;
+		for (int i = 0; (i < CAN_inMsg.len) && (i < 8); i++) {
+			words[i >> 2] |= (uint32_t)CAN_inMsg.buf[i] << (24 - 8 * (i & 3));
+		}
+	}
+	return result;
+	#endif
+}
+
+void CommunicationManager::Unpack(const uint32_t *words, unsigned char *out, unsigned int bytes, COMMUNICATION_BYTE_ORDER byteOrder) {
+	switch (bytes) {
+		case 1: COMMUNICATION_unpack<1>(words, out, byteOrder); break;
+		case 2: COMMUNICATION_unpack<2>(words, out, byteOrder); break;
+		case 3: COMMUNICATION_unpack<3>(words, out, byteOrder); break;
+		case 4: COMMUNICATION_unpack<4>(words, out, byteOrder); break;
+		case 5: COMMUNICATION_unpack<5>(words, out, byteOrder); break;
+		case 6: COMMUNICATION_unpack<6>(words, out, byteOrder); break;
+		case 7: COMMUNICATION_unpack<7>(words, out, byteOrder); break;
+		case 8: COMMUNICATION_unpack<8>(words, out, byteOrder); break;
+		default: break;
+	}
+}
+
+void CommunicationManager::Pack(const unsigned char *in, uint32_t *words, unsigned int bytes, COMMUNICATION_BYTE_ORDER byteOrder) {
+	switch (bytes) {
+		case 1: COMMUNICATION_pack<1>(in, words, byteOrder); break;
+		case 2: COMMUNICATION_pack<2>(in, words, byteOrder); break;
+		case 3: COMMUNICATION_pack<3>(in, words, byteOrder); break;
+		case 4: COMMUNICATION_pack<4>(in, words, byteOrder); break;
+		case 5: COMMUNICATION_pack<5>(in, words, byteOrder); break;
+		case 6: COMMUNICATION_pack<6>(in, words, byteOrder); break;
+		case 7: COMMUNICATION_pack<7>(in, words, byteOrder); break;
+		case 8: COMMUNICATION_pack<8>(in, words, byteOrder); break;
+		default:
+			words[0] = 0;
+			words[1] = 0;
+			break;
+	}
+}
+
+void CommunicationManager::UnpackFrame(const volatile uint32_t *words, uint8_t len, unsigned char *out, unsigned int bytes, COMMUNICATION_BYTE_ORDER byteOrder) {
+	/* Only the words that are needed are read, they stay in registers */
+	uint32_t frame[2];
+	frame[0] = words[0];
+	frame[1] = (bytes > 4) ? words[1] : 0;
+
+	if (len < bytes) {
+		uint64_t value = ((uint64_t)frame[0] << 32) | frame[1];
+		value &= ~(0xFFFFFFFFFFFFFFFFULL >> (8 * len));
+		frame[0] = value >> 32;
+		frame[1] = (uint32_t)value;
+	}
+
+	Unpack(frame, out, bytes, byteOrder);
+}
+
+#if COMMUNICATION_STATIC_TABLES
+unsigned char CommunicationManager::AddSignal(void*, COMMUNICATION_SIGNAL_TYPE, unsigned int canId, unsigned char, unsigned char, COMMUNICATION_BYTE_ORDER, float, float) {
+	COMMUNICATION_DEBUG_PRINT("[");
+	COMMUNICATION_DEBUG_PRINT(millis(), DEC);
+	COMMUNICATION_DEBUG_PRINT("] CommunicationManager: Failed to register Signal with Can Id ");
+	COMMUNICATION_DEBUG_PRINT(canId, HEX);
+	COMMUNICATION_DEBUG_PRINTLN(", tables are static!");
+
+	/* Failed: Signal frames are not available, see CommunicationFrame */
+	return COMMUNICATION_NO_SIGNAL;
+}
+#else
+unsigned char CommunicationManager::AddSignal(void* val, COMMUNICATION_SIGNAL_TYPE type, unsigned int canId, unsigned char startBit, unsigned char length, COMMUNICATION_BYTE_ORDER byteOrder, float factor, float offset) {
+	/* Position of the least significant bit, see COMMUNICATION_signal_t */
+	int shift = startBit;
+	if (ORDER_MSB == byteOrder) {
+		shift = 56 - 8 * (startBit >> 3) + (startBit & 7) - (length - 1);
+	}
+
+	if ((0 == length) || (length > 32) || (startBit > 63) || (shift < 0) || (shift + length > 64) || (0.0f == factor)) {
+		COMMUNICATION_DEBUG_PRINT("[");
+		COMMUNICATION_DEBUG_PRINT(millis(), DEC);
+		COMMUNICATION_DEBUG_PRINT("] CommunicationManager: Failed to register Signal with Can Id ");
+		COMMUNICATION_DEBUG_PRINT(canId, HEX);
+		COMMUNICATION_DEBUG_PRINTLN(", invalid signal layout!");
+
+		/* Failed: Signal does not fit into 8 bytes */
+		return COMMUNICATION_NO_SIGNAL;
+	}
+
+	if (COMMUNICATION_MAX_SIGNALS > nSignals) {
+		COMMUNICATION_signal_t* signal = &signals[nSignals];
+		signal->ref = val;
+		signal->factor = factor;
+		signal->offset = offset;
+		signal->type = type;
+		signal->byteOrder = byteOrder;
+		signal->shift = shift;
+		signal->length = length;
+		signal->next = COMMUNICATION_NO_SIGNAL;
+		signal->scaled = (SIGNAL_FLOAT == type) || (SIGNAL_UNSIGNED_FLOAT == type) || (1.0f != factor) || (0.0f != offset);
+
+		/* Last frame byte the signal touches */
+		if (ORDER_MSB == byteOrder) {
+			signal->bytes = 8 - (shift >> 3);
+		}
+		else {
+			signal->bytes = ((shift + length - 1) >> 3) + 1;
+		}
+
+		/* Success */
+		return nSignals++;
+	}
+
+	COMMUNICATION_DEBUG_PRINT("[");
+	COMMUNICATION_DEBUG_PRINT(millis(), DEC);
+	COMMUNICATION_DEBUG_PRINT("] CommunicationManager: Failed to register Signal with Can Id ");
+	COMMUNICATION_DEBUG_PRINT(canId, HEX);
+	COMMUNICATION_DEBUG_PRINTLN(", not enough memory allocated!");
+
+	/* Failed: To many signals */
+	return COMMUNICATION_NO_SIGNAL;
+}
+#endif
+
+uint64_t CommunicationManager::SignalMask(const COMMUNICATION_signal_t &signal) {
+	uint64_t mask = (((uint64_t)1 << signal.length) - 1) << signal.shift;
+	return (ORDER_MSB == signal.byteOrder) ? mask : __builtin_bswap64(mask);
+}
+
+/* Raw values are signed for these types */
+static inline bool COMMUNICATION_signedSignal(COMMUNICATION_SIGNAL_TYPE type) {
+	return (SIGNAL_INT8 == type) || (SIGNAL_INT16 == type) || (SIGNAL_INT32 == type) || (SIGNAL_FLOAT == type);
+}
+
+uint32_t CommunicationManager::SignalRaw(const COMMUNICATION_signal_t &signal) {
+	int64_t value = 0;
+	float physical = 0.0f;
+	switch (signal.type) {
+		case SIGNAL_UINT8: value = *(uint8_t*)signal.ref; break;
+		case SIGNAL_INT8: value = *(int8_t*)signal.ref; break;
+		case SIGNAL_UINT16: value = *(uint16_t*)signal.ref; break;
+		case SIGNAL_INT16: value = *(int16_t*)signal.ref; break;
+		case SIGNAL_UINT32: value = *(uint32_t*)signal.ref; break;
+		case SIGNAL_INT32: value = *(int32_t*)signal.ref; break;
+		default: physical = *(float*)signal.ref; break;
+	}
+
+	/* Values outside the raw range are saturated */
+	int64_t min = 0;
+	int64_t max = ((int64_t)1 << signal.length) - 1;
+	if (COMMUNICATION_signedSignal(signal.type)) {
+		min = -((int64_t)1 << (signal.length - 1));
+		max = ((int64_t)1 << (signal.length - 1)) - 1;
+	}
+
+	if (signal.scaled) {
+		if ((SIGNAL_FLOAT != signal.type) && (SIGNAL_UNSIGNED_FLOAT != signal.type)) {
+			physical = (float)value;
+		}
+		float raw = (physical - signal.offset) / signal.factor;
+		if (!(raw > (float)min)) {
+			/* NaN as well */
+			value = min;
+		}
+		else if (raw >= (float)max) {
+			value = max;
+		}
+		else {
+			value = llroundf(raw);
+		}
+	}
+	else if (value < min) {
+		value = min;
+	}
+	else if (value > max) {
+		value = max;
+	}
+
+	return (uint32_t)value;
+}
+
+void CommunicationManager::SignalStore(const COMMUNICATION_signal_t &signal, uint32_t raw) {
+	int64_t value = raw & ((((uint64_t)1) << signal.length) - 1);
+	if (COMMUNICATION_signedSignal(signal.type) && (value >> (signal.length - 1))) {
+		value -= (int64_t)1 << signal.length;
+	}
+
+	if ((SIGNAL_FLOAT == signal.type) || (SIGNAL_UNSIGNED_FLOAT == signal.type)) {
+		*(float*)signal.ref = (float)value * signal.factor + signal.offset;
+		return;
+	}
+
+	/* Integer variables are saturated to their type */
+	int64_t min;
+	int64_t max;
+	switch (signal.type) {
+		case SIGNAL_UINT8: min = 0; max = UINT8_MAX; break;
+		case SIGNAL_INT8: min = INT8_MIN; max = INT8_MAX; break;
+		case SIGNAL_UINT16: min = 0; max = UINT16_MAX; break;
+		case SIGNAL_INT16: min = INT16_MIN; max = INT16_MAX; break;
+		case SIGNAL_UINT32: min = 0; max = UINT32_MAX; break;
+		default: min = INT32_MIN; max = INT32_MAX; break;
+	}
+
+	if (signal.scaled) {
+		float physical = (float)value * signal.factor + signal.offset;
+		if (!(physical > (float)min)) {
+			value = min;
+		}
+		else if (physical >= (float)max) {
+			value = max;
+		}
+		else {
+			value = llroundf(physical);
+		}
+	}
+	else if (value < min) {
+		value = min;
+	}
+	else if (value > max) {
+		value = max;
+	}
+
+	switch (signal.type) {
+		case SIGNAL_UINT8: *(uint8_t*)signal.ref = value; break;
+		case SIGNAL_INT8: *(int8_t*)signal.ref = value; break;
+		case SIGNAL_UINT16: *(uint16_t*)signal.ref = value; break;
+		case SIGNAL_INT16: *(int16_t*)signal.ref = value; break;
+		case SIGNAL_UINT32: *(uint32_t*)signal.ref = value; break;
+		default: *(int32_t*)signal.ref = value; break;
+	}
+}
+
+bool CommunicationManager::AddCacheSlot(unsigned int producer) {
+	if ((producers[producer].ref && !producers[producer].pack) || (nCachedFrames >= COMMUNICATION_MAX_CACHED_FRAMES)) {
+		return false;
+	}
+
+	cacheSlots[producer] = nCachedFrames;
+	nCachedFrames += 1;
+	return true;
+}
+
+void CommunicationManager::PackProducer(const COMMUNICATION_producer_t &producer, uint32_t *words) {
+	if (producer.pack) {
+		producer.pack(producer.ref, words);
+	}
+	else if (producer.ref) {
+		Pack((const unsigned char*)producer.ref, words, producer.bytes, byteOrder);
+	}
+	else {
+		PackSignals(producer.signals, words);
+	}
+}
+
+void CommunicationManager::ProducerWords(unsigned char producer, uint32_t *words) {
+	unsigned char* dirty = producers[producer].dirty;
+
+	if (dirty) {
+		uint32_t* cache = txCache[cacheSlots[producer]];
+		if (*dirty) {
+			/* Cleared first, a change during the packing marks it again */
+			*dirty = 0;
+			PackProducer(producers[producer], cache);
+		}
+		words[0] = cache[0];
+		words[1] = cache[1];
+	}
+	else {
+		PackProducer(producers[producer], words);
+	}
+}
+
+void CommunicationManager::PackSignals(unsigned char first, uint32_t *words) {
+	/* Both byte orders are collected in their own word, the Intel signals
+	 * are swapped into frame order once at the end.
+	 */
+	uint64_t motorola = 0;
+	uint64_t intel = 0;
+	for (unsigned char i = first; COMMUNICATION_NO_SIGNAL != i; i = signals[i].next) {
+		uint64_t raw = SignalRaw(signals[i]) & ((((uint64_t)1) << signals[i].length) - 1);
+		if (ORDER_MSB == signals[i].byteOrder) {
+			motorola |= raw << signals[i].shift;
+		}
+		else {
+			intel |= raw << signals[i].shift;
+		}
+	}
+
+	uint64_t frame = motorola | __builtin_bswap64(intel);
+	words[0] = frame >> 32;
+	words[1] = (uint32_t)frame;
+}
+
+void CommunicationManager::InitRxRing() {
+	rxRingHead = 0;
+	rxRingTail = 0;
+	rxRingOverruns = 0;
+	rxRingMaxUsed = 0;
+}
+
+bool CommunicationManager::RxRingPush(uint32_t canId, const uint32_t *words, uint8_t bytes) {
+	unsigned int head = rxRingHead;
+	unsigned int used = head - rxRingTail;
+
+	if (used >= COMMUNICATION_RX_RING_SIZE) {
+		rxRingOverruns = rxRingOverruns + 1;
+
+		/* Failed: Ring full */
+		return false;
+	}
+
+	COMMUNICATION_rxFrame_t* frame = &rxRing[head & (COMMUNICATION_RX_RING_SIZE - 1)];
+	frame->canId = canId;
+	frame->bytes = bytes;
+	frame->words[0] = words[0];
+	frame->words[1] = words[1];
+
+	/* Frame must be complete before it is published to Update() */
+	__sync_synchronize();
+	rxRingHead = head + 1;
+
+	if (used + 1 > rxRingMaxUsed) {
+		rxRingMaxUsed = used + 1;
+	}
+
+	/* Success */
+	return true;
+}
+
+bool CommunicationManager::RxRingPeek(uint32_t *id, uint8_t *len, const volatile uint32_t **words) {
+	unsigned int tail = rxRingTail;
+
+	if (tail == rxRingHead) {
+		/* Ring empty */
+		return false;
+	}
+
+	/* Read the frame only after the head has been observed */
+	__sync_synchronize();
+
+	COMMUNICATION_rxFrame_t* frame = &rxRing[tail & (COMMUNICATION_RX_RING_SIZE - 1)];
+	*id = frame->canId;
+	*len = frame->bytes;
+	*words = frame->words;
+
+	return true;
+}
+
+void CommunicationManager::RxRingRelease() {
+	/* Slot may be reused once the tail has moved */
+	__sync_synchronize();
+	rxRingTail = rxRingTail + 1;
+}
+
+void CommunicationManager::HandleRxInterrupt() {
+	uint32_t id;
+	uint32_t words[2];
+	uint8_t len;
+
+	/* Always empty the controller FIFO, frames that do not fit into the
+	 * ring are counted as overruns.
+	 */
+	while (ReadCanMessage(&id, words, &len)) {
+		if (nInterruptConsumers > 0) {
+			DispatchInterrupt(id, words, len);
+		}
+		RxRingPush(id, words, len);
+	}
+}
+
+void CommunicationManager::DispatchInterrupt(uint32_t canId, const uint32_t *words, uint8_t len) {
+	/* The other consumers get the frame from the ring in Update() */
+	unsigned char i = DispatchFirst(canId);
+
+	while (COMMUNICATION_NO_CONSUMER != i) {
+		if (consumers[i].snapshot) {
+			StoreSnapshot(consumers[i], words, len);
+		}
+		else if (consumers[i].callback && consumers[i].interrupt) {
+			UnpackFrame(words, len, (unsigned char*)consumers[i].ref, consumers[i].bytes, byteOrder);
+			consumers[i].callback(consumers[i].context, consumers[i].ref);
+		}
+		i = consumers[i].next;
+	}
+}
+
+void CommunicationManager::StoreSnapshot(const COMMUNICATION_consumer_t &consumer, const volatile uint32_t *words, uint8_t len) {
+	/* Odd sequence while the value is written, readers retry */
+	COMMUNICATION_snapshot_t* snapshot = (COMMUNICATION_snapshot_t*)consumer.ref;
+	snapshot->sequence = snapshot->sequence + 1;
+	COMMUNICATION_SNAPSHOT_BARRIER();
+	UnpackFrame(words, len, (unsigned char*)snapshot->words, consumer.bytes, byteOrder);
+	COMMUNICATION_SNAPSHOT_BARRIER();
+	snapshot->sequence = snapshot->sequence + 1;
+}
+
+void CommunicationManager::RxInterrupt() {
+	GetInstance()->HandleRxInterrupt();
+}
+
+#if COMMUNICATION_STATIC_TABLES
+void CommunicationManager::InitDispatch() {
+	/* Tables are passed to Initialize() */
+	stdDispatch = nullptr;
+	extDispatch = nullptr;
+}
+
+unsigned char CommunicationManager::DispatchFirst(uint32_t canId) {
+	if (nullptr == stdDispatch) {
+		/* No consumers */
+		return COMMUNICATION_NO_CONSUMER;
+	}
+	if (canId < COMMUNICATION_STD_IDS) {
+		return stdDispatch[canId];
+	}
+
+	const COMMUNICATION_dispatchEntry_t* entry = COMMUNICATION_extDispatchEntry(extDispatch, canId);
+	return entry ? entry->first : COMMUNICATION_NO_CONSUMER;
+}
+#else
+void CommunicationManager::InitDispatch() {
+	for (uint16_t i = 0; i < COMMUNICATION_EXT_DISPATCH_SIZE; i++) {
+		dispatch[i].canId = 0;
+		dispatch[i].first = COMMUNICATION_NO_CONSUMER;
+	}
+}
+
+unsigned char* CommunicationManager::DispatchSlot(uint32_t canId, bool insert) {
+	/* An empty entry terminates the search */
+	COMMUNICATION_dispatchEntry_t* entry = COMMUNICATION_extDispatchEntry(dispatch, canId);
+	if (nullptr == entry) {
+		/* Failed: Table full */
+		return nullptr;
+	}
+
+	if (COMMUNICATION_NO_CONSUMER == entry->first) {
+		if (insert) {
+			entry->canId = canId;
+			return &entry->first;
+		}
+		return nullptr;
+	}
+	return &entry->first;
+}
+
+unsigned char CommunicationManager::DispatchFirst(uint32_t canId) {
+	unsigned char* slot = DispatchSlot(canId, false);
+	return slot ? *slot : COMMUNICATION_NO_CONSUMER;
+}
+#endif
+
+void CommunicationManager::UpdateRxFilters() {
+	/* One filter per subscribed id (first consumer of each dispatch chain) */
+	nRxFilters = 0;
+	for (unsigned int i = 0; i < nConsumers; i++) {
+		if (DispatchFirst(consumers[i].canId) == i) {
+			AddRxFilter(consumers[i].canId);
+		}
+	}
+}
+
+void CommunicationManager::AddRxFilter(uint32_t canId) {
+	COMMUNICATION_rxFilter_t filter;
+	filter.canId = canId;
+	filter.ext = (canId >= COMMUNICATION_STD_IDS) ? 1 : 0;
+	filter.mask = filter.ext ? 0x1FFFFFFFUL : (COMMUNICATION_STD_IDS - 1);
+
+	/* Filters are sorted by frame format and id, an id which already
+	 * passes a merged filter needs none.
+	 */
+	unsigned int pos = nRxFilters;
+	for (unsigned int i = 0; i < nRxFilters; i++) {
+		if ((rxFilters[i].ext == filter.ext) && (0 == ((rxFilters[i].canId ^ canId) & rxFilters[i].mask))) {
+			return;
+		}
+	}
+	while ((pos > 0) && ((rxFilters[pos - 1].ext > filter.ext) ||
+	       ((rxFilters[pos - 1].ext == filter.ext) && (rxFilters[pos - 1].canId > filter.canId)))) {
+		rxFilters[pos] = rxFilters[pos - 1];
+		pos -= 1;
+	}
+	rxFilters[pos] = filter;
+	nRxFilters += 1;
+
+	if (nRxFilters <= COMMUNICATION_RX_FILTERS) {
+		return;
+	}
+
+	/* One filter too many: merge the neighbours whose common mask lets the
+	 * fewest ids pass.
+	 */
+	unsigned int best = nRxFilters;
+	uint32_t bestMask = 0;
+	uint32_t bestCost = 0;
+
+	for (unsigned int i = 0; i + 1 < nRxFilters; i++) {
+		if (rxFilters[i].ext != rxFilters[i + 1].ext) {
+			continue;
+		}
+
+		uint32_t mask = rxFilters[i].mask & rxFilters[i + 1].mask & ~(rxFilters[i].canId ^ rxFilters[i + 1].canId);
+		unsigned int width = rxFilters[i].ext ? 29 : 11;
+		uint32_t cost = 1UL << (width - __builtin_popcount(mask));
+
+		if ((best == nRxFilters) || (cost < bestCost)) {
+			best = i;
+			bestMask = mask;
+			bestCost = cost;
+		}
+	}
+
+	rxFilters[best].mask = bestMask;
+	rxFilters[best].canId &= bestMask;
+	nRxFilters -= 1;
+	for (unsigned int i = best + 1; i < nRxFilters; i++) {
+		rxFilters[i] = rxFilters[i + 1];
+	}
+}
+
+void CommunicationManager::ApplyRxFilters() {
+	#ifdef COMMUNICATION_TEST_ENV
+	CAN_test_filter_t filters[COMMUNICATION_RX_FILTERS];
+	#else
+	CAN_filter_t filters[COMMUNICATION_RX_FILTERS];
+	#endif
+	uint32_t masks[COMMUNICATION_RX_FILTERS];
+
+	for (unsigned int i = 0; i < nRxFilters; i++) {
+		filters[i].rtr = 0;
+		filters[i].ext = rxFilters[i].ext;
+		filters[i].id = rxFilters[i].canId;
+		masks[i] = rxFilters[i].mask;
+	}
+
+	#ifndef COMMUNICATION_TEST_ENV
+	CAN_Can0.setFilters(filters, masks, nRxFilters);
+	#else
+	Test_setFilters(filters, masks, nRxFilters);
+	#endif
+}
+
+void CommunicationManager::InitWheel() {
+	for (uint16_t i = 0; i < COMMUNICATION_WHEEL_SIZE; i++) {
+		wheel[i] = COMMUNICATION_NO_TIMER;
+	}
+	wheelTick = micros() >> COMMUNICATION_WHEEL_TICK_BITS;
+}
+
+void CommunicationManager::InitSchedule(unsigned int producer) {
+	uint32_t cycle = producers[producer].cycle;
+	uint32_t due = scheduleStart + timers[producer].phase;
+	uint32_t now = micros();
+
+	/* Registered after Initialize(): skip the cycles that already passed,
+	 * the phase relation to the other producers is kept.
+	 */
+	if ((int32_t)(now - due) > 0) {
+		due += ((now - due + cycle - 1) / cycle) * cycle;
+	}
+	timers[producer].due = due;
+	WheelInsert(producer);
+}
+
+void CommunicationManager::WheelInsert(unsigned char producer) {
+	uint32_t tick = timers[producer].due >> COMMUNICATION_WHEEL_TICK_BITS;
+
+	/* Overdue timers go to the current slot, which is visited next */
+	if ((int32_t)(tick - wheelTick) < 0) {
+		tick = wheelTick;
+	}
+
+	unsigned char* slot = &wheel[tick & (COMMUNICATION_WHEEL_SIZE - 1)];
+	timers[producer].next = *slot;
+	*slot = producer;
+}
+
+unsigned char CommunicationManager::WheelExpire(uint32_t now) {
+	uint32_t nowTick = now >> COMMUNICATION_WHEEL_TICK_BITS;
+	uint32_t ticks = nowTick - wheelTick;
+	unsigned char expired = COMMUNICATION_NO_TIMER;
+
+	/* The slot of the last tick is visited again, it may hold timers which
+	 * were not due yet at the last call. After a full turn every slot has
+	 * been visited once.
+	 */
+	if (ticks >= COMMUNICATION_WHEEL_SIZE) {
+		ticks = COMMUNICATION_WHEEL_SIZE - 1;
+	}
+
+	for (uint32_t n = 0; n <= ticks; n++) {
+		unsigned char* link = &wheel[(nowTick - n) & (COMMUNICATION_WHEEL_SIZE - 1)];
+
+		while (COMMUNICATION_NO_TIMER != *link) {
+			unsigned char i = *link;
+			if ((int32_t)(now - timers[i].due) >= 0) {
+				/* Move to the list of expired timers */
+				*link = timers[i].next;
+				timers[i].next = expired;
+				expired = i;
+			}
+			else {
+				link = &timers[i].next;
+			}
+		}
+	}
+
+	wheelTick = nowTick;
+	return expired;
+}
+
+void CommunicationManager::InitPhaseLoad() {
+	for (unsigned int t = 0; t < COMMUNICATION_BALANCE_MILLIS; t++) {
+		phaseLoad[t] = 0;
+	}
+}
+
+void CommunicationManager::AddPhaseLoad(unsigned int producer) {
+	const uint32_t window = COMMUNICATION_BALANCE_MILLIS * 1000UL;
+	unsigned int bits = FrameBits(producers[producer].bytes);
+
+	for (uint32_t t = timers[producer].phase; t < window; t += producers[producer].cycle) {
+		uint32_t load = phaseLoad[t / 1000] + bits;
+		phaseLoad[t / 1000] = (load > 0xFFFF) ? 0xFFFF : load;
+	}
+}
+
+uint32_t CommunicationManager::AutoPhase(uint32_t cycle) {
+	const uint32_t window = COMMUNICATION_BALANCE_MILLIS * 1000UL;
+
+	if (cycle < 1000) {
+		/* Sent in every millisecond whatever the phase */
+		return 0;
+	}
+
+	/* Candidates are whole milliseconds within the cycle (and the window).
+	 * Lowest peak first, then lowest total load, then earliest phase.
+	 */
+	uint32_t candidates = cycle / 1000;
+	if (candidates > COMMUNICATION_BALANCE_MILLIS) {
+		candidates = COMMUNICATION_BALANCE_MILLIS;
+	}
+
+	uint32_t best = 0;
+	unsigned long bestPeak = 0;
+	unsigned long bestSum = 0;
+	for (uint32_t c = 0; c < candidates; c++) {
+		unsigned long peak = 0;
+		unsigned long sum = 0;
+		for (uint32_t t = c * 1000; t < window; t += cycle) {
+			if (phaseLoad[t / 1000] > peak) {
+				peak = phaseLoad[t / 1000];
+			}
+			sum += phaseLoad[t / 1000];
+		}
+		if ((0 == c) || (peak < bestPeak) || ((peak == bestPeak) && (sum < bestSum))) {
+			best = c * 1000;
+			bestPeak = peak;
+			bestSum = sum;
+		}
+	}
+
+	return best;
+}
+
+unsigned int CommunicationManager::FrameBits(unsigned int bytes, bool ext) {
+	/* Worst case length of a data frame: SOF, arbitration and control
+	 * field, data and CRC are subject to stuffing, CRC delimiter, ACK, EOF
+	 * and interframe space are not.
+	 */
+	unsigned int stuffed = (ext ? 54 : 34) + 8 * bytes;
+	return stuffed + (stuffed - 1) / 4 + 13;
+}
+
+typedef struct COMMUNICATION_stuffing_t {
+	uint16_t crc;
+	unsigned char last;
+	unsigned char run;
+	unsigned int bits;
+} COMMUNICATION_stuffing_t;
+
+static void COMMUNICATION_stuff(COMMUNICATION_stuffing_t* state, uint32_t value, unsigned int n, bool crc) {
+	while (n > 0) {
+		n -= 1;
+		unsigned char bit = (value >> n) & 1;
+
+		if (crc) {
+			/* CRC-15, polynomial 0x4599 */
+			bool invert = bit ^ ((state->crc >> 14) & 1);
+			state->crc = (state->crc << 1) & 0x7FFF;
+			if (invert) {
+				state->crc ^= 0x4599;
+			}
+		}
+
+		state->bits += 1;
+		if (bit == state->last) {
+			state->run += 1;
+		}
+		else {
+			state->last = bit;
+			state->run = 1;
+		}
+		if (5 == state->run) {
+			/* Stuff bit of opposite level starts a new run */
+			state->bits += 1;
+			state->last = !bit;
+			state->run = 1;
+		}
+	}
+}
+
+unsigned int CommunicationManager::StuffedFrameBits(uint32_t canId, const uint32_t *words, uint8_t bytes) {
+	COMMUNICATION_stuffing_t state = { 0, 2, 0, 0 };
+
+	if (bytes > 8) {
+		bytes = 8;
+	}
+
+	COMMUNICATION_stuff(&state, 0, 1, true);
+	if (canId < COMMUNICATION_STD_IDS) {
+		/* Identifier, RTR, IDE, r0 */
+		COMMUNICATION_stuff(&state, canId, 11, true);
+		COMMUNICATION_stuff(&state, 0, 3, true);
+	}
+	else {
+		/* Base identifier, SRR, IDE, extension, RTR, r1, r0 */
+		COMMUNICATION_stuff(&state, canId >> 18, 11, true);
+		COMMUNICATION_stuff(&state, 3, 2, true);
+		COMMUNICATION_stuff(&state, canId, 18, true);
+		COMMUNICATION_stuff(&state, 0, 3, true);
+	}
+	COMMUNICATION_stuff(&state, bytes, 4, true);
+	for (uint8_t i = 0; i < bytes; i++) {
+		COMMUNICATION_stuff(&state, words[i >> 2] >> (24 - 8 * (i & 3)), 8, true);
+	}
+	COMMUNICATION_stuff(&state, state.crc, 15, false);
+
+	return state.bits + 13;
+}
+
+void CommunicationManager::InitLoad() {
+	uint32_t now = micros();
+
+	loadStart = now;
+	loadTick = now / COMMUNICATION_LOAD_BUCKET_MICROS;
+	for (uint16_t i = 0; i < COMMUNICATION_LOAD_BUCKETS; i++) {
+		txBits[i] = 0;
+		rxBits[i] = 0;
+	}
+}
+
+void CommunicationManager::AdvanceLoad(uint32_t now) {
+	uint32_t tick = now / COMMUNICATION_LOAD_BUCKET_MICROS;
+	uint32_t passed = tick - loadTick;
+
+	/* Buckets which left the window start over */
+	if (passed > COMMUNICATION_LOAD_BUCKETS) {
+		passed = COMMUNICATION_LOAD_BUCKETS;
+	}
+	for (uint32_t n = 1; n <= passed; n++) {
+		uint32_t i = (loadTick + n) % COMMUNICATION_LOAD_BUCKETS;
+		txBits[i] = 0;
+		rxBits[i] = 0;
+	}
+	loadTick = tick;
+}
+
+void CommunicationManager::CountFrame(uint32_t *bits, uint32_t canId, const volatile uint32_t *words, uint8_t bytes) {
+  #if COMMUNICATION_EXACT_STUFFING
+	uint32_t frame[2] = { words[0], words[1] };
+	bits[loadTick % COMMUNICATION_LOAD_BUCKETS] += StuffedFrameBits(canId, frame, bytes);
+  #else
+	(void)words;
+	bits[loadTick % COMMUNICATION_LOAD_BUCKETS] += FrameBits(bytes, canId >= COMMUNICATION_STD_IDS);
+  #endif
+}
+
+float CommunicationManager::WindowLoad(const uint32_t *bits) {
+	uint32_t now = micros();
+
+	/* Full buckets plus the elapsed part of the current one, but not more
+	 * than the time since Initialize()
+	 */
+	uint32_t window = (COMMUNICATION_LOAD_BUCKETS - 1) * COMMUNICATION_LOAD_BUCKET_MICROS + (now % COMMUNICATION_LOAD_BUCKET_MICROS);
+	if (now - loadStart < window) {
+		window = now - loadStart;
+	}
+	if (0 == window) {
+		return 0.0f;
+	}
+
+	uint32_t sum = 0;
+	for (uint16_t i = 0; i < COMMUNICATION_LOAD_BUCKETS; i++) {
+		sum += bits[i];
+	}
+
+	/* Bits at baud bit/s against the window in microseconds */
+	return (100.0f * 1000000.0f * sum) / ((float)baud * window);
+}
+
+unsigned char CommunicationManager::FindProducer(unsigned int canId) {
+	for (unsigned int i = 0; i < nProducers; i++) {
+		if (producers[i].canId == canId) {
+			return i;
+		}
+	}
+	return COMMUNICATION_NO_PRODUCER;
+}
+
+void CommunicationManager::ResetLatency(unsigned char producer) {
+#if COMMUNICATION_TX_STATISTICS
+	for (unsigned int k = 0; k < COMMUNICATION_LATENCY_BUCKETS; k++) {
+		latencyBuckets[producer][k] = 0;
+	}
+	latencyMax[producer] = 0;
+#else
+	(void)producer;
+#endif
+}
+
+void CommunicationManager::RecordLatency(unsigned char producer, uint32_t latency) {
+#if !COMMUNICATION_TX_STATISTICS
+	(void)producer;
+	(void)latency;
+#else
+	if (COMMUNICATION_NO_PRODUCER == producer) {
+		/* Fire() with a Can ID nobody publishes */
+		return;
+	}
+
+	unsigned int bucket = 31 - __builtin_clz(latency | 1);
+	if (bucket >= COMMUNICATION_LATENCY_BUCKETS) {
+		bucket = COMMUNICATION_LATENCY_BUCKETS - 1;
+	}
+
+	uint16_t* buckets = latencyBuckets[producer];
+	if (0xFFFF == buckets[bucket]) {
+		/* Keep the shape of the distribution */
+		for (unsigned int k = 0; k < COMMUNICATION_LATENCY_BUCKETS; k++) {
+			buckets[k] >>= 1;
+		}
+	}
+	buckets[bucket] += 1;
+
+	if (latency > latencyMax[producer]) {
+		latencyMax[producer] = latency;
+	}
+#endif
+}
+
+void CommunicationManager::InitNodes() {
+	nNodes = 0;
+	maxNodesUsed = 0;
+	for (uint16_t i = 0; i < COMMUNICATION_MAX_LIST_NODES; i++) {
+		freeNodes[i] = &nodes[i];
+	}
+}
+
+COMMUNICATION_listNode_t* CommunicationManager::NewNode() {
+	if (nNodes < COMMUNICATION_MAX_LIST_NODES) {
+		COMMUNICATION_listNode_t* result = freeNodes[nNodes++];
+
+		/* Keep track of maximal usage.
+		 */
+		if (nNodes > maxNodesUsed) {
+			maxNodesUsed = nNodes;
+		}
+		if (maxNodesUsed == COMMUNICATION_MAX_LIST_NODES) {
+			maxNodesUsed = 0;
+		}
+
+		return result;
+	}
+
+	return nullptr;
+}
+
+void CommunicationManager::DeleteNode(COMMUNICATION_listNode_t* node) {
+	nNodes -= 1;
+	freeNodes[nNodes] = node;
+}
+
+void CommunicationManager::InitList() {
+	queueTop = 0;
+	for (uint16_t i = 0; i < COMMUNICATION_QUEUE_GROUPS; i++) {
+		queueGroups[i] = 0;
+	}
+	for (uint16_t i = 0; i < COMMUNICATION_QUEUE_WORDS; i++) {
+		queueWords[i] = 0;
+	}
+	for (uint16_t i = 0; i < COMMUNICATION_MAX_PRODUCERS; i++) {
+		queueTails[i] = COMMUNICATION_NO_NODE;
+	}
+}
+
+void CommunicationManager::AddQueueBucket(unsigned int producer) {
+	/* Searched from the top, producers mostly come in Can ID order */
+	unsigned int canId = producers[producer].canId;
+	unsigned int bucket = nQueueIds;
+	while ((bucket > 0) && (queueIds[bucket - 1] > canId)) {
+		bucket -= 1;
+	}
+
+	if ((bucket > 0) && (queueIds[bucket - 1] == canId)) {
+		/* Another producer of this Can ID */
+		queueBuckets[producer] = bucket - 1;
+		return;
+	}
+
+	queueBuckets[producer] = bucket;
+	nQueueIds += 1;
+	if (bucket == nQueueIds - 1) {
+		/* Highest Can ID so far */
+		queueIds[bucket] = canId;
+		queueTails[bucket] = COMMUNICATION_NO_NODE;
+		return;
+	}
+
+	/* Frames queued in the buckets above move along */
+	for (unsigned int i = nQueueIds - 1; i > bucket; i--) {
+		queueIds[i] = queueIds[i - 1];
+		queueTails[i] = queueTails[i - 1];
+	}
+	queueIds[bucket] = canId;
+	queueTails[bucket] = COMMUNICATION_NO_NODE;
+	for (unsigned int i = 0; i < producer; i++) {
+		if (queueBuckets[i] >= bucket) {
+			queueBuckets[i] += 1;
+		}
+	}
+
+	if (0 == queueTop) {
+		/* Nothing queued, the bitmap stays empty */
+		return;
+	}
+	queueTop = 0;
+	for (uint16_t i = 0; i < COMMUNICATION_QUEUE_GROUPS; i++) {
+		queueGroups[i] = 0;
+	}
+	for (uint16_t i = 0; i < COMMUNICATION_QUEUE_WORDS; i++) {
+		queueWords[i] = 0;
+	}
+	for (unsigned int i = 0; i < nQueueIds; i++) {
+		if (COMMUNICATION_NO_NODE != queueTails[i]) {
+			unsigned int word = i >> 5;
+			queueWords[word] |= 0x80000000UL >> (i & 31);
+			queueGroups[word >> 5] |= 0x80000000UL >> (word & 31);
+			queueTop |= 0x80000000UL >> (word >> 5);
+		}
+	}
+}
+
+bool CommunicationManager::ListAdd(unsigned char producer, uint32_t queued) {
+	COMMUNICATION_listNode_t* newNode = NewNode();
+
+	if (newNode) {
+		newNode->next = COMMUNICATION_NO_NODE;
+		/* TX_COALESCE packs the frame when it is sent */
+		if (TX_QUEUE == txMode) {
+			ProducerWords(producer, newNode->words);
+		}
+		newNode->canId = producers[producer].canId;
+		newNode->bytes = producers[producer].bytes;
+		newNode->queued = queued;
+		newNode->source = producer;
+
+		ListAdd(newNode);
+
+		/* Success */
+		return true;
+	}
+
+	/* Failed: List full */
+	return false;
+}
+
+bool CommunicationManager::ListRefresh(unsigned char producer) {
+	/* The pending frame is packed when it is sent (TX_COALESCE) */
+	return (COMMUNICATION_NO_NODE != queueTails[queueBuckets[producer]]);
+}
+
+void CommunicationManager::ListAdd(COMMUNICATION_listNode_t* newNode, bool front) {
+	unsigned int bucket = queueBuckets[newNode->source];
+	unsigned int word = bucket >> 5;
+	unsigned char index = newNode - nodes;
+	unsigned char tail = queueTails[bucket];
+
+	if (COMMUNICATION_NO_NODE == tail) {
+		newNode->next = index;
+		queueWords[word] |= 0x80000000UL >> (bucket & 31);
+		queueGroups[word >> 5] |= 0x80000000UL >> (word & 31);
+		queueTop |= 0x80000000UL >> (word >> 5);
 	}
 	else {
-		/* Go left: Since the list pointer is always refering to the
-		 *          element with the smallest id, the new node is just
-		 *          added to the left and the list pointer is set to the new
-		 *          Node.
+		/* Behind the tail, in front of the head: it is the new head unless
+		 * it becomes the tail
 		 */
-		nodeList->left = newNode;
-		newNode->right = nodeList;
-		nodeList = newNode;
+		newNode->next = nodes[tail].next;
+		nodes[tail].next = index;
+		if (front) {
+			return;
+		}
 	}
+	queueTails[bucket] = index;
+}
+
+unsigned int CommunicationManager::ListHeadBucket() {
+	/* Must not be called on an empty list */
+	unsigned int group = __builtin_clz(queueTop);
+	unsigned int word = (group << 5) + __builtin_clz(queueGroups[group]);
+
+	return (word << 5) + __builtin_clz(queueWords[word]);
+}
+
+unsigned int CommunicationManager::ListHeadId() {
+	return queueIds[ListHeadBucket()];
 }
 
-COMMUNICATION_producer_t CommunicationManager::ListGetHead() {
-	return nodeList->producer;
+COMMUNICATION_listNode_t* CommunicationManager::ListGetHead() {
+	return &nodes[nodes[queueTails[ListHeadBucket()]].next];
 }
 
 void CommunicationManager::ListRemoveHead() {
 	if (!ListEmpty()) {
-		COMMUNICATION_listNode_t* newHead = nodeList->right;
+		unsigned int bucket = ListHeadBucket();
+		unsigned char tail = queueTails[bucket];
+		COMMUNICATION_listNode_t* head = &nodes[nodes[tail].next];
 
-		// Free storage
-		DeleteNode(nodeList);
+		if (head != &nodes[tail]) {
+			nodes[tail].next = head->next;
+		}
+		else {
+			/* Bucket is empty now */
+			queueTails[bucket] = COMMUNICATION_NO_NODE;
+			unsigned int word = bucket >> 5;
+			queueWords[word] &= ~(0x80000000UL >> (bucket & 31));
+			if (0 == queueWords[word]) {
+				queueGroups[word >> 5] &= ~(0x80000000UL >> (word & 31));
+				if (0 == queueGroups[word >> 5]) {
+					queueTop &= ~(0x80000000UL >> (word >> 5));
+				}
+			}
+		}
 
-		nodeList = newHead;
+		// Free storage
+		DeleteNode(head);
 	}
 }
 
 bool CommunicationManager::ListEmpty() {
-	return (nullptr == nodeList);
+	return (0 == queueTop);
 }
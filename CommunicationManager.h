@@ -10,6 +10,8 @@
 
  #ifndef COMMUNICATION_TEST_ENV
  #include "FlexCAN.h"
+ #else
+ #include "CommunicationTestEnv.h"
  #endif
 
   /************************************************************************
@@ -22,52 +24,474 @@
  #define COMMUNICATION_DEBUG_PRINTLN(...) if(1 == COMMUNICATION_DEBUG_MODE) Serial.println(__VA_ARGS__)
 
 
- enum COMMUNICATION_CYCLE { CYCLE_10 = 0, CYCLE_20, CYCLE_40, CYCLE_80, CYCLE_100 };
+ /* Cycle times in microseconds, Publish() accepts any other period as well */
+ enum COMMUNICATION_CYCLE {
+ 	CYCLE_10 = 10000UL,
+ 	CYCLE_20 = 20000UL,
+ 	CYCLE_40 = 40000UL,
+ 	CYCLE_80 = 80000UL,
+ 	CYCLE_100 = 100000UL
+ };
+
+ /* Producers are sent at phase + k * cycle microseconds after Initialize().
+  * PHASE_AUTO picks the millisecond with the lowest bus load over the
+  * balance window (least common multiple of the CYCLE_* values), cycles
+  * below one millisecond load every millisecond alike and get phase 0.
+  */
+ #define COMMUNICATION_PHASE_AUTO 0xFFFFFFFFUL
+ #define COMMUNICATION_BALANCE_MILLIS 400
+
+ /* Hashed timing wheel driving the producers: a producer due at t (us) is
+  * kept in slot (t >> TICK_BITS) % WHEEL_SIZE, Update() only visits the
+  * slots of the ticks passed since the last call.
+  */
+ #define COMMUNICATION_WHEEL_TICK_BITS 10
+ #ifndef COMMUNICATION_WHEEL_SIZE
+ #define COMMUNICATION_WHEEL_SIZE 128
+ #endif
+ #define COMMUNICATION_NO_TIMER 0xFF
+ #define COMMUNICATION_NO_PRODUCER 0xFF
+
+ #if (COMMUNICATION_WHEEL_SIZE & (COMMUNICATION_WHEEL_SIZE - 1)) != 0
+ #error "COMMUNICATION_WHEEL_SIZE must be a power of two"
+ #endif
+
+ /* Signals packed into one frame (PublishFrame() / PublishSignal()), frames
+  * of a producer without ref are built from its signals.
+  */
+ #ifndef COMMUNICATION_MAX_SIGNALS
+ #define COMMUNICATION_MAX_SIGNALS 128
+ #endif
+ #define COMMUNICATION_NO_SIGNAL 0xFF
+
+ #if (COMMUNICATION_MAX_SIGNALS < 1) || (COMMUNICATION_MAX_SIGNALS >= COMMUNICATION_NO_SIGNAL)
+ #error "COMMUNICATION_MAX_SIGNALS must fit into the signal index"
+ #endif
+
+ /* Compile time frame layouts (see CommunicationFrame): conversion between
+  * a struct of values and the mailbox data words
+  */
+ typedef void (*COMMUNICATION_PACKER)(const void* val, uint32_t* words);
+ typedef void (*COMMUNICATION_UNPACKER)(void* val, const uint32_t* words);
 
  typedef struct COMMUNICATION_producer_t {
- 	unsigned char* ref;
+ 	void* ref;
  	unsigned char bytes;
+ 	unsigned char signals;
+ 	/* Transmission on change (PublishOnChange()), COMMUNICATION_NO_EVENT if cyclic */
+ 	unsigned char event;
+ 	COMMUNICATION_PACKER pack;
  	unsigned int canId;
  	unsigned char* txFlag;
- 	COMMUNICATION_CYCLE cycle;
+ 	/* Frame sent from the cache, packed again while *dirty is set (see CacheFrame()) */
+ 	unsigned char* dirty;
+ 	uint32_t cycle;
+ 	/* Phase as registered (may be PHASE_AUTO), the one in use is in the timer */
+ 	uint32_t phase;
  } COMMUNICATION_producer_t;
 
+ /* Producers sent on change: the timer checks the value every inhibit
+  * time and queues a frame if it moved (beyond the deadband) since the last
+  * frame or if heartbeat checks passed without one.
+  */
+ #ifndef COMMUNICATION_MAX_EVENT_PRODUCERS
+ #define COMMUNICATION_MAX_EVENT_PRODUCERS 32
+ #endif
+ #define COMMUNICATION_NO_EVENT 0xFF
+
+ #if (COMMUNICATION_MAX_EVENT_PRODUCERS < 1) || (COMMUNICATION_MAX_EVENT_PRODUCERS >= COMMUNICATION_NO_EVENT)
+ #error "COMMUNICATION_MAX_EVENT_PRODUCERS must fit into the event index"
+ #endif
+
+ typedef struct COMMUNICATION_event_t {
+ 	/* Value of the last frame, compared bytewise unless numeric */
+ 	unsigned char last[8];
+ 	float lastValue;
+ 	float deadband;
+ 	/* Checks between two frames at most (0: none) / since the last frame */
+ 	uint16_t heartbeat;
+ 	uint16_t silent;
+ 	unsigned char type;
+ 	bool numeric;
+ 	bool sent;
+ } COMMUNICATION_event_t;
+
+ typedef struct COMMUNICATION_timer_t {
+ 	uint32_t due;
+ 	uint32_t phase;
+ 	unsigned char next;
+ } COMMUNICATION_timer_t;
+
+ /* Frame level access for protocols on top of the manager (see
+  * CommunicationTransport): data holds the len bytes of the frame in frame
+  * order.
+  */
+ typedef void (*COMMUNICATION_FRAME_HANDLER)(void* context, uint32_t canId, const unsigned char* data, unsigned int len);
+
+ /* Value level subscriber, called after the value was written to val */
+ typedef void (*COMMUNICATION_CALLBACK)(void* context, void* val);
+
+ /* CALLBACK_INTERRUPT reacts as soon as the frame arrived (RX_INTERRUPT),
+  * CALLBACK_UPDATE is for callbacks which must not run in an interrupt and
+  * reacts no earlier than a flag polled after Update()
+  */
+ enum COMMUNICATION_CALLBACK_MODE {
+ 	CALLBACK_UPDATE,
+ 	CALLBACK_INTERRUPT
+ };
+
  typedef struct COMMUNICATION_consumer_t {
- 	unsigned char* ref;
+ 	void* ref;
  	unsigned char bytes;
+ 	unsigned char signal;
+ 	unsigned char next;
+ 	/* ref is a COMMUNICATION_snapshot_t */
+ 	bool snapshot;
+ 	/* callback runs / snapshot is written in the RX interrupt (RX_INTERRUPT) */
+ 	bool interrupt;
+ 	COMMUNICATION_UNPACKER unpack;
  	unsigned int canId;
  	unsigned char* rxFlag;
+ 	COMMUNICATION_FRAME_HANDLER handler;
+ 	void* context;
+ 	COMMUNICATION_CALLBACK callback;
  } COMMUNICATION_consumer_t;
 
+ /* Subscriber buffer which the RX interrupt writes while the loop reads
+  * it (see SubscribeSnapshot()). The sequence is odd while a frame is
+  * copied in, readers retry instead of blocking the writer. Every frame
+  * adds 2, so sequence / 2 is the generation of the value.
+  */
+ typedef struct COMMUNICATION_snapshot_t {
+ 	volatile uint32_t sequence;
+ 	uint32_t words[2];
+ } COMMUNICATION_snapshot_t;
+
+ /* Writer and reader run on the same core, which sees its own accesses
+  * in program order, so only the compiler must not move them across the
+  * sequence updates
+  */
+ #define COMMUNICATION_SNAPSHOT_BARRIER() __asm__ volatile("" : : : "memory")
+
+ typedef struct COMMUNICATION_dispatchEntry_t {
+ 	uint32_t canId;
+ 	unsigned char first;
+ } COMMUNICATION_dispatchEntry_t;
+
+ /* Queued frame: the payload (frame order) is packed when the frame is
+  * queued, so it carries the value that was due and the TX path only
+  * copies two words. Only standard identifiers are queued.
+  */
  typedef struct COMMUNICATION_listNode_t {
- 	COMMUNICATION_producer_t producer;
- 	COMMUNICATION_listNode_t* left;
- 	COMMUNICATION_listNode_t* right;
+ 	uint32_t words[2];
+ 	uint32_t queued;
+ 	uint16_t canId : 11;
+ 	uint16_t bytes : 5;
+ 	unsigned char source;
+ 	unsigned char next;
  } COMMUNICATION_listNode_t;
 
+ static_assert(sizeof(COMMUNICATION_listNode_t) == 16, "Queue nodes take 16 bytes");
+
+ /* Table sizes, each can be set for the node at hand (compiler flags) */
+ #ifndef COMMUNICATION_MAX_CONSUMERS
  #define COMMUNICATION_MAX_CONSUMERS 128
+ #endif
+ #ifndef COMMUNICATION_MAX_PRODUCERS
  #define COMMUNICATION_MAX_PRODUCERS 128
- #define COMMUNICATION_FIRE_STACK_SIZE 8
+ #endif
+ #ifndef COMMUNICATION_FIRE_QUEUE_SIZE
+ #define COMMUNICATION_FIRE_QUEUE_SIZE 8
+ #endif
+ #ifndef COMMUNICATION_FRAME_QUEUE_SIZE
+ #define COMMUNICATION_FRAME_QUEUE_SIZE 16
+ #endif
+ #ifndef COMMUNICATION_MAX_LIST_NODES
  #define COMMUNICATION_MAX_LIST_NODES 96
+ #endif
+ /* Frames sent from the cache (CacheFrame()), only frames of several signals */
+ #ifndef COMMUNICATION_MAX_CACHED_FRAMES
+ #define COMMUNICATION_MAX_CACHED_FRAMES 32
+ #endif
+
+ #if COMMUNICATION_MAX_CACHED_FRAMES > 0xFF
+ #error "COMMUNICATION_MAX_CACHED_FRAMES must fit into the cache slot"
+ #endif
+
+ /* Message buffers of the controller, list frames in TX mailboxes are tracked */
+ #define COMMUNICATION_MAILBOXES 16
+
+ /* The frame is kept, so a frame taken back is queued again unchanged */
+ typedef struct COMMUNICATION_txMailbox_t {
+ 	uint32_t words[2];
+ 	uint32_t queued;
+ 	unsigned int canId;
+ 	unsigned char bytes;
+ 	unsigned char source;
+ } COMMUNICATION_txMailbox_t;
+
+ /* Queueing latency histograms: bucket k counts the frames which waited
+  * 2^k .. 2^(k+1)-1 us (bucket 0 also 0 us, the last bucket everything
+  * above) between being queued and being handed to a mailbox. They and
+  * the counters of coalesced frames are kept per producer, TX_STATISTICS 0
+  * leaves them out (the getters report nothing).
+  */
+ #ifndef COMMUNICATION_TX_STATISTICS
+ #define COMMUNICATION_TX_STATISTICS 1
+ #endif
+ #define COMMUNICATION_LATENCY_BUCKETS 16
+
+ #if COMMUNICATION_MAX_PRODUCERS >= COMMUNICATION_NO_TIMER
+ #error "COMMUNICATION_MAX_PRODUCERS must fit into the timer index"
+ #endif
+
+ /* Receive dispatch: the subscribed identifiers are kept in an open
+  * addressing hash table (power of two, at least twice the number of
+  * consumers). Static tables (flash) direct-map the standard identifiers
+  * and hash only the others.
+  */
+ #define COMMUNICATION_STD_IDS 2048
+ #ifndef COMMUNICATION_EXT_DISPATCH_BITS
+ #define COMMUNICATION_EXT_DISPATCH_BITS 8
+ #endif
+ #define COMMUNICATION_EXT_DISPATCH_SIZE (1 << COMMUNICATION_EXT_DISPATCH_BITS)
+ #define COMMUNICATION_NO_CONSUMER 0xFF
+
+ #if COMMUNICATION_MAX_CONSUMERS >= COMMUNICATION_NO_CONSUMER
+ #error "COMMUNICATION_MAX_CONSUMERS must fit into the dispatch table index"
+ #endif
+
+ #if COMMUNICATION_EXT_DISPATCH_SIZE < 2 * COMMUNICATION_MAX_CONSUMERS
+ #error "COMMUNICATION_EXT_DISPATCH_BITS too small for COMMUNICATION_MAX_CONSUMERS"
+ #endif
+
+ /* Entry of canId in the hash table or the empty entry which ends its
+  * search, nullptr if the table is full. Multiplicative hash, linear
+  * probing, entries are never removed.
+  */
+ template <typename ENTRY>
+ constexpr ENTRY* COMMUNICATION_extDispatchEntry(ENTRY* table, uint32_t canId) {
+ 	uint32_t index = (uint32_t)(canId * 2654435761UL) >> (32 - COMMUNICATION_EXT_DISPATCH_BITS);
+ 	for (uint16_t probe = 0; probe < COMMUNICATION_EXT_DISPATCH_SIZE; probe++) {
+ 		if ((COMMUNICATION_NO_CONSUMER == table[index].first) || (table[index].canId == canId)) {
+ 			return &table[index];
+ 		}
+ 		index = (index + 1) & (COMMUNICATION_EXT_DISPATCH_SIZE - 1);
+ 	}
+ 	return nullptr;
+ }
+
+ /* Static configuration: producers, consumers and the dispatch tables are
+  * const data (flash) generated at compile time, see CommunicationTables.h.
+  * Only mutable state is kept in RAM, registration at runtime fails.
+  */
+ #ifndef COMMUNICATION_STATIC_TABLES
+ #define COMMUNICATION_STATIC_TABLES 0
+ #endif
+
+ typedef struct COMMUNICATION_tables_t {
+ 	const COMMUNICATION_producer_t* producers;
+ 	unsigned int nProducers;
+ 	const COMMUNICATION_consumer_t* consumers;
+ 	unsigned int nConsumers;
+ 	const unsigned char* stdDispatch;
+ 	const COMMUNICATION_dispatchEntry_t* extDispatch;
+ } COMMUNICATION_tables_t;
+
+ /* Transmit queue: one bucket per Can ID of the registered producers,
+  * sorted by Can ID, and a three level bitmap over the buckets (a word per
+  * 32 buckets, a group word per 32 words and one bit per group in the top
+  * word). The most significant bit stands for the lowest identifier, so
+  * count-leading-zeros yields the next frame to send.
+  */
+ #define COMMUNICATION_QUEUE_WORDS ((COMMUNICATION_MAX_PRODUCERS + 31) / 32)
+ #define COMMUNICATION_QUEUE_GROUPS ((COMMUNICATION_QUEUE_WORDS + 31) / 32)
+ #define COMMUNICATION_NO_NODE 0xFF
+
+ static_assert(COMMUNICATION_QUEUE_GROUPS <= 32, "Queue groups must fit into the top word");
+
+ #if COMMUNICATION_MAX_LIST_NODES >= COMMUNICATION_NO_NODE
+ #error "COMMUNICATION_MAX_LIST_NODES must fit into the queue index"
+ #endif
 
 
  enum COMMUNICATION_BYTE_ORDER { ORDER_MSB, ORDER_LSB };
 
+ /* Type of the variable behind a signal. The raw value in the frame is
+  * signed for the signed types and SIGNAL_FLOAT, unsigned for the others.
+  */
+ enum COMMUNICATION_SIGNAL_TYPE {
+ 	SIGNAL_UINT8,
+ 	SIGNAL_INT8,
+ 	SIGNAL_UINT16,
+ 	SIGNAL_INT16,
+ 	SIGNAL_UINT32,
+ 	SIGNAL_INT32,
+ 	SIGNAL_FLOAT,
+ 	SIGNAL_UNSIGNED_FLOAT
+ };
+
+ /* Signal of length bits (1..32) in a frame, physical value = raw * factor
+  * + offset. Bit numbering as in DBC files: bit k is bit k % 8 of frame
+  * byte k / 8. ORDER_LSB (Intel) signals start at their least significant
+  * bit and grow towards higher bytes, ORDER_MSB (Motorola) signals start at
+  * their most significant bit and grow towards lower bits and then the
+  * following byte. shift is the position of the least significant bit in
+  * the frame as a 64 bit word, big endian (ORDER_MSB) or little endian
+  * (ORDER_LSB).
+  */
+ typedef struct COMMUNICATION_signal_t {
+ 	void* ref;
+ 	float factor;
+ 	float offset;
+ 	COMMUNICATION_SIGNAL_TYPE type;
+ 	COMMUNICATION_BYTE_ORDER byteOrder;
+ 	unsigned char shift;
+ 	unsigned char length;
+ 	/* Frame bytes the signal needs */
+ 	unsigned char bytes;
+ 	bool scaled;
+ 	unsigned char next;
+ } COMMUNICATION_signal_t;
+
+ /* RX_INTERRUPT: the RX FIFO interrupt copies frames into a ring buffer
+  * which is drained by Update(). RX_POLLING: Update() reads the RX FIFO.
+  */
+ enum COMMUNICATION_RX_MODE { RX_POLLING, RX_INTERRUPT };
+
+ /* Payload of the cyclic and on-change frames:
+  * TX_QUEUE: every queued frame is sent, with the value it was queued with.
+  * TX_COALESCE: at most one pending frame per Can ID, queueing an id which
+  * is still pending is counted instead of adding another copy. The frame
+  * takes the value of its producer when it is written to a mailbox (an
+  * on-change producer compares with the value of its last check).
+  * Fire() frames are never merged and carry the value passed to Fire().
+  */
+ enum COMMUNICATION_TX_MODE { TX_QUEUE, TX_COALESCE };
+
+ /* Single producer (interrupt) / single consumer (Update) ring, power of
+  * two. Only RX_INTERRUPT uses it.
+  */
+ #ifndef COMMUNICATION_RX_RING_SIZE
+ #define COMMUNICATION_RX_RING_SIZE 64
+ #endif
+
+ #if (COMMUNICATION_RX_RING_SIZE & (COMMUNICATION_RX_RING_SIZE - 1)) != 0
+ #error "COMMUNICATION_RX_RING_SIZE must be a power of two"
+ #endif
+
+ /* Bus load estimation over a sliding window of LOAD_BUCKETS buckets. Frames
+  * are counted with worst case bit stuffing, or with the stuff bits they
+  * actually contain (CRC included) if EXACT_STUFFING is 1.
+  */
+ #define COMMUNICATION_EXACT_STUFFING 0
+ #define COMMUNICATION_LOAD_BUCKETS 10
+ #define COMMUNICATION_LOAD_BUCKET_MICROS 10000UL
+
+ /* Hardware acceptance filters (RX FIFO filter table elements) */
+ #define COMMUNICATION_RX_FILTERS 8
+
+ typedef struct COMMUNICATION_rxFilter_t {
+ 	uint32_t canId;
+ 	uint32_t mask;
+ 	unsigned char ext;
+ } COMMUNICATION_rxFilter_t;
+
+ typedef struct COMMUNICATION_rxFrame_t {
+ 	uint32_t canId;
+ 	unsigned char bytes;
+ 	uint32_t words[2];
+ } COMMUNICATION_rxFrame_t;
+
+ typedef struct COMMUNICATION_frame_t {
+ 	uint32_t words[2];
+ 	unsigned int canId;
+ 	unsigned char bytes;
+ } COMMUNICATION_frame_t;
+
  class CommunicationManager {
+ #ifdef COMMUNICATION_TEST_ENV
+ 	friend class CommunicationBenchmark;
+ #endif
+
  private:
  	CommunicationManager();
 
  #ifndef COMMUNICATION_TEST_ENV
- 	CAN_message_t CAN_outMsg;
- 	CAN_message_t CAN_inMsg;
-
  	FlexCAN CAN_Can0;
  	CAN_filter_t CAN_filter;
  #endif
 
  	void InitCan(uint32_t baud);
- 	int SendCanMessage(uint16_t msgID, uint8_t *data, uint8_t lengthOfData);
- 	int ReceiveCanMessage(uint32_t *id, uint8_t *buf, int n);
+ 	/* Payloads are passed as mailbox data words, see Pack() / Unpack() */
+ 	/* Mailbox used or -1, see FlexCAN::writeWords() / writeReserved() / preempt() */
+ 	int SendCanMessage(uint16_t msgID, const uint32_t *words, uint8_t lengthOfData, int first = 0);
+ 	int SendReservedCanMessage(uint16_t msgID, const uint32_t *words, uint8_t lengthOfData);
+ 	/* Mailboxes set in keep are never taken over, aborted is 2 while the
+ 	 * frame to abort is on the bus and nothing was written
+ 	 */
+ 	int PreemptCanMessage(uint16_t msgID, const uint32_t *words, uint8_t lengthOfData, uint8_t *aborted, uint32_t *abortedId, uint16_t keep);
+ 	bool TxPending(int mailbox);
+ 	/* See FlexCAN::abort() */
+ 	int AbortCanMessage(int mailbox);
+ 	int ReadCanMessage(uint32_t *id, uint32_t *words, uint8_t *len);
+
+ 	/* Next received frame without copying it: words points into the RX
+ 	 * FIFO message buffer (RX_POLLING) or the RX ring (RX_INTERRUPT) and
+ 	 * stays valid until ReleaseCanMessage().
+ 	 */
+ 	bool PeekCanMessage(uint32_t *id, uint8_t *len, const volatile uint32_t **words);
+ 	void ReleaseCanMessage();
+
+ 	/* Conversion between a value of bytes length and the mailbox data words
+ 	 * (frame byte 0 is the most significant byte of words[0])
+ 	 */
+ 	static void Unpack(const uint32_t *words, unsigned char *out, unsigned int bytes, COMMUNICATION_BYTE_ORDER byteOrder);
+ 	static void Pack(const unsigned char *in, uint32_t *words, unsigned int bytes, COMMUNICATION_BYTE_ORDER byteOrder);
+ 	/* Unpack() straight out of a received frame of len bytes, bytes beyond
+ 	 * the frame read as zero
+ 	 */
+ 	static void UnpackFrame(const volatile uint32_t *words, uint8_t len, unsigned char *out, unsigned int bytes, COMMUNICATION_BYTE_ORDER byteOrder);
+
+ #if COMMUNICATION_STATIC_TABLES
+ 	const COMMUNICATION_signal_t* signals;
+ #else
+ 	COMMUNICATION_signal_t signals[COMMUNICATION_MAX_SIGNALS];
+ #endif
+ 	unsigned int nSignals;
+
+ 	/* Checks the layout and appends a signal, COMMUNICATION_NO_SIGNAL if
+ 	 * it does not fit
+ 	 */
+ 	unsigned char AddSignal(void* val, COMMUNICATION_SIGNAL_TYPE type, unsigned int canId, unsigned char startBit, unsigned char length, COMMUNICATION_BYTE_ORDER byteOrder, float factor, float offset);
+ 	/* Bits of the frame (big endian 64 bit word) taken by a signal */
+ 	static uint64_t SignalMask(const COMMUNICATION_signal_t &signal);
+ 	static uint32_t SignalRaw(const COMMUNICATION_signal_t &signal);
+ 	static void SignalStore(const COMMUNICATION_signal_t &signal, uint32_t raw);
+ 	/* Frame of the producer from ref or its signals */
+ 	void PackProducer(const COMMUNICATION_producer_t &producer, uint32_t *words);
+ 	/* Frame of a registered producer, copied from txCache unless it is dirty */
+ 	void ProducerWords(unsigned char producer, uint32_t *words);
+ 	void PackSignals(unsigned char first, uint32_t *words);
+
+ 	COMMUNICATION_RX_MODE rxMode;
+
+ 	COMMUNICATION_rxFrame_t rxRing[COMMUNICATION_RX_RING_SIZE];
+
+ 	/* Free running counters, head is only written by the interrupt and
+ 	 * tail only by Update().
+ 	 */
+ 	volatile unsigned int rxRingHead;
+ 	volatile unsigned int rxRingTail;
+ 	volatile unsigned long rxRingOverruns;
+ 	volatile unsigned int rxRingMaxUsed;
+
+ 	void InitRxRing();
+ 	bool RxRingPush(uint32_t canId, const uint32_t *words, uint8_t bytes);
+ 	bool RxRingPeek(uint32_t *id, uint8_t *len, const volatile uint32_t **words);
+ 	void RxRingRelease();
+ 	void HandleRxInterrupt();
+ 	static void RxInterrupt();
 
  	COMMUNICATION_listNode_t nodes[COMMUNICATION_MAX_LIST_NODES];
  	COMMUNICATION_listNode_t* freeNodes[COMMUNICATION_MAX_LIST_NODES];
@@ -79,44 +503,398 @@
  	COMMUNICATION_listNode_t* NewNode();
  	void DeleteNode(COMMUNICATION_listNode_t* node);
 
- 	COMMUNICATION_listNode_t* nodeList;
+ 	uint32_t queueTop;
+ 	uint32_t queueGroups[COMMUNICATION_QUEUE_GROUPS];
+ 	uint32_t queueWords[COMMUNICATION_QUEUE_WORDS];
+ 	/* Buckets are circular lists in queue order, the newest node (tail)
+ 	 * links to the oldest one, so frames of an identifier leave FIFO
+ 	 */
+ 	unsigned char queueTails[COMMUNICATION_MAX_PRODUCERS];
+ 	/* Can ID of each bucket (ascending) and bucket of each producer */
+ 	uint16_t queueIds[COMMUNICATION_MAX_PRODUCERS];
+ 	unsigned char queueBuckets[COMMUNICATION_MAX_PRODUCERS];
+ 	unsigned int nQueueIds;
 
  	void InitList();
- 	bool ListAdd(COMMUNICATION_producer_t producer);
- 	void ListAdd(COMMUNICATION_listNode_t* node);
- 	COMMUNICATION_producer_t ListGetHead();
+ 	/* Bucket of a new producer, the buckets above move up if its Can ID is new */
+ 	void AddQueueBucket(unsigned int producer);
+ 	unsigned int ListHeadBucket();
+ 	unsigned int ListHeadId();
+ 	bool ListAdd(unsigned char producer, uint32_t queued);
+ 	bool ListRefresh(unsigned char producer);
+ 	/* Appends node to its bucket, or puts it in front (a frame taken back
+ 	 * from a mailbox is older than those still queued)
+ 	 */
+ 	void ListAdd(COMMUNICATION_listNode_t* node, bool front = false);
+ 	COMMUNICATION_listNode_t* ListGetHead();
  	void ListRemoveHead();
  	bool ListEmpty();
 
+ #if COMMUNICATION_STATIC_TABLES
+ 	const COMMUNICATION_producer_t* producers;
+ 	const COMMUNICATION_consumer_t* consumers;
+ #else
  	COMMUNICATION_producer_t producers[COMMUNICATION_MAX_PRODUCERS];
  	COMMUNICATION_consumer_t consumers[COMMUNICATION_MAX_CONSUMERS];
+ #endif
 
  	unsigned int nProducers;
  	unsigned int nConsumers;
 
- 	COMMUNICATION_producer_t emergencies[COMMUNICATION_FIRE_STACK_SIZE];
+ 	/* Consumer of val without flag, handler or callback */
+ 	static COMMUNICATION_consumer_t NewConsumer(void* val, unsigned int bytes, unsigned int canId);
+ 	bool AddConsumer(const COMMUNICATION_consumer_t &consumer);
+
+ 	/* Callbacks and snapshots served in the RX interrupt (RX_INTERRUPT only) */
+ 	unsigned int nInterruptConsumers;
+ 	void DispatchInterrupt(uint32_t canId, const uint32_t *words, uint8_t len);
+ 	void StoreSnapshot(const COMMUNICATION_consumer_t &consumer, const volatile uint32_t *words, uint8_t len);
+
+ 	template <class FUNCTOR>
+ 	static void CallFunctor(void* context, void* val) {
+ 		(*(FUNCTOR*)context)(val);
+ 	}
+ 	bool AddProducer(void* val, unsigned int bytes, unsigned int canId, unsigned char* txFlag, uint32_t cycle, uint32_t phase, COMMUNICATION_PACKER pack);
+
+ #if !COMMUNICATION_STATIC_TABLES
+ 	COMMUNICATION_event_t events[COMMUNICATION_MAX_EVENT_PRODUCERS];
+ #endif
+ 	unsigned int nEvents;
+
+ 	bool AddEventProducer(void* val, unsigned int bytes, unsigned int canId, unsigned char* txFlag, uint32_t inhibit, uint32_t heartbeat, const COMMUNICATION_event_t &event);
+ 	/* Called on every timer expiry of an event producer, true if a frame
+ 	 * has to be queued (the value is taken as the last one sent)
+ 	 */
+ 	bool EventDue(unsigned char producer);
+ 	static float EventValue(const void* val, COMMUNICATION_SIGNAL_TYPE type);
+ 	bool PublishPacked(void* val, unsigned int bytes, unsigned int canId, unsigned char* txFlag, uint32_t cycle, uint32_t phase, COMMUNICATION_PACKER pack);
+ 	bool SubscribePacked(void* val, unsigned int bytes, unsigned int canId, unsigned char* rxFlag, COMMUNICATION_UNPACKER unpack);
+
+ 	COMMUNICATION_TX_MODE txMode;
+
+ 	/* One timer per producer */
+ 	uint32_t scheduleStart;
+ 	COMMUNICATION_timer_t timers[COMMUNICATION_MAX_PRODUCERS];
+ 	unsigned char wheel[COMMUNICATION_WHEEL_SIZE];
+ 	uint32_t wheelTick;
+
+ 	void InitWheel();
+ 	void InitSchedule(unsigned int producer);
+ 	void WheelInsert(unsigned char producer);
+ 	unsigned char WheelExpire(uint32_t now);
+ 	/* Bus load (bits) of the registered producers per millisecond of the
+ 	 * balance window, a producer is added once its phase is known
+ 	 */
+ 	uint16_t phaseLoad[COMMUNICATION_BALANCE_MILLIS];
+
+ 	void InitPhaseLoad();
+ 	void AddPhaseLoad(unsigned int producer);
+ 	uint32_t AutoPhase(uint32_t cycle);
+ 	static unsigned int FrameBits(unsigned int bytes, bool ext = false);
+ 	static unsigned int StuffedFrameBits(uint32_t canId, const uint32_t *words, uint8_t bytes);
+
+ 	/* Bits sent / received per bucket, bucket of the current time is
+ 	 * loadTick % COMMUNICATION_LOAD_BUCKETS.
+ 	 */
+ 	uint32_t baud;
+ 	uint32_t loadStart;
+ 	uint32_t loadTick;
+ 	uint32_t txBits[COMMUNICATION_LOAD_BUCKETS];
+ 	uint32_t rxBits[COMMUNICATION_LOAD_BUCKETS];
+
+ 	/* Bits per second of the registered producers */
+ 	uint32_t projectedBits;
+
+ 	void InitLoad();
+ 	void AdvanceLoad(uint32_t now);
+ 	void CountFrame(uint32_t *bits, uint32_t canId, const volatile uint32_t *words, uint8_t bytes);
+ 	float WindowLoad(const uint32_t *bits);
+
+ 	/* Packed frames of the producers with a dirty flag, by cacheSlots[producer] */
+ 	uint32_t txCache[COMMUNICATION_MAX_CACHED_FRAMES][2];
+ 	unsigned char cacheSlots[COMMUNICATION_MAX_PRODUCERS];
+ 	unsigned int nCachedFrames;
+
+ 	/* False for a single value (packing it costs no more than the copy)
+ 	 * or if the cache is full
+ 	 */
+ 	bool AddCacheSlot(unsigned int producer);
+
+ #if COMMUNICATION_TX_STATISTICS
+ 	/* Frames merged into a pending frame, per producer */
+ 	unsigned long coalesced[COMMUNICATION_MAX_PRODUCERS];
+
+ 	/* Counters are halved when one of them would overflow */
+ 	uint16_t latencyBuckets[COMMUNICATION_MAX_PRODUCERS][COMMUNICATION_LATENCY_BUCKETS];
+ 	uint32_t latencyMax[COMMUNICATION_MAX_PRODUCERS];
+ #endif
+
+ 	/* Time of the current Update() call */
+ 	uint32_t updateMicros;
+
+ 	unsigned char FindProducer(unsigned int canId);
+ 	void ResetLatency(unsigned char producer);
+ 	void RecordLatency(unsigned char producer, uint32_t latency);
+
+ #if COMMUNICATION_STATIC_TABLES
+ 	const unsigned char* stdDispatch;
+ 	const COMMUNICATION_dispatchEntry_t* extDispatch;
+ #else
+ 	COMMUNICATION_dispatchEntry_t dispatch[COMMUNICATION_EXT_DISPATCH_SIZE];
+
+ 	unsigned char* DispatchSlot(uint32_t canId, bool insert);
+ #endif
 
+ 	void InitDispatch();
+ 	/* First consumer of canId or COMMUNICATION_NO_CONSUMER */
+ 	unsigned char DispatchFirst(uint32_t canId);
+
+ 	/* One spare entry, a filter beyond COMMUNICATION_RX_FILTERS is merged
+ 	 * with a neighbour right away
+ 	 */
+ 	COMMUNICATION_rxFilter_t rxFilters[COMMUNICATION_RX_FILTERS + 1];
+ 	unsigned int nRxFilters;
+ 	bool initialized;
+
+ 	void UpdateRxFilters();
+ 	void AddRxFilter(uint32_t canId);
+ 	void ApplyRxFilters();
+
+ 	/* Fire() frames in the order they were fired, they bypass the message
+ 	 * list: the reserved mailbox takes them, or a preempted one if the
+ 	 * reserved mailbox still holds a frame with a higher Can ID.
+ 	 */
+ 	COMMUNICATION_listNode_t emergencies[COMMUNICATION_FIRE_QUEUE_SIZE];
+
+ 	unsigned int emergencyHead;
  	unsigned int nEmergencies;
 
+ 	/* Can ID last written to the reserved mailbox and the mailbox of the
+ 	 * last preemption (-1 if none), equal Can IDs never preempt each other
+ 	 * so they keep their order.
+ 	 */
+ 	unsigned int reservedId;
+ 	int preemptMailbox;
+ 	unsigned long abortedFrames;
+
+ 	bool FireProducer(COMMUNICATION_producer_t producer);
+ 	bool SendEmergency(const COMMUNICATION_listNode_t &emergency);
+ 	void Requeue(int mailbox);
+
+ 	/* List frames handed to the controller, one bit per mailbox. Only a
+ 	 * Fire() frame takes one of them back (the controller already sends the
+ 	 * pending frame with the lowest Can ID first), the abort of a frame on
+ 	 * the bus is finished by the next Update().
+ 	 */
+ 	COMMUNICATION_txMailbox_t txMailboxes[COMMUNICATION_MAILBOXES];
+ 	uint16_t txMailboxMask;
+ 	int abortMailbox;
+
+ 	bool FinishAbort();
+
+ 	/* SendFrame() frames in the order they were queued, they compete with
+ 	 * the list by Can ID. The controller sends equal identifiers in mailbox
+ 	 * order, so a frame only goes into a mailbox above those still holding
+ 	 * its Can ID (first). Their mailboxes (Can ID in txMailboxes) are never
+ 	 * taken back.
+ 	 */
+ 	COMMUNICATION_frame_t frameQueue[COMMUNICATION_FRAME_QUEUE_SIZE];
+ 	unsigned int frameHead;
+ 	unsigned int nFrames;
+ 	uint16_t frameMailboxMask;
+
+ 	bool FrameReady(int *first);
+ 	bool SendQueuedFrame(int first);
+
+ 	unsigned int messagesSent;
+ 	unsigned int maxMessagesSent;
+
  	COMMUNICATION_BYTE_ORDER byteOrder;
 
  public:
  	static CommunicationManager* GetInstance();
 
- 	void Initialize(uint32_t baud = 500000, COMMUNICATION_BYTE_ORDER byteOrder = ORDER_MSB);
+ 	void Initialize(uint32_t baud = 500000, COMMUNICATION_BYTE_ORDER byteOrder = ORDER_MSB, COMMUNICATION_RX_MODE rxMode = RX_POLLING, COMMUNICATION_TX_MODE txMode = TX_QUEUE);
+
+ #if COMMUNICATION_STATIC_TABLES
+ 	/* Takes the producers and consumers from tables, which have to stay
+ 	 * valid (see CommunicationTables.h)
+ 	 */
+ 	void Initialize(const COMMUNICATION_tables_t &tables, uint32_t baud = 500000, COMMUNICATION_BYTE_ORDER byteOrder = ORDER_MSB, COMMUNICATION_RX_MODE rxMode = RX_POLLING, COMMUNICATION_TX_MODE txMode = TX_QUEUE);
+ #endif
 
  	unsigned int GetMessageUtilization();
 
  	unsigned int GetMaxMessageUtilization();
 
+ 	/* Frames handed to the CAN controller by the last / busiest Update() call */
+ 	unsigned int GetMessagesSent();
+
+ 	unsigned int GetMaxMessagesSent();
+
+ 	/* Queued frames taken back from a mailbox to make room for a Fire() frame */
+ 	unsigned long GetAbortedFrames();
+
+ 	/* Bus load in percent caused by the frames this node sent / received
+ 	 * (after acceptance filtering) within the sliding window
+ 	 */
+ 	float GetTxLoad();
+
+ 	float GetRxLoad();
+
+ 	/* Bus load in percent the registered producers cause at their cycle times */
+ 	float GetProjectedLoad();
+
+ 	/* Queueing latency histogram (COMMUNICATION_LATENCY_BUCKETS entries) of the
+ 	 * producers with canId / with the given cycle time. Fire() frames count
+ 	 * for the producer with the same Can ID. False if there is no such
+ 	 * producer or COMMUNICATION_TX_STATISTICS is 0.
+ 	 */
+ 	bool GetLatencyHistogram(unsigned int canId, unsigned long* buckets);
+
+ 	bool GetCycleLatencyHistogram(uint32_t cycle, unsigned long* buckets);
+
+ 	/* Longest queueing latency of canId in microseconds */
+ 	uint32_t GetMaxLatency(unsigned int canId);
+
+ 	void ResetLatency();
+
+ 	/* Frames of canId merged into a pending frame (TX_COALESCE) */
+ 	unsigned long GetCoalesced(unsigned int canId);
+
+ 	/* Phase of the producer with canId in microseconds */
+ 	uint32_t GetPhase(unsigned int canId);
+
+ 	/* Frames dropped because the receive ring was full (RX_INTERRUPT) */
+ 	unsigned long GetRxOverruns();
+
+ 	unsigned int GetMaxRxRingUtilization();
+
+ 	/* Acceptance filters derived from the subscriptions, returns the number
+ 	 * of filters copied into filters (at most COMMUNICATION_RX_FILTERS)
+ 	 */
+ 	unsigned int GetRxFilters(COMMUNICATION_rxFilter_t* filters);
+
  	bool Fire(unsigned int canId);
 
+ 	/* val is copied, it only has to be valid during the call */
  	bool Fire(void* val, unsigned int bytes, unsigned int canId);
 
- 	bool Publish(void* val, unsigned int bytes, unsigned int canId, unsigned char* txFlag, COMMUNICATION_CYCLE cycle);
+ 	bool Publish(void* val, unsigned int bytes, unsigned int canId, unsigned char* txFlag, uint32_t cycle, uint32_t phase = COMMUNICATION_PHASE_AUTO);
 
  	bool Subscribe(void* val, unsigned int bytes, unsigned int canId, unsigned char* rxFlag);
 
+ 	/* Sends val when its bytes changed, checked every inhibit microseconds
+ 	 * (the minimum distance between two frames), and at least every
+ 	 * heartbeat microseconds (0: only on change). The first check always
+ 	 * sends. The projected load counts every check as a frame.
+ 	 */
+ 	bool PublishOnChange(void* val, unsigned int bytes, unsigned int canId, unsigned char* txFlag, uint32_t inhibit, uint32_t heartbeat = 0);
+
+ 	/* Same for a numeric value, which is only sent when it differs by more
+ 	 * than deadband from the value of the last frame
+ 	 */
+ 	bool PublishOnChange(void* val, COMMUNICATION_SIGNAL_TYPE type, unsigned int canId, unsigned char* txFlag, float deadband, uint32_t inhibit, uint32_t heartbeat = 0);
+
+ 	/* callback(context, val) is called as soon as a frame of canId was
+ 	 * written to val: in the RX interrupt if the manager runs with
+ 	 * RX_INTERRUPT, otherwise (or with CALLBACK_UPDATE) during Update().
+ 	 * Interrupt callbacks have to be short, the loop may see val half
+ 	 * written (see SubscribeSnapshot()).
+ 	 */
+ 	bool Subscribe(void* val, unsigned int bytes, unsigned int canId, COMMUNICATION_CALLBACK callback, void* context, COMMUNICATION_CALLBACK_MODE mode = CALLBACK_INTERRUPT);
+
+ 	/* Same with a function object, (*functor)(val) is called. The functor
+ 	 * is not copied and has to stay valid.
+ 	 */
+ 	template <class FUNCTOR>
+ 	bool Subscribe(void* val, unsigned int bytes, unsigned int canId, FUNCTOR* functor, COMMUNICATION_CALLBACK_MODE mode = CALLBACK_INTERRUPT) {
+ 		return Subscribe(val, bytes, canId, &CallFunctor<FUNCTOR>, (void*)functor, mode);
+ 	}
+
+ 	/* The frame of the producer canId (PublishFrame() or a frame layout) is
+ 	 * packed once and then copied from a cache. The application sets *dirty
+ 	 * to 1 whenever it changed a signal of the frame, the next frame is
+ 	 * packed again and clears it. Fire(canId) always packs the current
+ 	 * values. Values published with Publish() are not cached.
+ 	 */
+ 	bool CacheFrame(unsigned int canId, unsigned char* dirty);
+
+ 	/* Cyclic frame of bytes length which carries the signals added with
+ 	 * PublishSignal(), they are read when the frame is queued. Fire(canId)
+ 	 * sends it at once.
+ 	 */
+ 	bool PublishFrame(unsigned int bytes, unsigned int canId, unsigned char* txFlag, uint32_t cycle, uint32_t phase = COMMUNICATION_PHASE_AUTO);
+
+ 	/* Adds a signal to the frame canId of PublishFrame(), fails if it
+ 	 * exceeds the frame or overlaps another signal
+ 	 */
+ 	bool PublishSignal(void* val, COMMUNICATION_SIGNAL_TYPE type, unsigned int canId, unsigned char startBit, unsigned char length, COMMUNICATION_BYTE_ORDER byteOrder, float factor = 1.0f, float offset = 0.0f);
+
+ 	/* The signal is written to val and rxFlag is set whenever a frame of
+ 	 * canId arrives which is long enough to contain it
+ 	 */
+ 	bool SubscribeSignal(void* val, COMMUNICATION_SIGNAL_TYPE type, unsigned int canId, unsigned char startBit, unsigned char length, COMMUNICATION_BYTE_ORDER byteOrder, unsigned char* rxFlag, float factor = 1.0f, float offset = 0.0f);
+
+ 	/* Frame with a compile time layout (see CommunicationFrame), the struct
+ 	 * is packed by FRAME::PackRef() every time the frame is queued
+ 	 */
+ 	template <class FRAME>
+ 	bool Publish(const typename FRAME::Values* val, unsigned int canId, unsigned char* txFlag, uint32_t cycle, uint32_t phase = COMMUNICATION_PHASE_AUTO) {
+ 		return PublishPacked((void*)val, FRAME::bytes, canId, txFlag, cycle, phase, &FRAME::PackRef);
+ 	}
+
+ 	/* Only frames which contain all fields are unpacked into val */
+ 	template <class FRAME>
+ 	bool Subscribe(typename FRAME::Values* val, unsigned int canId, unsigned char* rxFlag) {
+ 		return SubscribePacked(val, FRAME::bytes, canId, rxFlag, &FRAME::UnpackRef);
+ 	}
+
+ 	/* Like Subscribe() into a seqlock buffer of up to 8 bytes. With
+ 	 * RX_INTERRUPT the RX interrupt writes it as soon as the frame arrived,
+ 	 * otherwise Update(). The generation replaces rxFlag, a difference of
+ 	 * more than 1 between two reads counts the updates missed.
+ 	 */
+ 	bool SubscribeSnapshot(COMMUNICATION_snapshot_t* snapshot, unsigned int bytes, unsigned int canId);
+
+ 	/* Consistent copy of the value without disabling interrupts, returns its
+ 	 * generation (0 until the first frame). Must not be called from an
+ 	 * interrupt which preempts the writer.
+ 	 */
+ 	static inline uint32_t ReadSnapshot(const COMMUNICATION_snapshot_t* snapshot, void* val, unsigned int bytes) {
+ 		uint32_t sequence;
+ 		uint32_t words[2];
+ 		do {
+ 			sequence = snapshot->sequence;
+ 			COMMUNICATION_SNAPSHOT_BARRIER();
+ 			words[0] = snapshot->words[0];
+ 			words[1] = snapshot->words[1];
+ 			COMMUNICATION_SNAPSHOT_BARRIER();
+ 		} while ((sequence & 1) || (sequence != snapshot->sequence));
+
+ 		unsigned char* out = (unsigned char*)val;
+ 		for (unsigned int i = 0; (i < bytes) && (i < 8); i++) {
+ 			out[i] = ((const unsigned char*)words)[i];
+ 		}
+ 		return sequence >> 1;
+ 	}
+
+ 	static inline uint32_t GetGeneration(const COMMUNICATION_snapshot_t* snapshot) {
+ 		return snapshot->sequence >> 1;
+ 	}
+
+ 	/* Every frame of canId is passed to handler during Update(), before
+ 	 * the transmission of that Update() call
+ 	 */
+ 	bool SubscribeFrames(unsigned int canId, COMMUNICATION_FRAME_HANDLER handler, void* context);
+
+ 	/* Copies a frame of len bytes (frame order) into the frame queue, it is
+ 	 * sent by the next Update(). Frames of a Can ID keep their order.
+ 	 */
+ 	bool SendFrame(unsigned int canId, const void* data, unsigned int len);
+
+ 	unsigned int GetFrameQueueSpace();
+
  	void Update();
  };
 
@@ -0,0 +1,108 @@
+/************************************************************************
+ * Static registration tables
+ *
+ * With COMMUNICATION_STATIC_TABLES set to 1 the producers, consumers and
+ * the receive dispatch tables are const data generated at compile time
+ * instead of RAM arrays filled by Publish() / Subscribe() in setup().
+ *
+ *   constexpr COMMUNICATION_producer_t producers[] = {
+ *     COMMUNICATION_PRODUCER(&speed, 2, 0x100, &speedFlag, CYCLE_10, COMMUNICATION_PHASE_AUTO),
+ *     COMMUNICATION_FRAME_PRODUCER(MotorFrame, &motor, 0x120, &motorFlag, CYCLE_20, 0)
+ *   };
+ *   constexpr COMMUNICATION_consumer_t consumers[] = {
+ *     COMMUNICATION_CONSUMER(&target, 2, 0x101, &targetFlag)
+ *   };
+ *   constexpr auto dispatch = CommunicationDispatch(consumers);
+ *   const COMMUNICATION_tables_t tables = COMMUNICATION_TABLES(producers, dispatch);
+ *
+ *   cm->Initialize(tables, 500000);
+ *
+ */
+ #ifndef __COMMUNICATION_TABLES_H__
+ #define __COMMUNICATION_TABLES_H__
+
+ #include "CommunicationManager.h"
+
+ #define COMMUNICATION_PRODUCER(val, bytes, canId, txFlag, cycle, phase) \
+ 	{ val, bytes, COMMUNICATION_NO_SIGNAL, COMMUNICATION_NO_EVENT, nullptr, canId, txFlag, nullptr, cycle, phase }
+
+ /* Compile time frame layout, see CommunicationFrame */
+ #define COMMUNICATION_FRAME_PRODUCER(FRAME, val, canId, txFlag, cycle, phase) \
+ 	{ val, FRAME::bytes, COMMUNICATION_NO_SIGNAL, COMMUNICATION_NO_EVENT, &FRAME::PackRef, canId, txFlag, nullptr, cycle, phase }
+
+ /* Sent from a cache which is packed again while *dirty is set, see
+  * CommunicationManager::CacheFrame()
+  */
+ #define COMMUNICATION_CACHED_FRAME_PRODUCER(FRAME, val, canId, txFlag, dirty, cycle, phase) \
+ 	{ val, FRAME::bytes, COMMUNICATION_NO_SIGNAL, COMMUNICATION_NO_EVENT, &FRAME::PackRef, canId, txFlag, dirty, cycle, phase }
+
+ #define COMMUNICATION_CONSUMER(val, bytes, canId, rxFlag) \
+ 	{ val, bytes, COMMUNICATION_NO_SIGNAL, COMMUNICATION_NO_CONSUMER, false, false, nullptr, canId, rxFlag, nullptr, nullptr, nullptr }
+
+ #define COMMUNICATION_FRAME_CONSUMER(FRAME, val, canId, rxFlag) \
+ 	{ val, FRAME::bytes, COMMUNICATION_NO_SIGNAL, COMMUNICATION_NO_CONSUMER, false, false, &FRAME::UnpackRef, canId, rxFlag, nullptr, nullptr, nullptr }
+
+ /* Seqlock buffer, see CommunicationManager::SubscribeSnapshot() */
+ #define COMMUNICATION_SNAPSHOT_CONSUMER(snapshot, bytes, canId) \
+ 	{ snapshot, bytes, COMMUNICATION_NO_SIGNAL, COMMUNICATION_NO_CONSUMER, true, true, nullptr, canId, nullptr, nullptr, nullptr, nullptr }
+
+ /* mode is CALLBACK_INTERRUPT (the default of Subscribe()) or CALLBACK_UPDATE */
+ #define COMMUNICATION_CALLBACK_CONSUMER(val, bytes, canId, callback, context, mode) \
+ 	{ val, bytes, COMMUNICATION_NO_SIGNAL, COMMUNICATION_NO_CONSUMER, false, (CALLBACK_INTERRUPT == mode), nullptr, canId, nullptr, nullptr, context, callback }
+
+ #define COMMUNICATION_FRAME_HANDLER_CONSUMER(canId, handler, context) \
+ 	{ nullptr, 8, COMMUNICATION_NO_SIGNAL, COMMUNICATION_NO_CONSUMER, false, false, nullptr, canId, nullptr, handler, context, nullptr }
+
+ #define COMMUNICATION_TABLES(producers, dispatch) \
+ 	{ producers, sizeof(producers) / sizeof(producers[0]), dispatch.consumers, sizeof(dispatch.consumers) / sizeof(dispatch.consumers[0]), dispatch.stdDispatch, dispatch.extDispatch }
+
+ /* Consumers with their dispatch chains and the dispatch tables, the same
+  * content AddConsumer() builds at runtime
+  */
+ template <unsigned int N>
+ struct COMMUNICATION_dispatchTables_t {
+ 	COMMUNICATION_consumer_t consumers[N];
+ 	unsigned char stdDispatch[COMMUNICATION_STD_IDS];
+ 	COMMUNICATION_dispatchEntry_t extDispatch[COMMUNICATION_EXT_DISPATCH_SIZE];
+ };
+
+ template <unsigned int N>
+ constexpr COMMUNICATION_dispatchTables_t<N> CommunicationDispatch(const COMMUNICATION_consumer_t (&consumers)[N]) {
+ 	static_assert(N < COMMUNICATION_NO_CONSUMER, "Too many consumers for the dispatch table index");
+
+ 	COMMUNICATION_dispatchTables_t<N> tables = {};
+ 	for (unsigned int i = 0; i < COMMUNICATION_STD_IDS; i++) {
+ 		tables.stdDispatch[i] = COMMUNICATION_NO_CONSUMER;
+ 	}
+ 	for (unsigned int i = 0; i < COMMUNICATION_EXT_DISPATCH_SIZE; i++) {
+ 		tables.extDispatch[i].canId = 0;
+ 		tables.extDispatch[i].first = COMMUNICATION_NO_CONSUMER;
+ 	}
+
+ 	for (unsigned int i = 0; i < N; i++) {
+ 		tables.consumers[i] = consumers[i];
+ 		tables.consumers[i].next = COMMUNICATION_NO_CONSUMER;
+
+ 		uint32_t canId = consumers[i].canId;
+ 		unsigned char* slot = nullptr;
+ 		if (canId < COMMUNICATION_STD_IDS) {
+ 			slot = &tables.stdDispatch[canId];
+ 		}
+ 		else {
+ 			/* A full table is not a constant expression */
+ 			COMMUNICATION_dispatchEntry_t* entry = COMMUNICATION_extDispatchEntry(tables.extDispatch, canId);
+ 			entry->canId = canId;
+ 			slot = &entry->first;
+ 		}
+
+ 		/* Append to the consumers of this Can ID, keeps table order */
+ 		while (COMMUNICATION_NO_CONSUMER != *slot) {
+ 			slot = &tables.consumers[*slot].next;
+ 		}
+ 		*slot = i;
+ 	}
+
+ 	return tables;
+ }
+
+ #endif
@@ -0,0 +1,446 @@
+/************************************************************************
+ * CommunicationTransport implementation
+ *
+ */
+#ifndef COMMUNICATION_TEST_ENV
+#include "Arduino.h"
+#endif
+#include "CommunicationTransport.h"
+#include <string.h>
+
+#define COMMUNICATION_TP_NO_FLOW_STATUS 0xFF
+
+CommunicationTransport::CommunicationTransport() {
+	cm = nullptr;
+	txId = 0;
+	rxId = 0;
+	blockSize = 0;
+	stMin = 0;
+	txStatus = TP_IDLE;
+	txData = nullptr;
+	txSource = nullptr;
+	txContext = nullptr;
+	txLength = 0;
+	txOffset = 0;
+	txSequence = 0;
+	txWaitFlowControl = false;
+	txBlockSize = 0;
+	txBlockLeft = 0;
+	txWaits = 0;
+	txSeparation = 0;
+	txNext = 0;
+	txDeadline = 0;
+	rxStatus = TP_IDLE;
+	rxBuffer = nullptr;
+	rxSize = 0;
+	rxFlag = nullptr;
+	rxSink = nullptr;
+	rxContext = nullptr;
+	rxLength = 0;
+	rxOffset = 0;
+	rxSequence = 0;
+	rxBlockLeft = 0;
+	rxDeadline = 0;
+	rxFlowStatus = COMMUNICATION_TP_NO_FLOW_STATUS;
+}
+
+bool CommunicationTransport::Begin(unsigned int txId, unsigned int rxId, unsigned char blockSize, unsigned char stMin) {
+	if ((txId >= COMMUNICATION_STD_IDS) || (rxId >= COMMUNICATION_STD_IDS)) {
+		COMMUNICATION_DEBUG_PRINT("[");
+		COMMUNICATION_DEBUG_PRINT(millis(), DEC);
+		COMMUNICATION_DEBUG_PRINT("] CommunicationTransport: Failed to begin with Can Id ");
+		COMMUNICATION_DEBUG_PRINT(txId, HEX);
+		COMMUNICATION_DEBUG_PRINT(" / ");
+		COMMUNICATION_DEBUG_PRINT(rxId, HEX);
+		COMMUNICATION_DEBUG_PRINTLN(", Can ID exceeds 11 bit!");
+
+		/* Failed: Normal addressing with standard identifiers only */
+		return false;
+	}
+
+	CommunicationManager* manager = CommunicationManager::GetInstance();
+	if (!manager->SubscribeFrames(rxId, FrameHandler, this)) {
+		/* Failed: to many subscribers */
+		return false;
+	}
+
+	cm = manager;
+	this->txId = txId;
+	this->rxId = rxId;
+	this->blockSize = blockSize;
+	this->stMin = stMin;
+
+	/* Success */
+	return true;
+}
+
+bool CommunicationTransport::Send(const void* data, unsigned int length) {
+	if (TP_BUSY == txStatus) {
+		/* Failed: Transfer in progress */
+		return false;
+	}
+
+	txData = (const unsigned char*)data;
+	txSource = nullptr;
+	txContext = nullptr;
+	return Start(length);
+}
+
+bool CommunicationTransport::Send(unsigned int length, COMMUNICATION_TP_SOURCE source, void* context) {
+	if (TP_BUSY == txStatus) {
+		/* Failed: Transfer in progress */
+		return false;
+	}
+
+	txData = nullptr;
+	txSource = source;
+	txContext = context;
+	return Start(length);
+}
+
+bool CommunicationTransport::Start(uint32_t length) {
+	if (nullptr == cm) {
+		COMMUNICATION_DEBUG_PRINT("[");
+		COMMUNICATION_DEBUG_PRINT(millis(), DEC);
+		COMMUNICATION_DEBUG_PRINTLN("] CommunicationTransport: in Send() Begin() was not called!");
+
+		/* Failed: No identifiers */
+		return false;
+	}
+
+	if ((0 == length) || (length > COMMUNICATION_TP_MAX_LENGTH)) {
+		COMMUNICATION_DEBUG_PRINT("[");
+		COMMUNICATION_DEBUG_PRINT(millis(), DEC);
+		COMMUNICATION_DEBUG_PRINT("] CommunicationTransport: in Send() length ");
+		COMMUNICATION_DEBUG_PRINT(length, DEC);
+		COMMUNICATION_DEBUG_PRINTLN(" out of range!");
+
+		/* Failed: Length does not fit into the first frame */
+		return false;
+	}
+
+	txLength = length;
+	txOffset = 0;
+
+	if (length <= 7) {
+		if (!SendSegment(COMMUNICATION_TP_SINGLE | length, nullptr, 0, length)) {
+			/* Failed: Frame queue full or source failed */
+			return false;
+		}
+		txStatus = TP_DONE;
+
+		/* Success */
+		return true;
+	}
+
+	unsigned char header = length & 0xFF;
+	if (!SendSegment(COMMUNICATION_TP_FIRST | (length >> 8), &header, 1, 6)) {
+		/* Failed: Frame queue full or source failed */
+		return false;
+	}
+
+	txStatus = TP_BUSY;
+	txSequence = 1;
+	txWaits = 0;
+	txWaitFlowControl = true;
+	txDeadline = micros() + COMMUNICATION_TP_TIMEOUT_MICROS;
+
+	/* Success */
+	return true;
+}
+
+bool CommunicationTransport::SendSegment(unsigned char pci, const unsigned char* header, unsigned int headerBytes, unsigned int bytes) {
+	if (0 == cm->GetFrameQueueSpace()) {
+		/* Failed: Frame queue full, try again later */
+		return false;
+	}
+
+	unsigned char frame[8];
+	memset(frame, COMMUNICATION_TP_PADDING, sizeof(frame));
+	frame[0] = pci;
+	memcpy(&frame[1], header, headerBytes);
+
+	unsigned char* out = &frame[1 + headerBytes];
+	if (txSource) {
+		if (!txSource(txContext, txOffset, out, bytes)) {
+			txStatus = TP_ERROR_ABORTED;
+
+			/* Failed: Source gave up */
+			return false;
+		}
+	}
+	else {
+		memcpy(out, txData + txOffset, bytes);
+	}
+
+	cm->SendFrame(txId, frame, sizeof(frame));
+	txOffset += bytes;
+
+	/* Success */
+	return true;
+}
+
+bool CommunicationTransport::SendFlowControl(unsigned char flowStatus) {
+	unsigned char frame[8];
+	memset(frame, COMMUNICATION_TP_PADDING, sizeof(frame));
+	frame[0] = COMMUNICATION_TP_FLOW_CONTROL | flowStatus;
+	frame[1] = blockSize;
+	frame[2] = stMin;
+
+	return cm->SendFrame(txId, frame, sizeof(frame));
+}
+
+void CommunicationTransport::SetReceiveBuffer(void* buffer, unsigned int size, unsigned char* rxFlag) {
+	rxBuffer = (unsigned char*)buffer;
+	rxSize = size;
+	this->rxFlag = rxFlag;
+	*rxFlag = 0;
+	rxSink = nullptr;
+	rxContext = nullptr;
+}
+
+void CommunicationTransport::SetReceiveSink(COMMUNICATION_TP_SINK sink, void* context) {
+	rxSink = sink;
+	rxContext = context;
+}
+
+COMMUNICATION_TP_STATUS CommunicationTransport::GetTxStatus() {
+	return txStatus;
+}
+
+COMMUNICATION_TP_STATUS CommunicationTransport::GetRxStatus() {
+	return rxStatus;
+}
+
+uint32_t CommunicationTransport::GetRxLength() {
+	return rxLength;
+}
+
+void CommunicationTransport::Update() {
+	if (nullptr == cm) {
+		return;
+	}
+
+	uint32_t now = micros();
+
+	// Flow control which did not fit into the frame queue
+	if ((COMMUNICATION_TP_NO_FLOW_STATUS != rxFlowStatus) && SendFlowControl(rxFlowStatus)) {
+		rxFlowStatus = COMMUNICATION_TP_NO_FLOW_STATUS;
+	}
+
+	if ((TP_BUSY == rxStatus) && ((int32_t)(now - rxDeadline) >= 0)) {
+		rxStatus = TP_ERROR_TIMEOUT;
+	}
+
+	if (TP_BUSY != txStatus) {
+		return;
+	}
+
+	if (txWaitFlowControl) {
+		if ((int32_t)(now - txDeadline) >= 0) {
+			txStatus = TP_ERROR_TIMEOUT;
+		}
+		return;
+	}
+
+	// Consecutive frames while the block and the frame queue allow
+	while ((txOffset < txLength) && ((int32_t)(now - txNext) >= 0)) {
+		unsigned int bytes = txLength - txOffset;
+		if (bytes > 7) {
+			bytes = 7;
+		}
+
+		if (!SendSegment(COMMUNICATION_TP_CONSECUTIVE | txSequence, nullptr, 0, bytes)) {
+			break;
+		}
+		txSequence = (txSequence + 1) & 0x0F;
+		txNext = now + txSeparation;
+
+		if ((txBlockSize > 0) && (0 == --txBlockLeft) && (txOffset < txLength)) {
+			// Block complete, the receiver grants the next one
+			txWaitFlowControl = true;
+			txDeadline = now + COMMUNICATION_TP_TIMEOUT_MICROS;
+			break;
+		}
+		if (txSeparation > 0) {
+			break;
+		}
+	}
+
+	if ((TP_BUSY == txStatus) && (txOffset >= txLength)) {
+		txStatus = TP_DONE;
+	}
+}
+
+void CommunicationTransport::FrameHandler(void* context, uint32_t canId, const unsigned char* data, unsigned int len) {
+	(void)canId;
+	((CommunicationTransport*)context)->HandleFrame(data, len);
+}
+
+void CommunicationTransport::HandleFrame(const unsigned char* data, unsigned int len) {
+	if (0 == len) {
+		return;
+	}
+
+	switch (data[0] & 0xF0) {
+		case COMMUNICATION_TP_SINGLE: {
+			/* A new message ends the one in progress */
+			unsigned int length = data[0] & 0x0F;
+			if ((0 == length) || (length + 1 > len)) {
+				return;
+			}
+
+			rxLength = length;
+			rxOffset = 0;
+			if (!Deliver(&data[1], length)) {
+				rxStatus = TP_ERROR_OVERFLOW;
+				return;
+			}
+			rxStatus = TP_DONE;
+			if (rxFlag && !rxSink) {
+				*rxFlag = 1;
+			}
+			break;
+		}
+
+		case COMMUNICATION_TP_FIRST: {
+			uint32_t length = ((data[0] & 0x0F) << 8) | ((len > 1) ? data[1] : 0);
+			if ((len < 8) || (length < 8)) {
+				return;
+			}
+
+			rxLength = length;
+			rxOffset = 0;
+			if (!Deliver(&data[2], 6)) {
+				rxStatus = TP_ERROR_OVERFLOW;
+				rxFlowStatus = COMMUNICATION_TP_OVERFLOW;
+			}
+			else {
+				rxStatus = TP_BUSY;
+				rxSequence = 1;
+				rxBlockLeft = blockSize;
+				rxDeadline = micros() + COMMUNICATION_TP_TIMEOUT_MICROS;
+				rxFlowStatus = COMMUNICATION_TP_CTS;
+			}
+
+			/* Usually goes out with the current Update() */
+			if (SendFlowControl(rxFlowStatus)) {
+				rxFlowStatus = COMMUNICATION_TP_NO_FLOW_STATUS;
+			}
+			break;
+		}
+
+		case COMMUNICATION_TP_CONSECUTIVE: {
+			if (TP_BUSY != rxStatus) {
+				return;
+			}
+			if ((data[0] & 0x0F) != rxSequence) {
+				rxStatus = TP_ERROR_SEQUENCE;
+				return;
+			}
+
+			unsigned int bytes = rxLength - rxOffset;
+			if (bytes > 7) {
+				bytes = 7;
+			}
+			if ((bytes + 1 > len) || !Deliver(&data[1], bytes)) {
+				rxStatus = TP_ERROR_ABORTED;
+				return;
+			}
+			rxSequence = (rxSequence + 1) & 0x0F;
+			rxDeadline = micros() + COMMUNICATION_TP_TIMEOUT_MICROS;
+
+			if (rxOffset >= rxLength) {
+				rxStatus = TP_DONE;
+				if (rxFlag && !rxSink) {
+					*rxFlag = 1;
+				}
+			}
+			else if ((blockSize > 0) && (0 == --rxBlockLeft)) {
+				rxBlockLeft = blockSize;
+				rxFlowStatus = COMMUNICATION_TP_CTS;
+				if (SendFlowControl(rxFlowStatus)) {
+					rxFlowStatus = COMMUNICATION_TP_NO_FLOW_STATUS;
+				}
+			}
+			break;
+		}
+
+		case COMMUNICATION_TP_FLOW_CONTROL:
+			HandleFlowControl(data, len);
+			break;
+
+		default:
+			/* Unknown frame type is ignored */
+			break;
+	}
+}
+
+void CommunicationTransport::HandleFlowControl(const unsigned char* data, unsigned int len) {
+	if ((TP_BUSY != txStatus) || !txWaitFlowControl || (len < 3)) {
+		return;
+	}
+
+	switch (data[0] & 0x0F) {
+		case COMMUNICATION_TP_CTS:
+			txWaitFlowControl = false;
+			txBlockSize = data[1];
+			txBlockLeft = data[1];
+			txSeparation = SeparationMicros(data[2]);
+			txWaits = 0;
+			txNext = micros();
+			break;
+
+		case COMMUNICATION_TP_WAIT:
+			txWaits += 1;
+			if (txWaits > COMMUNICATION_TP_MAX_WAIT) {
+				txStatus = TP_ERROR_ABORTED;
+			}
+			else {
+				txDeadline = micros() + COMMUNICATION_TP_TIMEOUT_MICROS;
+			}
+			break;
+
+		case COMMUNICATION_TP_OVERFLOW:
+			txStatus = TP_ERROR_OVERFLOW;
+			break;
+
+		default:
+			/* Invalid flow status */
+			txStatus = TP_ERROR_ABORTED;
+			break;
+	}
+}
+
+bool CommunicationTransport::Deliver(const unsigned char* data, unsigned int bytes) {
+	if (rxSink) {
+		if (!rxSink(rxContext, rxLength, rxOffset, data, bytes)) {
+			/* Failed: Sink rejected the message */
+			return false;
+		}
+	}
+	else {
+		if (!rxBuffer || (rxLength > rxSize)) {
+			/* Failed: Message does not fit */
+			return false;
+		}
+		memcpy(rxBuffer + rxOffset, data, bytes);
+	}
+
+	rxOffset += bytes;
+
+	/* Success */
+	return true;
+}
+
+uint32_t CommunicationTransport::SeparationMicros(unsigned char stMin) {
+	if (stMin <= 0x7F) {
+		return stMin * 1000UL;
+	}
+	if ((stMin >= 0xF1) && (stMin <= 0xF9)) {
+		return (stMin - 0xF0) * 100UL;
+	}
+
+	/* Reserved values stand for the longest separation time */
+	return 127000UL;
+}
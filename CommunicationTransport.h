@@ -0,0 +1,147 @@
+/************************************************************************
+ * CommunicationTransport class
+ *
+ * ISO 15765-2 (ISO-TP) style segmentation of payloads up to 4095 bytes on
+ * top of the CommunicationManager: single frame, first frame, consecutive
+ * frames and flow control with block size and separation time, normal
+ * addressing with 11 bit identifiers. Every frame is padded to 8 bytes.
+ *
+ */
+ #ifndef __COMMUNICATION_TRANSPORT_H__
+ #define __COMMUNICATION_TRANSPORT_H__
+
+ #include "CommunicationManager.h"
+
+ #define COMMUNICATION_TP_MAX_LENGTH 4095
+ #define COMMUNICATION_TP_PADDING 0xCC
+
+ /* N_Bs (flow control expected) and N_Cr (consecutive frame expected) */
+ #define COMMUNICATION_TP_TIMEOUT_MICROS 1000000UL
+ /* Flow control WAIT frames accepted in a row (N_WFTmax) */
+ #define COMMUNICATION_TP_MAX_WAIT 8
+
+ /* Protocol control information, upper nibble of byte 0 */
+ #define COMMUNICATION_TP_SINGLE 0x00
+ #define COMMUNICATION_TP_FIRST 0x10
+ #define COMMUNICATION_TP_CONSECUTIVE 0x20
+ #define COMMUNICATION_TP_FLOW_CONTROL 0x30
+
+ /* Flow status, lower nibble of a flow control frame */
+ #define COMMUNICATION_TP_CTS 0x00
+ #define COMMUNICATION_TP_WAIT 0x01
+ #define COMMUNICATION_TP_OVERFLOW 0x02
+
+ enum COMMUNICATION_TP_STATUS {
+ 	TP_IDLE,
+ 	TP_BUSY,
+ 	TP_DONE,
+ 	TP_ERROR_TIMEOUT,
+ 	TP_ERROR_OVERFLOW,
+ 	TP_ERROR_SEQUENCE,
+ 	TP_ERROR_ABORTED
+ };
+
+ /* Streaming send: copies bytes of the message starting at offset into out,
+  * false aborts the transfer.
+  */
+ typedef bool (*COMMUNICATION_TP_SOURCE)(void* context, uint32_t offset, unsigned char* out, unsigned int bytes);
+
+ /* Streaming receive: called with the data of every frame in order. The
+  * call with offset 0 starts a message of length bytes, false rejects it
+  * (flow control overflow) or aborts it later on.
+  */
+ typedef bool (*COMMUNICATION_TP_SINK)(void* context, uint32_t length, uint32_t offset, const unsigned char* data, unsigned int bytes);
+
+ class CommunicationTransport {
+ #ifdef COMMUNICATION_TEST_ENV
+ 	friend class CommunicationBenchmark;
+ #endif
+
+ private:
+ 	CommunicationManager* cm;
+
+ 	unsigned int txId;
+ 	unsigned int rxId;
+ 	unsigned char blockSize;
+ 	unsigned char stMin;
+
+ 	/* Sender */
+ 	COMMUNICATION_TP_STATUS txStatus;
+ 	const unsigned char* txData;
+ 	COMMUNICATION_TP_SOURCE txSource;
+ 	void* txContext;
+ 	uint32_t txLength;
+ 	uint32_t txOffset;
+ 	unsigned char txSequence;
+ 	bool txWaitFlowControl;
+ 	unsigned char txBlockSize;
+ 	unsigned char txBlockLeft;
+ 	unsigned char txWaits;
+ 	uint32_t txSeparation;
+ 	uint32_t txNext;
+ 	uint32_t txDeadline;
+
+ 	/* Receiver, into rxBuffer unless there is a sink */
+ 	COMMUNICATION_TP_STATUS rxStatus;
+ 	unsigned char* rxBuffer;
+ 	unsigned int rxSize;
+ 	unsigned char* rxFlag;
+ 	COMMUNICATION_TP_SINK rxSink;
+ 	void* rxContext;
+ 	uint32_t rxLength;
+ 	uint32_t rxOffset;
+ 	unsigned char rxSequence;
+ 	unsigned char rxBlockLeft;
+ 	uint32_t rxDeadline;
+ 	/* Flow status still to be sent, 0xFF if none */
+ 	unsigned char rxFlowStatus;
+
+ 	bool Start(uint32_t length);
+ 	bool SendSegment(unsigned char pci, const unsigned char* header, unsigned int headerBytes, unsigned int bytes);
+ 	bool SendFlowControl(unsigned char flowStatus);
+
+ 	void HandleFrame(const unsigned char* data, unsigned int len);
+ 	void HandleFlowControl(const unsigned char* data, unsigned int len);
+ 	bool Deliver(const unsigned char* data, unsigned int bytes);
+
+ 	static void FrameHandler(void* context, uint32_t canId, const unsigned char* data, unsigned int len);
+ 	static uint32_t SeparationMicros(unsigned char stMin);
+
+ public:
+ 	CommunicationTransport();
+
+ 	/* Sends on txId and receives on rxId. blockSize (0 = no limit) and
+ 	 * stMin (0x00..0x7F ms, 0xF1..0xF9 100..900 us) are granted to the
+ 	 * peer in the flow control frames.
+ 	 */
+ 	bool Begin(unsigned int txId, unsigned int rxId, unsigned char blockSize = 8, unsigned char stMin = 0);
+
+ 	/* The data is read while it is sent and must stay valid until the
+ 	 * transfer is finished
+ 	 */
+ 	bool Send(const void* data, unsigned int length);
+
+ 	bool Send(unsigned int length, COMMUNICATION_TP_SOURCE source, void* context);
+
+ 	/* Received messages are copied into buffer, rxFlag is set when one is
+ 	 * complete. Longer messages are rejected.
+ 	 */
+ 	void SetReceiveBuffer(void* buffer, unsigned int size, unsigned char* rxFlag);
+
+ 	/* Received messages are passed to sink frame by frame instead */
+ 	void SetReceiveSink(COMMUNICATION_TP_SINK sink, void* context);
+
+ 	COMMUNICATION_TP_STATUS GetTxStatus();
+
+ 	COMMUNICATION_TP_STATUS GetRxStatus();
+
+ 	/* Length of the message received last / being received */
+ 	uint32_t GetRxLength();
+
+ 	/* Timeouts, consecutive frames and pending flow control, call after
+ 	 * CommunicationManager::Update()
+ 	 */
+ 	void Update();
+ };
+
+ #endif
@@ -8,11 +8,13 @@
 
 static const int txb = 8; // with default settings, all buffers before this are consumed by the FIFO
 static const int txBuffers = 8;
+static const int txReserved = txb; // kept free for writeReserved() once reserved, wins ties with equal identifiers
 static const int rxb = 0;
 
 #define FLEXCANb_MCR(b)                   (*(vuint32_t*)(b))
 #define FLEXCANb_CTRL1(b)                 (*(vuint32_t*)(b+4))
 #define FLEXCANb_RXMGMASK(b)              (*(vuint32_t*)(b+0x10))
+#define FLEXCANb_IMASK1(b)                (*(vuint32_t*)(b+0x28))
 #define FLEXCANb_IFLAG1(b)                (*(vuint32_t*)(b+0x30))
 #define FLEXCANb_RXFGMASK(b)              (*(vuint32_t*)(b+0x48))
 #define FLEXCANb_MBn_CS(b, n)             (*(vuint32_t*)(b+0x80+n*0x10))
@@ -20,11 +22,15 @@ static const int rxb = 0;
 #define FLEXCANb_MBn_WORD0(b, n)          (*(vuint32_t*)(b+0x88+n*0x10))
 #define FLEXCANb_MBn_WORD1(b, n)          (*(vuint32_t*)(b+0x8C+n*0x10))
 #define FLEXCANb_IDFLT_TAB(b, n)          (*(vuint32_t*)(b+0xE0+(n*4)))
+#define FLEXCANb_RXIMR(b, n)              (*(vuint32_t*)(b+0x880+(n*4)))
+
+static void (*rxHandler[2])(void) = { 0, 0 };
 
 // -------------------------------------------------------------
 FlexCAN::FlexCAN(uint32_t baud, uint8_t id, uint8_t txAlt, uint8_t rxAlt)
 {
   flexcanBase = FLEXCAN0_BASE;
+  txFirst = txb;
 #ifdef __MK66FX1M0__
   if(id > 0) flexcanBase = FLEXCAN1_BASE;
 #endif
@@ -77,6 +83,9 @@ FlexCAN::FlexCAN(uint32_t baud, uint8_t id, uint8_t txAlt, uint8_t rxAlt)
   // disable self-reception
   FLEXCANb_MCR(flexcanBase) |= FLEXCAN_MCR_SRX_DIS;
 
+  // allow pending transmissions to be aborted, see preempt()
+  FLEXCANb_MCR(flexcanBase) |= FLEXCAN_MCR_AEN;
+
   //enable RX FIFO
   FLEXCANb_MCR(flexcanBase) |= FLEXCAN_MCR_FEN;
 
@@ -101,6 +110,11 @@ FlexCAN::FlexCAN(uint32_t baud, uint8_t id, uint8_t txAlt, uint8_t rxAlt)
                                 | FLEXCAN_CTRL_PSEG1(7) | FLEXCAN_CTRL_PSEG2(3) | FLEXCAN_CTRL_PRESDIV(7));
   }
 
+  // CTRL1 leaves LBUF = 0, the pending buffer with the lowest identifier
+  // goes first. the local priority field only decides between equal
+  // identifiers (reserved buffer, see transmit())
+  FLEXCANb_MCR(flexcanBase) |= FLEXCAN_MCR_LPRIO_EN;
+
   // Default mask is allow everything
   defaultMask.rtr = 0;
   defaultMask.ext = 0;
@@ -158,6 +172,46 @@ void FlexCAN::setFilter(const CAN_filter_t &filter, uint8_t n)
 }
 
 
+// -------------------------------------------------------------
+void FlexCAN::setFilters(const CAN_filter_t *filters, const uint32_t *masks, uint8_t n)
+{
+  // filter table and individual masks are only writable in freeze mode
+  FLEXCANb_MCR(flexcanBase) |= (FLEXCAN_MCR_FRZ | FLEXCAN_MCR_HALT);
+  while(!(FLEXCANb_MCR(flexcanBase) & FLEXCAN_MCR_FRZ_ACK))
+    ;
+
+  // every filter element uses its own mask register
+  FLEXCANb_MCR(flexcanBase) |= FLEXCAN_MCR_IRMQ;
+
+  for (uint8_t i = 0; i < 8; i++) {
+    if ( 0 == n ) {
+      // only remote frames with id 0 pass
+      FLEXCANb_IDFLT_TAB(flexcanBase, i) = (1UL << 31);
+      FLEXCANb_RXIMR(flexcanBase, i) = 0xFFFFFFFF;
+      continue;
+    }
+
+    const CAN_filter_t &filter = filters[(i < n) ? i : (n - 1)];
+    uint32_t mask = masks[(i < n) ? i : (n - 1)];
+
+    if (filter.ext) {
+      FLEXCANb_IDFLT_TAB(flexcanBase, i) = ((filter.rtr?1:0) << 31) | (1UL << 30) | ((filter.id & FLEXCAN_MB_ID_EXT_MASK) << 1);
+      FLEXCANb_RXIMR(flexcanBase, i) = (1UL << 30) | ((mask & FLEXCAN_MB_ID_EXT_MASK) << 1);
+    } else {
+      FLEXCANb_IDFLT_TAB(flexcanBase, i) = ((filter.rtr?1:0) << 31) | (FLEXCAN_MB_ID_IDSTD(filter.id) << 1);
+      FLEXCANb_RXIMR(flexcanBase, i) = (1UL << 30) | (FLEXCAN_MB_ID_IDSTD(mask) << 1);
+    }
+  }
+
+  // leave freeze mode
+  FLEXCANb_MCR(flexcanBase) &= ~(FLEXCAN_MCR_HALT);
+  while(FLEXCANb_MCR(flexcanBase) & FLEXCAN_MCR_FRZ_ACK)
+    ;
+  while(FLEXCANb_MCR(flexcanBase) & FLEXCAN_MCR_NOT_RDY)
+    ;
+}
+
+
 // -------------------------------------------------------------
 int FlexCAN::available(void)
 {
@@ -181,44 +235,78 @@ int FlexCAN::read(CAN_message_t &msg)
     yield();
   }
 
-  // get identifier and dlc
-  msg.len = FLEXCAN_get_length(FLEXCANb_MBn_CS(flexcanBase, rxb));
-  msg.ext = (FLEXCANb_MBn_CS(flexcanBase, rxb) & FLEXCAN_MB_CS_IDE)? 1:0;
-  msg.id  = (FLEXCANb_MBn_ID(flexcanBase, rxb) & FLEXCAN_MB_ID_EXT_MASK);
-  if(!msg.ext) {
-    msg.id >>= FLEXCAN_MB_ID_STD_BIT_NO;
-  }
+  uint32_t words[2];
+  readWords(msg.id, msg.ext, msg.len, words);
 
   // copy out message
-  uint32_t dataIn = FLEXCANb_MBn_WORD0(flexcanBase, rxb);
-  msg.buf[3] = dataIn;
-  dataIn >>=8;
-  msg.buf[2] = dataIn;
-  dataIn >>=8;
-  msg.buf[1] = dataIn;
-  dataIn >>=8;
-  msg.buf[0] = dataIn;
-  if ( 4 < msg.len ) {
-    dataIn = FLEXCANb_MBn_WORD1(flexcanBase, rxb);
-    msg.buf[7] = dataIn;
-    dataIn >>=8;
-    msg.buf[6] = dataIn;
-    dataIn >>=8;
-    msg.buf[5] = dataIn;
-    dataIn >>=8;
-    msg.buf[4] = dataIn;
-  }
-  for( int loop=msg.len; loop<8; ++loop ) {
-    msg.buf[loop] = 0;
+  for( int loop=0; loop<8; ++loop ) {
+    msg.buf[loop] = words[loop >> 2] >> (24 - 8 * (loop & 3));
   }
 
-  //notify FIFO that message has been read
-  FLEXCANb_IFLAG1(flexcanBase) = FLEXCAN_IMASK1_BUF5M;
+  return 1;
+}
+
+
+// -------------------------------------------------------------
+int FlexCAN::readWords(uint32_t &id, uint8_t &ext, uint8_t &len, uint32_t *words)
+{
+  if ( !peek(id, ext, len) ) {
+    return 0;
+  }
+
+  // copy out message, clear the bytes beyond the length
+  words[0] = FLEXCANb_MBn_WORD0(flexcanBase, rxb);
+  words[1] = 0;
+  if ( 4 < len ) {
+    words[1] = FLEXCANb_MBn_WORD1(flexcanBase, rxb);
+    if ( 8 > len ) {
+      words[1] &= ~(0xFFFFFFFFUL >> (8 * (len - 4)));
+    }
+  } else if ( 4 > len ) {
+    words[0] = len ? (words[0] & ~(0xFFFFFFFFUL >> (8 * len))) : 0;
+  }
+
+  release();
+
+  return 1;
+}
+
+
+// -------------------------------------------------------------
+int FlexCAN::peek(uint32_t &id, uint8_t &ext, uint8_t &len)
+{
+  if ( !available() ) {
+    return 0;
+  }
+
+  // get identifier and dlc
+  len = FLEXCAN_get_length(FLEXCANb_MBn_CS(flexcanBase, rxb));
+  ext = (FLEXCANb_MBn_CS(flexcanBase, rxb) & FLEXCAN_MB_CS_IDE)? 1:0;
+  id  = (FLEXCANb_MBn_ID(flexcanBase, rxb) & FLEXCAN_MB_ID_EXT_MASK);
+  if(!ext) {
+    id >>= FLEXCAN_MB_ID_STD_BIT_NO;
+  }
 
   return 1;
 }
 
 
+// -------------------------------------------------------------
+const volatile uint32_t* FlexCAN::peekWords(void)
+{
+  // WORD1 directly follows WORD0 in the message buffer
+  return &FLEXCANb_MBn_WORD0(flexcanBase, rxb);
+}
+
+
+// -------------------------------------------------------------
+void FlexCAN::release(void)
+{
+  //notify FIFO that message has been read
+  FLEXCANb_IFLAG1(flexcanBase) = FLEXCAN_IMASK1_BUF5M;
+}
+
+
 // -------------------------------------------------------------
 int FlexCAN::write(const CAN_message_t &msg)
 {
@@ -226,9 +314,9 @@ int FlexCAN::write(const CAN_message_t &msg)
 
   startMillis = msg.timeout? millis() : 0;
 
-  // find an available buffer
+  // find an available buffer, the reserved one is left alone
   int buffer = -1;
-  for ( int index = txb; ; ) {
+  for ( int index = txFirst; ; ) {
     if ((FLEXCANb_MBn_CS(flexcanBase, index) & FLEXCAN_MB_CS_CODE_MASK) == FLEXCAN_MB_CS_CODE(FLEXCAN_MB_CODE_TX_INACTIVE)) {
       buffer = index;
       break;// found one
@@ -247,21 +335,218 @@ int FlexCAN::write(const CAN_message_t &msg)
   }
 
   // transmit the frame
+  transmit(buffer, msg.id, msg.ext, msg.len,
+           (msg.buf[0]<<24)|(msg.buf[1]<<16)|(msg.buf[2]<<8)|msg.buf[3],
+           (msg.buf[4]<<24)|(msg.buf[5]<<16)|(msg.buf[6]<<8)|msg.buf[7]);
+
+  return 1;
+}
+
+
+// -------------------------------------------------------------
+int FlexCAN::writeWords(uint32_t id, uint8_t ext, uint8_t len, const uint32_t *words, int first)
+{
+  // find an available buffer, the reserved one is left alone
+  int index = (first > txFirst) ? first : txFirst;
+  for ( ; index < (txb+txBuffers); ++index ) {
+    if ((FLEXCANb_MBn_CS(flexcanBase, index) & FLEXCAN_MB_CS_CODE_MASK) == FLEXCAN_MB_CS_CODE(FLEXCAN_MB_CODE_TX_INACTIVE)) {
+      transmit(index, id, ext, len, words[0], words[1]);
+      return index;
+    }
+  }
+
+  return -1;// no buffers available
+}
+
+
+// -------------------------------------------------------------
+void FlexCAN::reserveTx(bool enable)
+{
+  txFirst = enable ? (txReserved+1) : txb;
+}
+
+
+// -------------------------------------------------------------
+int FlexCAN::writeReserved(uint32_t id, uint8_t ext, uint8_t len, const uint32_t *words)
+{
+  if ( txFirst <= txReserved ) {
+    return -1;// no reserved buffer
+  }
+  if ((FLEXCANb_MBn_CS(flexcanBase, txReserved) & FLEXCAN_MB_CS_CODE_MASK) != FLEXCAN_MB_CS_CODE(FLEXCAN_MB_CODE_TX_INACTIVE)) {
+    return -1;// previous frame still pending
+  }
+
+  transmit(txReserved, id, ext, len, words[0], words[1]);
+  return txReserved;
+}
+
+
+// -------------------------------------------------------------
+int FlexCAN::preempt(uint32_t id, uint8_t ext, uint8_t len, const uint32_t *words, uint8_t &aborted, uint32_t &abortedId, uint32_t keep)
+{
+  uint32_t victimId = ext ? (id & FLEXCAN_MB_ID_EXT_MASK) : FLEXCAN_MB_ID_IDSTD(id);
+  int victim = -1;
+
+  aborted = 0;
+
+  // a free buffer needs no abort, otherwise the lowest priority pending one
+  for ( int index = txFirst; index < (txb+txBuffers); ++index ) {
+    if ((FLEXCANb_MBn_CS(flexcanBase, index) & FLEXCAN_MB_CS_CODE_MASK) == FLEXCAN_MB_CS_CODE(FLEXCAN_MB_CODE_TX_INACTIVE)) {
+      transmit(index, id, ext, len, words[0], words[1]);
+      return index;
+    }
+    uint32_t pendingId = FLEXCANb_MBn_ID(flexcanBase, index) & FLEXCAN_MB_ID_EXT_MASK;
+    if ( txPending(index) && !(keep & (1UL << index)) && (pendingId > victimId) ) {
+      victim = index;
+      victimId = pendingId;
+    }
+  }
+
+  if ( 0 > victim ) {
+    return -1;// everything pending has a higher priority
+  }
+
+  uint8_t victimExt = (FLEXCANb_MBn_CS(flexcanBase, victim) & FLEXCAN_MB_CS_IDE)? 1:0;
+
+  // a frame already on the bus decides the outcome when it is complete,
+  // nothing is written until abort() tells
+  int result = abort(victim);
+  if ( 0 > result ) {
+    aborted = 2;
+    return victim;
+  }
+  if ( 0 < result ) {
+    aborted = 1;
+    abortedId = victimExt ? victimId : (victimId >> FLEXCAN_MB_ID_STD_BIT_NO);
+  }
+
+  transmit(victim, id, ext, len, words[0], words[1]);
+  return victim;
+}
+
+
+// -------------------------------------------------------------
+int FlexCAN::abort(int mailbox)
+{
+  uint32_t flag = 1UL << mailbox;
+
+  if ((FLEXCANb_MBn_CS(flexcanBase, mailbox) & FLEXCAN_MB_CS_CODE_MASK) == FLEXCAN_MB_CS_CODE(FLEXCAN_MB_CODE_TX_ONCE)) {
+    // clear the flag first, a frame completing from here on sets it again
+    FLEXCANb_IFLAG1(flexcanBase) = flag;
+    if ((FLEXCANb_MBn_CS(flexcanBase, mailbox) & FLEXCAN_MB_CS_CODE_MASK) != FLEXCAN_MB_CS_CODE(FLEXCAN_MB_CODE_TX_ONCE)) {
+      return 0;// just sent
+    }
+    FLEXCANb_MBn_CS(flexcanBase, mailbox) = FLEXCAN_MB_CS_CODE(FLEXCAN_MB_CODE_TX_ABORT);
+  }
+
+  if ((FLEXCANb_MBn_CS(flexcanBase, mailbox) & FLEXCAN_MB_CS_CODE_MASK) != FLEXCAN_MB_CS_CODE(FLEXCAN_MB_CODE_TX_ABORT)) {
+    return 0;// nothing pending
+  }
+  if ( !(FLEXCANb_IFLAG1(flexcanBase) & flag) ) {
+    return -1;// frame on the bus
+  }
+
+  // the controller answers with the flag: the code stays ABORT if the frame
+  // was taken back and turns INACTIVE if it won arbitration before
+  FLEXCANb_IFLAG1(flexcanBase) = flag;
+  if ((FLEXCANb_MBn_CS(flexcanBase, mailbox) & FLEXCAN_MB_CS_CODE_MASK) == FLEXCAN_MB_CS_CODE(FLEXCAN_MB_CODE_TX_ABORT)) {
+    FLEXCANb_MBn_CS(flexcanBase, mailbox) = FLEXCAN_MB_CS_CODE(FLEXCAN_MB_CODE_TX_INACTIVE);
+    return 1;
+  }
+
+  return 0;
+}
+
+
+// -------------------------------------------------------------
+int FlexCAN::txPending(int mailbox)
+{
+  return ((FLEXCANb_MBn_CS(flexcanBase, mailbox) & FLEXCAN_MB_CS_CODE_MASK) == FLEXCAN_MB_CS_CODE(FLEXCAN_MB_CODE_TX_ONCE))? 1:0;
+}
+
+
+// -------------------------------------------------------------
+void FlexCAN::transmit(int buffer, uint32_t id, uint8_t ext, uint8_t len, uint32_t word0, uint32_t word1)
+{
+  // with equal identifiers the reserved buffer goes first
+  uint32_t prio = FLEXCAN_MB_ID_PRIO(((txReserved == buffer) && (txFirst > txReserved)) ? 0 : 1);
+
   FLEXCANb_MBn_CS(flexcanBase, buffer) = FLEXCAN_MB_CS_CODE(FLEXCAN_MB_CODE_TX_INACTIVE);
-  if(msg.ext) {
-    FLEXCANb_MBn_ID(flexcanBase, buffer) = (msg.id & FLEXCAN_MB_ID_EXT_MASK);
+  if(ext) {
+    FLEXCANb_MBn_ID(flexcanBase, buffer) = (id & FLEXCAN_MB_ID_EXT_MASK) | prio;
   } else {
-    FLEXCANb_MBn_ID(flexcanBase, buffer) = FLEXCAN_MB_ID_IDSTD(msg.id);
+    FLEXCANb_MBn_ID(flexcanBase, buffer) = FLEXCAN_MB_ID_IDSTD(id) | prio;
   }
-  FLEXCANb_MBn_WORD0(flexcanBase, buffer) = (msg.buf[0]<<24)|(msg.buf[1]<<16)|(msg.buf[2]<<8)|msg.buf[3];
-  FLEXCANb_MBn_WORD1(flexcanBase, buffer) = (msg.buf[4]<<24)|(msg.buf[5]<<16)|(msg.buf[6]<<8)|msg.buf[7];
-  if(msg.ext) {
+  FLEXCANb_MBn_WORD0(flexcanBase, buffer) = word0;
+  FLEXCANb_MBn_WORD1(flexcanBase, buffer) = word1;
+  if(ext) {
     FLEXCANb_MBn_CS(flexcanBase, buffer) = FLEXCAN_MB_CS_CODE(FLEXCAN_MB_CODE_TX_ONCE)
-                                         | FLEXCAN_MB_CS_LENGTH(msg.len) | FLEXCAN_MB_CS_SRR | FLEXCAN_MB_CS_IDE;
+                                         | FLEXCAN_MB_CS_LENGTH(len) | FLEXCAN_MB_CS_SRR | FLEXCAN_MB_CS_IDE;
   } else {
     FLEXCANb_MBn_CS(flexcanBase, buffer) = FLEXCAN_MB_CS_CODE(FLEXCAN_MB_CODE_TX_ONCE)
-                                         | FLEXCAN_MB_CS_LENGTH(msg.len);
+                                         | FLEXCAN_MB_CS_LENGTH(len);
   }
+}
 
-  return 1;
+
+// -------------------------------------------------------------
+void FlexCAN::attachRxInterrupt(void (*handler)(void))
+{
+  if(flexcanBase == FLEXCAN0_BASE) {
+    rxHandler[0] = handler;
+  } else {
+    rxHandler[1] = handler;
+  }
+
+  // interrupt when a frame is available in the RX FIFO
+  FLEXCANb_IMASK1(flexcanBase) |= FLEXCAN_IMASK1_BUF5M;
+
+  if(flexcanBase == FLEXCAN0_BASE) {
+#if defined(__MK66FX1M0__) || defined(__MK64FX512__)
+    NVIC_ENABLE_IRQ(IRQ_CAN0_MESSAGE);
+#else
+    NVIC_ENABLE_IRQ(IRQ_CAN_MESSAGE);
+#endif
+  }
+#ifdef __MK66FX1M0__
+  else if(flexcanBase == FLEXCAN1_BASE) {
+    NVIC_ENABLE_IRQ(IRQ_CAN1_MESSAGE);
+  }
+#endif
 }
+
+
+// -------------------------------------------------------------
+void FlexCAN::detachRxInterrupt(void)
+{
+  FLEXCANb_IMASK1(flexcanBase) &= ~FLEXCAN_IMASK1_BUF5M;
+
+  if(flexcanBase == FLEXCAN0_BASE) {
+    rxHandler[0] = 0;
+  } else {
+    rxHandler[1] = 0;
+  }
+}
+
+
+// -------------------------------------------------------------
+void can0_message_isr(void)
+{
+  if(rxHandler[0]) {
+    rxHandler[0]();
+  } else {
+    FLEXCANb_IMASK1(FLEXCAN0_BASE) &= ~FLEXCAN_IMASK1_BUF5M;
+  }
+}
+
+#ifdef __MK66FX1M0__
+// -------------------------------------------------------------
+void can1_message_isr(void)
+{
+  if(rxHandler[1]) {
+    rxHandler[1]();
+  } else {
+    FLEXCANb_IMASK1(FLEXCAN1_BASE) &= ~FLEXCAN_IMASK1_BUF5M;
+  }
+}
+#endif
@@ -28,6 +28,8 @@ class FlexCAN
 private:
   struct CAN_filter_t defaultMask;
   uint32_t flexcanBase;
+  int txFirst;
+  void transmit(int buffer, uint32_t id, uint8_t ext, uint8_t len, uint32_t word0, uint32_t word1);
 
 public:
   FlexCAN(uint32_t baud = 125000, uint8_t id = 0, uint8_t txAlt = 0, uint8_t rxAlt = 0);
@@ -37,11 +39,53 @@ public:
     begin(defaultMask);
   }
   void setFilter(const CAN_filter_t &filter, uint8_t n);
+  // programs all 8 RX FIFO filter elements with individual masks (plain id
+  // masks, 1 = bit must match) at runtime, unused elements repeat the last
+  // filter, n = 0 rejects all data frames
+  void setFilters(const CAN_filter_t *filters, const uint32_t *masks, uint8_t n);
   void end(void);
   int available(void);
   int write(const CAN_message_t &msg);
   int read(CAN_message_t &msg);
 
+  // mailbox data words as they are: byte 0 of the frame is the most
+  // significant byte of words[0], bytes beyond len read as zero. both
+  // never block, writeWords() returns the TX buffer used or -1 and leaves
+  // a reserved one and the buffers below first alone
+  int readWords(uint32_t &id, uint8_t &ext, uint8_t &len, uint32_t *words);
+  int writeWords(uint32_t id, uint8_t ext, uint8_t len, const uint32_t *words, int first = 0);
+
+  // reserveTx() keeps the first TX buffer for writeReserved(), write(),
+  // writeWords() and preempt() then use the others. without it (default)
+  // all TX buffers are available to them and writeReserved() returns -1
+  void reserveTx(bool enable = true);
+
+  // urgent frames: writeReserved() uses the reserved TX buffer, preempt()
+  // a free one or else aborts the pending frame with the highest identifier
+  // above id and takes its buffer (aborted = 1 and abortedId if it was taken
+  // back before it got sent), buffers set in keep are never aborted. both
+  // return the buffer used or -1. preempt() never waits: aborted = 2 if the
+  // frame is on the bus, nothing is written, finish with abort() and retry
+  int writeReserved(uint32_t id, uint8_t ext, uint8_t len, const uint32_t *words);
+  int preempt(uint32_t id, uint8_t ext, uint8_t len, const uint32_t *words, uint8_t &aborted, uint32_t &abortedId, uint32_t keep = 0);
+  int txPending(int mailbox);
+  // takes a pending frame back without waiting: 1 if it was taken back,
+  // 0 if it got sent (or nothing was pending), -1 while it is still on the
+  // bus, call again until the outcome is known
+  int abort(int mailbox);
+
+  // frame at the head of the RX FIFO without removing it: peekWords() points
+  // to its data words in the message buffer (bytes beyond len are
+  // undefined), both stay valid until release() hands the slot back
+  int peek(uint32_t &id, uint8_t &ext, uint8_t &len);
+  const volatile uint32_t* peekWords(void);
+  void release(void);
+
+  // handler is called from the interrupt whenever the RX FIFO holds a frame,
+  // it has to read() all available frames
+  void attachRxInterrupt(void (*handler)(void));
+  void detachRxInterrupt(void);
+
 };
 
 #endif // __FLEXCAN_H__
@@ -17,11 +17,12 @@ void setup() {
   // Initialize CommunicationManager with 500kBit/s
   CommunicationManager::GetInstance()->Initialize(500000);
 
-  // Publish Sensor value every 40ms
-  CommunicationManager::GetInstance()->Publish(&sensorValue, sizeof(sensorValue), CAN_ID, &txFlagSensorValue, CYCLE_40);
-
   // Initialize Sensor Value
   readSensor();
+
+  // Publish Sensor value when it moved by more than 4, at most every 10ms
+  // and at least once a second
+  CommunicationManager::GetInstance()->PublishOnChange(&sensorValue, SIGNAL_UINT16, CAN_ID, &txFlagSensorValue, 4.0f, CYCLE_10, 1000000UL);
 }
 
 void readSensor() {
@@ -29,14 +30,14 @@ void readSensor() {
 }
 
 void loop() {
+  // Read new sensor value, it is sent when it changed
+  readSensor();
+
   // Update CommunicationManager
   CommunicationManager::GetInstance()->Update();
 
   // Check if value was sent
   if(1 == txFlagSensorValue) {
-    // Read new sensor value
-    readSensor();
-
     // Reset flag
     txFlagSensorValue = 0;
   }
@@ -0,0 +1,2761 @@
+/************************************************************************
+ * CommunicationManager benchmark
+ *
+ * Runs the CommunicationManager against the VirtualCanBus and reports
+ * the cost of Update(), ListAdd() and the receive dispatch as well as the
+ * end-to-end frame latency of a node with 128 producers and 128 consumers.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <vector>
+#include <signal.h>
+#include <time.h>
+#include "CommunicationManager.h"
+#include "CommunicationTransport.h"
+#include "CommunicationBulk.h"
+#include "CommunicationFrame.h"
+#include "VirtualCanBus.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define BENCH_SIGNALS 128
+#define BENCH_STEP_US 100
+#define BENCH_DURATION_MS 2000
+
+static const COMMUNICATION_CYCLE BENCH_cycles[] = { CYCLE_10, CYCLE_20, CYCLE_40, CYCLE_80, CYCLE_100 };
+static const unsigned int BENCH_cycleMillis[] = { 10, 20, 40, 80, 100 };
+
+static uint64_t BENCH_now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* CPU cycles (time stamp counter) where available, nanoseconds otherwise */
+static uint64_t BENCH_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return BENCH_now();
+#endif
+}
+
+static void BENCH_report(const char* group, const char* name, double value, const char* unit) {
+	printf("%-16s %-44s %12.1f %s\n", group, name, value, unit);
+}
+
+/* Correctness results are reported like the measurements, every one which
+ * differs from the expected value fails the run
+ */
+static unsigned int BENCH_failures = 0;
+
+static void BENCH_check(const char* group, const char* name, double value, double expected, const char* unit) {
+	BENCH_report(group, name, value, unit);
+	if (value != expected) {
+		printf("%-16s %-44s %12.1f expected, FAILED\n", group, name, expected);
+		BENCH_failures += 1;
+	}
+}
+
+typedef struct BENCH_stats_t {
+	double mean;
+	double p99;
+	double max;
+} BENCH_stats_t;
+
+static BENCH_stats_t BENCH_statistics(std::vector<double>& samples) {
+	BENCH_stats_t stats = { 0.0, 0.0, 0.0 };
+	if (samples.empty()) {
+		return stats;
+	}
+
+	std::sort(samples.begin(), samples.end());
+	double sum = 0.0;
+	for (double sample : samples) {
+		sum += sample;
+	}
+	stats.mean = sum / samples.size();
+	stats.p99 = samples[(samples.size() * 99) / 100];
+	stats.max = samples.back();
+	return stats;
+}
+
+/************************************************************************
+ * Transport: message content and a sink which checks it on the fly
+ */
+static unsigned char BENCH_pattern(uint32_t offset) {
+	return (unsigned char)(offset * 31 + (offset >> 8));
+}
+
+typedef struct BENCH_sink_t {
+	unsigned long bytes;
+	unsigned long errors;
+	unsigned long messages;
+} BENCH_sink_t;
+
+static bool BENCH_sink(void* context, uint32_t length, uint32_t offset, const unsigned char* data, unsigned int bytes) {
+	BENCH_sink_t* sink = (BENCH_sink_t*)context;
+	for (unsigned int i = 0; i < bytes; i++) {
+		if (data[i] != BENCH_pattern(offset + i)) {
+			sink->errors += 1;
+		}
+	}
+	sink->bytes += bytes;
+	if (offset + bytes == length) {
+		sink->messages += 1;
+	}
+	return true;
+}
+
+/************************************************************************
+ * Reference: sorted doubly linked list formerly used as transmit queue
+ */
+typedef struct BENCH_listNode_t {
+	COMMUNICATION_producer_t producer;
+	BENCH_listNode_t* left;
+	BENCH_listNode_t* right;
+} BENCH_listNode_t;
+
+class BENCH_sortedList {
+private:
+	BENCH_listNode_t nodes[COMMUNICATION_MAX_LIST_NODES];
+	BENCH_listNode_t* freeNodes[COMMUNICATION_MAX_LIST_NODES];
+	unsigned int nNodes;
+	BENCH_listNode_t* nodeList;
+
+public:
+	BENCH_sortedList() {
+		nNodes = 0;
+		nodeList = nullptr;
+		for (unsigned int i = 0; i < COMMUNICATION_MAX_LIST_NODES; i++) {
+			freeNodes[i] = &nodes[i];
+		}
+	}
+
+	void Add(const COMMUNICATION_producer_t& producer) {
+		BENCH_listNode_t* newNode = freeNodes[nNodes++];
+		newNode->left = nullptr;
+		newNode->right = nullptr;
+		newNode->producer = producer;
+
+		if (nullptr == nodeList) {
+			nodeList = newNode;
+			return;
+		}
+		if (newNode->producer.canId > nodeList->producer.canId) {
+			BENCH_listNode_t* currentNode = nodeList;
+			do {
+				BENCH_listNode_t* rightNode = currentNode->right;
+				if (nullptr == rightNode) {
+					currentNode->right = newNode;
+					newNode->left = currentNode;
+					return;
+				}
+				currentNode = rightNode;
+			} while (newNode->producer.canId > currentNode->producer.canId);
+
+			BENCH_listNode_t* oldLeftNode = currentNode->left;
+			currentNode->left = newNode;
+			oldLeftNode->right = newNode;
+			newNode->right = currentNode;
+			newNode->left = oldLeftNode;
+		}
+		else {
+			nodeList->left = newNode;
+			newNode->right = nodeList;
+			nodeList = newNode;
+		}
+	}
+
+	void RemoveHead() {
+		BENCH_listNode_t* newHead = nodeList->right;
+		freeNodes[--nNodes] = nodeList;
+		nodeList = newHead;
+	}
+
+	bool Empty() {
+		return (nullptr == nodeList);
+	}
+};
+
+/************************************************************************
+ * Simulated RX interrupt, see BenchRxPreemption()
+ */
+#define BENCH_ISR_FRAMES 500000
+#define BENCH_ISR_BURST 64
+#define BENCH_ISR_IDS COMMUNICATION_RX_RING_SIZE
+
+/* Compile time layout against the same signals registered at runtime */
+typedef struct BENCH_frame_t {
+	int16_t position;
+	uint8_t enable;
+	int32_t counter;
+	uint16_t speed;
+	int8_t current;
+} BENCH_frame_t;
+
+typedef CommunicationFrame<BENCH_frame_t, 8,
+	COMMUNICATION_FIELD(BENCH_frame_t, position, 3, 12, ORDER_MSB),
+	COMMUNICATION_FIELD(BENCH_frame_t, enable, 16, 1, ORDER_LSB),
+	COMMUNICATION_FIELD(BENCH_frame_t, counter, 17, 20, ORDER_LSB),
+	COMMUNICATION_FIELD(BENCH_frame_t, speed, 47, 16, ORDER_MSB),
+	COMMUNICATION_FIELD(BENCH_frame_t, current, 56, 8, ORDER_LSB)> BENCH_frame;
+
+static_assert(BENCH_frame::layout[2].shift == 17, "layout table is constexpr");
+
+/* Packed and unpacked by the compiler, saturation and sign extension included */
+static constexpr uint32_t BENCH_framePacked(const BENCH_frame_t& values, unsigned int word) {
+	uint32_t words[2] = { 0, 0 };
+	BENCH_frame::Pack(values, words);
+	return words[word];
+}
+
+static constexpr BENCH_frame_t BENCH_frameUnpacked(uint32_t word0, uint32_t word1) {
+	const uint32_t words[2] = { word0, word1 };
+	BENCH_frame_t values = { 0, 0, 0, 0, 0 };
+	BENCH_frame::Unpack(words, values);
+	return values;
+}
+
+static_assert(BENCH_framePacked({ -100, 1, -300000, 0xBEEF, -5 }, 0) == 0x0F9C41D8UL, "Pack() is constexpr");
+static_assert(BENCH_framePacked({ -100, 1, -300000, 0xBEEF, -5 }, 1) == 0x16BEEFFBUL, "Pack() is constexpr");
+static_assert(BENCH_framePacked({ 4000, 0, 0, 0, 0 }, 0) == 0x07FF0000UL, "Pack() saturates at compile time");
+static_assert(BENCH_frameUnpacked(0x0F9C41D8UL, 0x16BEEFFBUL).counter == -300000, "Unpack() is constexpr");
+static_assert(BENCH_frameUnpacked(0x0F9C41D8UL, 0x16BEEFFBUL).position == -100, "Unpack() is constexpr");
+
+/* Out of line, so that "make size" can compare them with the generic path */
+__attribute__((noinline)) void BENCH_framePack(const BENCH_frame_t& values, uint32_t* words) {
+	BENCH_frame::Pack(values, words);
+}
+
+__attribute__((noinline)) void BENCH_frameUnpack(const uint32_t* words, BENCH_frame_t& values) {
+	BENCH_frame::Unpack(words, values);
+}
+
+static volatile uint32_t BENCH_isrSeq;
+static volatile uint32_t BENCH_isrPushed;
+
+/* Snapshot subscriber, see BenchSnapshotRead() */
+#define BENCH_SNAPSHOT_FRAMES 50000
+#define BENCH_SNAPSHOT_ID 0x101
+#define BENCH_PLAIN_ID 0x103
+
+static volatile uint32_t BENCH_snapshotSeq;
+/* Model of __disable_irq() / __enable_irq(): the timer signal is deferred
+ * while the loop masks it and taken when it unmasks
+ */
+static volatile bool BENCH_irqMasked;
+static volatile bool BENCH_irqPending;
+static volatile unsigned long BENCH_irqDeferred;
+
+static void BENCH_ignore(void*, void*) {
+}
+
+/* Reaction to a frame, see BenchReaction() */
+typedef struct BENCH_reaction_t {
+	uint32_t sentAt;
+	std::vector<double>* latency;
+} BENCH_reaction_t;
+
+static void BENCH_react(void* context, void*) {
+	BENCH_reaction_t* reaction = (BENCH_reaction_t*)context;
+	reaction->latency->push_back((double)(micros() - reaction->sentAt));
+}
+
+class CommunicationBenchmark {
+private:
+	static void RxInterrupt(int) {
+		CommunicationManager* cm = CommunicationManager::GetInstance();
+		uint32_t words[2];
+
+		for (unsigned int n = 0; (n < BENCH_ISR_BURST) && (BENCH_isrSeq < BENCH_ISR_FRAMES); n++) {
+			uint32_t seq = BENCH_isrSeq + 1;
+			/* Little endian payload bytes as they come out of the mailbox */
+			words[0] = __builtin_bswap32(seq);
+			words[1] = __builtin_bswap32(~seq);
+			if (cm->RxRingPush(0x101 + 2 * (seq % BENCH_ISR_IDS), words, 8)) {
+				BENCH_isrPushed = BENCH_isrPushed + 1;
+			}
+			BENCH_isrSeq = seq;
+		}
+	}
+
+	static void SnapshotInterrupt(int) {
+		/* Both frames arrive, the RX interrupt writes the subscribers */
+		if (BENCH_irqMasked) {
+			BENCH_irqPending = true;
+			BENCH_irqDeferred = BENCH_irqDeferred + 1;
+			return;
+		}
+		if (BENCH_snapshotSeq >= BENCH_SNAPSHOT_FRAMES) {
+			return;
+		}
+		uint32_t seq = BENCH_snapshotSeq + 1;
+		CAN_test_msg_t msg = {};
+		msg.len = 8;
+		for (unsigned int i = 0; i < 4; i++) {
+			msg.buf[i] = seq >> (8 * i);
+			msg.buf[4 + i] = ~seq >> (8 * i);
+		}
+		msg.id = BENCH_SNAPSHOT_ID;
+		Test_GetNode()->Inject(msg);
+		msg.id = BENCH_PLAIN_ID;
+		Test_GetNode()->Inject(msg);
+		BENCH_snapshotSeq = seq;
+	}
+
+	static inline void ReadMasked(const volatile uint32_t* words, uint32_t* value) {
+		BENCH_irqMasked = true;
+		__asm__ volatile("" : : : "memory");
+		value[0] = words[0];
+		value[1] = words[1];
+		__asm__ volatile("" : : : "memory");
+		BENCH_irqMasked = false;
+		if (BENCH_irqPending) {
+			/* Taken now, the timer signal waits until it returned */
+			sigset_t block;
+			sigset_t previous;
+			sigemptyset(&block);
+			sigaddset(&block, SIGALRM);
+			sigprocmask(SIG_BLOCK, &block, &previous);
+			BENCH_irqPending = false;
+			SnapshotInterrupt(0);
+			sigprocmask(SIG_SETMASK, &previous, nullptr);
+		}
+	}
+
+	CommunicationManager* cm;
+
+	uint16_t txValues[BENCH_SIGNALS];
+	uint8_t txFlags[BENCH_SIGNALS];
+	uint16_t rxValues[BENCH_SIGNALS];
+	uint8_t rxFlags[BENCH_SIGNALS];
+
+	/* Producer of signal i uses an even, consumer an odd identifier */
+	static unsigned int ProducerId(unsigned int i) { return 0x100 + 2 * i; }
+	static unsigned int ConsumerId(unsigned int i) { return 0x101 + 2 * i; }
+
+	void Reset(VirtualCanNode* node, uint32_t baud, COMMUNICATION_BYTE_ORDER byteOrder = ORDER_MSB, COMMUNICATION_RX_MODE rxMode = RX_POLLING, COMMUNICATION_TX_MODE txMode = TX_QUEUE) {
+		/* Fresh singleton state, the clock keeps running */
+		*cm = CommunicationManager();
+		Test_SetNode(node);
+		cm->Initialize(baud, byteOrder, rxMode, txMode);
+	}
+
+	void RegisterSignals(unsigned int producers, unsigned int consumers, uint32_t phase = COMMUNICATION_PHASE_AUTO) {
+		for (unsigned int i = 0; i < producers; i++) {
+			txValues[i] = i;
+			cm->Publish(&txValues[i], sizeof(txValues[i]), ProducerId(i), &txFlags[i], BENCH_cycles[i % 5], phase);
+		}
+		for (unsigned int i = 0; i < consumers; i++) {
+			cm->Subscribe(&rxValues[i], sizeof(rxValues[i]), ConsumerId(i), &rxFlags[i]);
+		}
+	}
+
+public:
+	CommunicationBenchmark() {
+		cm = CommunicationManager::GetInstance();
+	}
+
+	void BenchUpdateIdle() {
+		VirtualCanBus bus(1000000);
+		VirtualCanNode* node = bus.AddNode();
+		Test_SetBus(&bus);
+		Reset(node, 1000000);
+		RegisterSignals(BENCH_SIGNALS, BENCH_SIGNALS);
+
+		/* Align to a tick and stay in between ticks */
+		Test_AdvanceMillis(10 - (millis() % 10));
+		cm->Update();
+		Test_AdvanceMillis(1);
+		while (node->GetPendingTx() > 0 || cm->GetMessageUtilization() > 0) {
+			cm->Update();
+			Test_AdvanceMicros(BENCH_STEP_US);
+		}
+
+		const unsigned int iterations = 100000;
+		uint64_t start = BENCH_now();
+		for (unsigned int i = 0; i < iterations; i++) {
+			cm->Update();
+		}
+		uint64_t end = BENCH_now();
+
+		BENCH_report("update", "idle (128 producers, 128 consumers)", (double)(end - start) / iterations, "ns/call");
+		Test_SetBus(nullptr);
+	}
+
+	void BenchTimerWheel() {
+		/* Update() cost while nothing is due, over the number of producers */
+		const unsigned int counts[] = { 16, BENCH_SIGNALS };
+		for (unsigned int n : counts) {
+			VirtualCanBus bus(1000000);
+			VirtualCanNode* node = bus.AddNode();
+			Test_SetBus(&bus);
+			Reset(node, 1000000);
+			for (unsigned int i = 0; i < n; i++) {
+				cm->Publish(&txValues[i], sizeof(txValues[i]), ProducerId(i), &txFlags[i], 1000000UL);
+			}
+
+			/* One step per call, phases spread the producers over 400ms */
+			const unsigned int iterations = 100000;
+			uint64_t cost = 0;
+			for (unsigned int i = 0; i < iterations; i++) {
+				uint64_t start = BENCH_now();
+				cm->Update();
+				cost += BENCH_now() - start;
+				Test_AdvanceMicros(BENCH_STEP_US);
+			}
+
+			char name[64];
+			snprintf(name, sizeof(name), "Update() with %u producers (1s cycle)", n);
+			BENCH_report("wheel", name, (double)cost / iterations, "ns/call");
+			Test_SetBus(nullptr);
+		}
+
+		/* Arbitrary periods: interval between two transmissions */
+		const uint32_t cycles[] = { 2550, 7333, 1500000 };
+		for (uint32_t cycle : cycles) {
+			VirtualCanBus bus(1000000);
+			VirtualCanNode* node = bus.AddNode();
+			Test_SetBus(&bus);
+			Reset(node, 1000000);
+			cm->Publish(&txValues[0], sizeof(txValues[0]), ProducerId(0), &txFlags[0], cycle);
+
+			std::vector<double> error;
+			uint32_t last = 0;
+			bool first = true;
+			uint32_t startMicros = micros();
+			while ((micros() - startMicros) < 6000000UL) {
+				cm->Update();
+				if (txFlags[0]) {
+					txFlags[0] = 0;
+					if (!first) {
+						error.push_back(fabs((double)(micros() - last) - cycle));
+					}
+					first = false;
+					last = micros();
+				}
+				Test_AdvanceMicros(BENCH_STEP_US);
+			}
+
+			char name[64];
+			snprintf(name, sizeof(name), "period %luus, max interval error", (unsigned long)cycle);
+			BENCH_stats_t stats = BENCH_statistics(error);
+			BENCH_report("wheel", name, stats.max, "us");
+			Test_SetBus(nullptr);
+		}
+
+		/* Update() not called for 1s: the missed cycles are skipped, the
+		 * frame after the overdue one is sent on the phase grid again
+		 */
+		VirtualCanBus bus(1000000);
+		VirtualCanNode* node = bus.AddNode();
+		Test_SetBus(&bus);
+		Reset(node, 1000000);
+		cm->Publish(&txValues[0], sizeof(txValues[0]), ProducerId(0), &txFlags[0], CYCLE_10, 2000);
+		for (unsigned int t = 0; t < 50000; t += BENCH_STEP_US) {
+			cm->Update();
+			Test_AdvanceMicros(BENCH_STEP_US);
+		}
+		Test_AdvanceMicros(1003000UL);
+
+		unsigned int burst = 0;
+		uint32_t next = 0;
+		for (unsigned int t = 0; t < 20000; t += BENCH_STEP_US) {
+			txFlags[0] = 0;
+			cm->Update();
+			if (txFlags[0] && (t < 1000)) {
+				burst += 1;
+			}
+			else if (txFlags[0] && (0 == next)) {
+				next = micros() - cm->scheduleStart;
+			}
+			Test_AdvanceMicros(BENCH_STEP_US);
+		}
+		BENCH_check("wheel", "frames within 1ms after a 1s stall", burst, 1.0, "frames");
+		BENCH_check("wheel", "next frame after the stall on its phase", (next % CYCLE_10) == 2000, 1.0, "bool");
+		Test_SetBus(nullptr);
+	}
+
+	void BenchListAdd() {
+		VirtualCanBus bus(1000000);
+		VirtualCanNode* node = bus.AddNode();
+		Test_SetBus(&bus);
+		Reset(node, 1000000);
+		RegisterSignals(COMMUNICATION_MAX_LIST_NODES, 0);
+
+		std::vector<unsigned int> order(COMMUNICATION_MAX_LIST_NODES);
+		for (unsigned int i = 0; i < order.size(); i++) {
+			order[i] = i;
+		}
+
+		const char* names[] = { "ascending ids", "descending ids", "random ids" };
+		for (unsigned int variant = 0; variant < 3; variant++) {
+			if (1 == variant) {
+				std::reverse(order.begin(), order.end());
+			}
+			else if (2 == variant) {
+				srand(1);
+				for (unsigned int i = order.size() - 1; i > 0; i--) {
+					std::swap(order[i], order[rand() % (i + 1)]);
+				}
+			}
+
+			const unsigned int rounds = 2000;
+			uint64_t addTime = 0;
+			uint64_t removeTime = 0;
+			uint64_t refAddTime = 0;
+			uint64_t refRemoveTime = 0;
+			BENCH_sortedList reference;
+			for (unsigned int r = 0; r < rounds; r++) {
+				uint64_t start = BENCH_now();
+				for (unsigned int i : order) {
+					cm->ListAdd(i, 0);
+				}
+				uint64_t mid = BENCH_now();
+				while (!cm->ListEmpty()) {
+					cm->ListRemoveHead();
+				}
+				uint64_t end = BENCH_now();
+				addTime += mid - start;
+				removeTime += end - mid;
+
+				start = BENCH_now();
+				for (unsigned int i : order) {
+					reference.Add(cm->producers[i]);
+				}
+				mid = BENCH_now();
+				while (!reference.Empty()) {
+					reference.RemoveHead();
+				}
+				end = BENCH_now();
+				refAddTime += mid - start;
+				refRemoveTime += end - mid;
+			}
+
+			char name[64];
+			snprintf(name, sizeof(name), "sorted list add, %s", names[variant]);
+			BENCH_report("queue", name, (double)refAddTime / (rounds * order.size()), "ns/op");
+			snprintf(name, sizeof(name), "sorted list remove head, %s", names[variant]);
+			BENCH_report("queue", name, (double)refRemoveTime / (rounds * order.size()), "ns/op");
+			snprintf(name, sizeof(name), "ListAdd %s", names[variant]);
+			BENCH_report("queue", name, (double)addTime / (rounds * order.size()), "ns/op");
+			snprintf(name, sizeof(name), "ListRemoveHead %s", names[variant]);
+			BENCH_report("queue", name, (double)removeTime / (rounds * order.size()), "ns/op");
+		}
+
+		/* Buckets are kept in Can ID order: a producer registered while
+		 * frames are queued gets its bucket between theirs
+		 */
+		Reset(node, 1000000);
+		const unsigned int ids[] = { 8, 6, 4, 2, 3, 3 };
+		for (unsigned int i = 0; i < 6; i++) {
+			cm->Publish(&txValues[i], sizeof(txValues[i]), ProducerId(ids[i]), &txFlags[i], CYCLE_100);
+			cm->ListAdd(i, 0);
+		}
+		unsigned int outOfOrder = 0;
+		unsigned int dequeued = 0;
+		unsigned int last = 0;
+		while (!cm->ListEmpty()) {
+			COMMUNICATION_listNode_t* head = cm->ListGetHead();
+			outOfOrder += ((head->canId < last) || (head->canId != cm->ListHeadId())) ? 1 : 0;
+			last = head->canId;
+			dequeued += 1;
+			cm->ListRemoveHead();
+		}
+		BENCH_check("queue", "frames dequeued after late registrations", (double)dequeued, 6.0, "frames");
+		BENCH_check("queue", "frames out of Can ID order", (double)outOfOrder, 0.0, "frames");
+		Test_SetBus(nullptr);
+	}
+
+	void BenchRxDispatch() {
+		VirtualCanBus bus(1000000);
+		VirtualCanNode* node = bus.AddNode(VIRTUAL_CAN_TX_MAILBOXES, BENCH_SIGNALS);
+		Test_SetBus(&bus);
+		Reset(node, 1000000);
+		RegisterSignals(0, BENCH_SIGNALS);
+
+		CAN_test_msg_t msg = {};
+		msg.len = 2;
+
+		const unsigned int rounds = 2000;
+		uint64_t total = 0;
+		for (unsigned int r = 0; r < rounds; r++) {
+			for (unsigned int i = 0; i < BENCH_SIGNALS; i++) {
+				msg.id = ConsumerId((i * 37) % BENCH_SIGNALS);
+				node->Inject(msg);
+			}
+			uint64_t start = BENCH_now();
+			cm->Update();
+			total += BENCH_now() - start;
+		}
+
+		BENCH_report("rx", "dispatch (128 consumers)", (double)total / (rounds * BENCH_SIGNALS), "ns/frame");
+
+		/* Traffic nobody subscribed to */
+		total = 0;
+		for (unsigned int r = 0; r < rounds; r++) {
+			for (unsigned int i = 0; i < BENCH_SIGNALS; i++) {
+				msg.id = 0x400 + i;
+				node->Inject(msg);
+			}
+			uint64_t start = BENCH_now();
+			cm->Update();
+			total += BENCH_now() - start;
+		}
+
+		BENCH_report("rx", "discard (unknown ids, hardware filtered)", (double)total / (rounds * BENCH_SIGNALS), "ns/frame");
+
+		/* Frames shorter than the subscription, the message buffer holds
+		 * stale bytes beyond the length which must not reach the subscriber
+		 */
+		Reset(node, 1000000, ORDER_LSB);
+		uint64_t wide = 0;
+		unsigned char wideFlag = 0;
+		cm->Subscribe(&wide, sizeof(wide), 0x123, &wideFlag);
+		unsigned long mismatches = 0;
+		for (uint8_t len = 0; len <= 8; len++) {
+			CAN_test_msg_t shortMsg = {};
+			shortMsg.id = 0x123;
+			shortMsg.len = len;
+			uint64_t expected = 0;
+			for (unsigned int n = 0; n < 8; n++) {
+				shortMsg.buf[n] = 0xA0 + n;
+				if (n < len) {
+					expected |= (uint64_t)shortMsg.buf[n] << (8 * n);
+				}
+			}
+			wide = ~0ULL;
+			wideFlag = 0;
+			node->Inject(shortMsg);
+			cm->Update();
+			if (!wideFlag || (wide != expected)) {
+				mismatches++;
+			}
+		}
+		BENCH_check("rx", "short frames with stale bytes delivered wrong", (double)mismatches, 0.0, "frames");
+		Test_SetBus(nullptr);
+	}
+
+	void BenchDispatchLookup() {
+		VirtualCanBus bus(1000000);
+		VirtualCanNode* node = bus.AddNode();
+		Test_SetBus(&bus);
+
+		const char* names[] = { "standard ids", "extended ids" };
+		for (unsigned int variant = 0; variant < 2; variant++) {
+			uint32_t base = (0 == variant) ? 0x101 : 0x18FF0001;
+
+			Reset(node, 1000000);
+			for (unsigned int i = 0; i < BENCH_SIGNALS; i++) {
+				cm->Subscribe(&rxValues[i], sizeof(rxValues[i]), base + 2 * i, &rxFlags[i]);
+			}
+
+			std::vector<uint32_t> ids(1024);
+			for (unsigned int i = 0; i < ids.size(); i++) {
+				/* Three quarters subscribed, one quarter unknown */
+				ids[i] = base + 2 * ((i * 37) % (BENCH_SIGNALS + BENCH_SIGNALS / 3));
+			}
+
+			const unsigned int rounds = 2000;
+			volatile unsigned int sink = 0;
+
+			/* Reference: linear scan over all consumers (previous implementation) */
+			uint64_t start = BENCH_now();
+			for (unsigned int r = 0; r < rounds; r++) {
+				for (uint32_t id : ids) {
+					for (unsigned int i = 0; i < cm->nConsumers; i++) {
+						if (cm->consumers[i].canId == id) {
+							sink = sink + i;
+						}
+					}
+				}
+			}
+			uint64_t mid = BENCH_now();
+			for (unsigned int r = 0; r < rounds; r++) {
+				for (uint32_t id : ids) {
+					unsigned char* slot = cm->DispatchSlot(id, false);
+					unsigned char i = slot ? *slot : COMMUNICATION_NO_CONSUMER;
+					while (COMMUNICATION_NO_CONSUMER != i) {
+						sink = sink + i;
+						i = cm->consumers[i].next;
+					}
+				}
+			}
+			uint64_t end = BENCH_now();
+
+			char name[64];
+			snprintf(name, sizeof(name), "lookup linear scan, %s", names[variant]);
+			BENCH_report("rx", name, (double)(mid - start) / (rounds * ids.size()), "ns/frame");
+			snprintf(name, sizeof(name), "lookup dispatch table, %s", names[variant]);
+			BENCH_report("rx", name, (double)(end - mid) / (rounds * ids.size()), "ns/frame");
+		}
+		Test_SetBus(nullptr);
+	}
+
+	void BenchByteOrder() {
+		const unsigned int frames = 1024;
+		const unsigned int rounds = 2000;
+		std::vector<uint32_t> words(frames * 2);
+		srand(5);
+		for (uint32_t& w : words) {
+			w = ((uint32_t)(rand() & 0xFFFF) << 16) | (rand() & 0xFFFF);
+		}
+
+		const unsigned int sizes[] = { 2, 4, 8 };
+		const COMMUNICATION_BYTE_ORDER orders[] = { ORDER_MSB, ORDER_LSB };
+		const char* orderNames[] = { "msb", "lsb" };
+		for (COMMUNICATION_BYTE_ORDER order : orders) {
+			for (unsigned int bytes : sizes) {
+				uint8_t ref[8] = { 0 };
+				uint8_t out[8] = { 0 };
+				uint32_t packed[2];
+				unsigned long mismatches = 0;
+
+				/* Reference: mailbox words to bytes, then per-byte order loop (previous implementation) */
+				uint64_t start = BENCH_now();
+				for (unsigned int r = 0; r < rounds; r++) {
+					for (unsigned int f = 0; f < frames; f++) {
+						volatile const uint32_t* mb = &words[f * 2];
+						uint8_t buf[8];
+						for (unsigned int n = 0; n < 8; n++) {
+							buf[n] = mb[n >> 2] >> (24 - 8 * (n & 3));
+						}
+						if (ORDER_MSB == order) {
+							for (unsigned int n = 0; n < bytes; n++) {
+								ref[(bytes - 1) - n] = buf[n];
+							}
+						}
+						else {
+							for (unsigned int n = 0; n < bytes; n++) {
+								ref[n] = buf[n];
+							}
+						}
+						asm volatile("" : : "r"(ref) : "memory");
+					}
+				}
+				uint64_t mid = BENCH_now();
+				for (unsigned int r = 0; r < rounds; r++) {
+					for (unsigned int f = 0; f < frames; f++) {
+						volatile const uint32_t* mb = &words[f * 2];
+						uint32_t w[2] = { mb[0], mb[1] };
+						CommunicationManager::Unpack(w, out, bytes, order);
+						asm volatile("" : : "r"(out) : "memory");
+					}
+				}
+				uint64_t end = BENCH_now();
+
+				/* Both paths must agree, and packing must give back the frame */
+				for (unsigned int f = 0; f < frames; f++) {
+					uint32_t* w = &words[f * 2];
+					for (unsigned int n = 0; n < bytes; n++) {
+						uint8_t b = w[n >> 2] >> (24 - 8 * (n & 3));
+						ref[(ORDER_MSB == order) ? (bytes - 1) - n : n] = b;
+					}
+					CommunicationManager::Unpack(w, out, bytes, order);
+					CommunicationManager::Pack(out, packed, bytes, order);
+					uint64_t frame = ((uint64_t)w[0] << 32) | w[1];
+					uint64_t back = ((uint64_t)packed[0] << 32) | packed[1];
+					uint64_t mask = ~0ULL << (64 - 8 * bytes);
+					if (memcmp(ref, out, bytes) || ((frame & mask) != back)) {
+						mismatches++;
+					}
+				}
+
+				char name[64];
+				snprintf(name, sizeof(name), "unpack per byte, %s, %u bytes", orderNames[order], bytes);
+				BENCH_report("byte-order", name, (double)(mid - start) / (rounds * frames), "ns/frame");
+				snprintf(name, sizeof(name), "unpack words, %s, %u bytes", orderNames[order], bytes);
+				BENCH_report("byte-order", name, (double)(end - mid) / (rounds * frames), "ns/frame");
+				snprintf(name, sizeof(name), "mismatches, %s, %u bytes", orderNames[order], bytes);
+				BENCH_check("byte-order", name, (double)mismatches, 0.0, "frames");
+			}
+		}
+
+		/* Transmit direction */
+		for (COMMUNICATION_BYTE_ORDER order : orders) {
+			uint64_t value = 0x0123456789ABCDEFULL;
+			uint32_t packed[2];
+			uint8_t dataOut[8];
+			uint64_t start = BENCH_now();
+			for (unsigned int r = 0; r < rounds * frames; r++) {
+				const uint8_t* data = (const uint8_t*)&value;
+				if (ORDER_MSB == order) {
+					for (unsigned int n = 0; n < 8; n++) {
+						dataOut[7 - n] = data[n];
+					}
+				}
+				else {
+					for (unsigned int n = 0; n < 8; n++) {
+						dataOut[n] = data[n];
+					}
+				}
+				packed[0] = ((uint32_t)dataOut[0] << 24) | (dataOut[1] << 16) | (dataOut[2] << 8) | dataOut[3];
+				packed[1] = ((uint32_t)dataOut[4] << 24) | (dataOut[5] << 16) | (dataOut[6] << 8) | dataOut[7];
+				asm volatile("" : : "r"(packed), "r"(&value) : "memory");
+			}
+			uint64_t mid = BENCH_now();
+			for (unsigned int r = 0; r < rounds * frames; r++) {
+				CommunicationManager::Pack((const uint8_t*)&value, packed, 8, order);
+				asm volatile("" : : "r"(packed), "r"(&value) : "memory");
+			}
+			uint64_t end = BENCH_now();
+
+			char name[64];
+			snprintf(name, sizeof(name), "pack per byte, %s, 8 bytes", orderNames[order]);
+			BENCH_report("byte-order", name, (double)(mid - start) / (rounds * frames), "ns/frame");
+			snprintf(name, sizeof(name), "pack words, %s, 8 bytes", orderNames[order]);
+			BENCH_report("byte-order", name, (double)(end - mid) / (rounds * frames), "ns/frame");
+		}
+	}
+
+	void BenchRxFilter() {
+		/* 0: regular subscriptions, foreign ids in a separate range
+		 * 1: regular subscriptions, foreign ids interleaved
+		 * 2: scattered subscriptions and foreign ids
+		 */
+		for (unsigned int variant = 0; variant < 3; variant++) {
+			VirtualCanBus bus(1000000);
+			VirtualCanNode* node = bus.AddNode();
+			VirtualCanNode* peer = bus.AddNode();
+			Test_SetBus(&bus);
+			Reset(node, 1000000);
+
+			std::vector<uint32_t> subscribed;
+			std::vector<uint32_t> foreign;
+			if (2 == variant) {
+				std::vector<uint32_t> all(COMMUNICATION_STD_IDS);
+				for (unsigned int id = 0; id < all.size(); id++) {
+					all[id] = id;
+				}
+				srand(2);
+				for (unsigned int i = all.size() - 1; i > 0; i--) {
+					std::swap(all[i], all[rand() % (i + 1)]);
+				}
+				subscribed.assign(all.begin(), all.begin() + BENCH_SIGNALS);
+				foreign.assign(all.begin() + BENCH_SIGNALS, all.begin() + 2 * BENCH_SIGNALS);
+			}
+			else {
+				for (unsigned int i = 0; i < BENCH_SIGNALS; i++) {
+					subscribed.push_back(ConsumerId(i));
+					foreign.push_back((0 == variant) ? (0x400 + i) : ProducerId(i));
+				}
+			}
+			for (unsigned int i = 0; i < BENCH_SIGNALS; i++) {
+				cm->Subscribe(&rxValues[i], sizeof(rxValues[i]), subscribed[i], &rxFlags[i]);
+			}
+
+			uint64_t start = BENCH_now();
+			cm->UpdateRxFilters();
+			cm->ApplyRxFilters();
+			uint64_t end = BENCH_now();
+
+			/* Subscribed and foreign ids alternate on the bus */
+			std::vector<uint32_t> ids;
+			for (unsigned int i = 0; i < BENCH_SIGNALS; i++) {
+				ids.push_back(subscribed[i]);
+				ids.push_back(foreign[i]);
+			}
+
+			bus.ResetStatistics();
+			node->ResetStatistics();
+			unsigned int next = 0;
+			for (unsigned int t = 0; t < 500000; t += BENCH_STEP_US) {
+				CAN_test_msg_t msg = {};
+				msg.len = 2;
+				msg.id = ids[next];
+				while (peer->Write(msg)) {
+					next = (next + 1) % ids.size();
+					msg.id = ids[next];
+				}
+				cm->Update();
+				Test_AdvanceMicros(BENCH_STEP_US);
+			}
+
+			COMMUNICATION_rxFilter_t filters[COMMUNICATION_RX_FILTERS];
+			unsigned int nFilters = cm->GetRxFilters(filters);
+			unsigned long passing = 0;
+			for (unsigned int id = 0; id < COMMUNICATION_STD_IDS; id++) {
+				for (unsigned int i = 0; i < nFilters; i++) {
+					if (0 == ((id ^ filters[i].canId) & filters[i].mask)) {
+						passing += 1;
+						break;
+					}
+				}
+			}
+
+			const char* groups[] = { "rx-filter/range", "rx-filter/inter", "rx-filter/scatter" };
+			BENCH_report(groups[variant], "filter table setup (128 ids)", (double)(end - start), "ns");
+			BENCH_report(groups[variant], "standard ids passing the filters", (double)passing, "ids");
+			BENCH_report(groups[variant], "frames on bus (50% subscribed)", (double)bus.GetFrames(), "frames");
+			BENCH_report(groups[variant], "filtered in hardware", 100.0 * node->GetRxFiltered() / bus.GetFrames(), "%");
+			BENCH_report(groups[variant], "frames reaching software", (double)node->GetRxFrames(), "frames");
+			Test_SetBus(nullptr);
+		}
+	}
+
+	void BenchRxPreemption() {
+		VirtualCanBus bus(1000000);
+		VirtualCanNode* node = bus.AddNode();
+		Test_SetBus(&bus);
+		Reset(node, 1000000, ORDER_LSB, RX_INTERRUPT);
+
+		/* Payload carries a sequence number and its complement, a torn
+		 * or reordered frame breaks either relation.
+		 */
+		struct {
+			uint32_t seq;
+			uint32_t check;
+		} values[BENCH_ISR_IDS];
+		uint8_t flags[BENCH_ISR_IDS];
+		uint32_t last[BENCH_ISR_IDS];
+		for (unsigned int i = 0; i < BENCH_ISR_IDS; i++) {
+			cm->Subscribe(&values[i], sizeof(values[i]), ConsumerId(i), &flags[i]);
+			last[i] = 0;
+		}
+
+		/* A 20us timer signal plays the RX interrupt: it preempts Update()
+		 * at arbitrary instructions and pushes a burst of frames.
+		 */
+		BENCH_isrSeq = 0;
+		BENCH_isrPushed = 0;
+		struct sigaction action = {};
+		action.sa_handler = RxInterrupt;
+		sigaction(SIGALRM, &action, nullptr);
+
+		timer_t timer;
+		struct sigevent event = {};
+		event.sigev_notify = SIGEV_SIGNAL;
+		event.sigev_signo = SIGALRM;
+		timer_create(CLOCK_MONOTONIC, &event, &timer);
+		struct itimerspec period = {};
+		period.it_interval.tv_nsec = 20000;
+		period.it_value.tv_nsec = 20000;
+		timer_settime(timer, 0, &period, nullptr);
+
+		unsigned long errors = 0;
+		unsigned long updates = 0;
+		while (true) {
+			bool finished = (BENCH_isrSeq >= BENCH_ISR_FRAMES);
+			cm->Update();
+			updates += 1;
+
+			for (unsigned int i = 0; i < BENCH_ISR_IDS; i++) {
+				if (flags[i]) {
+					flags[i] = 0;
+					if ((values[i].check != ~values[i].seq) || (values[i].seq <= last[i]) || ((values[i].seq % BENCH_ISR_IDS) != i)) {
+						errors += 1;
+					}
+					last[i] = values[i].seq;
+				}
+			}
+
+			if (finished && (cm->rxRingHead == cm->rxRingTail)) {
+				break;
+			}
+		}
+
+		timer_delete(timer);
+		action.sa_handler = SIG_DFL;
+		sigaction(SIGALRM, &action, nullptr);
+
+		BENCH_report("rx-isr", "frames generated by interrupt", (double)BENCH_isrSeq, "frames");
+		BENCH_report("rx-isr", "frames accepted into ring", (double)BENCH_isrPushed, "frames");
+		BENCH_report("rx-isr", "ring overruns", (double)cm->GetRxOverruns(), "frames");
+		BENCH_check("rx-isr", "unaccounted frames", (double)BENCH_isrSeq - BENCH_isrPushed - cm->GetRxOverruns(), 0.0, "frames");
+		BENCH_check("rx-isr", "torn or reordered frames", (double)errors, 0.0, "frames");
+		BENCH_report("rx-isr", "max ring utilization", (double)cm->GetMaxRxRingUtilization(), "frames");
+		BENCH_report("rx-isr", "Update() calls", (double)updates, "calls");
+		Test_SetBus(nullptr);
+	}
+
+	void BenchEmergency() {
+		/* Overloaded 125 kbit/s bus keeps all mailboxes busy with cyclic
+		 * frames, bursts of Fire() frames have to get past them.
+		 */
+		const unsigned int signals = 64;
+		const unsigned int burst = 3;
+		const unsigned int urgentId = 0x010;
+		const unsigned int alarmId = 0x008;
+		VirtualCanBus bus(125000);
+		VirtualCanNode* node = bus.AddNode();
+		VirtualCanNode* peer = bus.AddNode(VIRTUAL_CAN_TX_MAILBOXES, VIRTUAL_CAN_MAX_RX_FIFO_DEPTH);
+		Test_SetBus(&bus);
+		Test_AdvanceMillis(400 - (millis() % 400));
+		Reset(node, 125000);
+		RegisterSignals(signals, 0);
+		bus.ResetStatistics();
+
+		/* Fire() reads the value when the frame is sent, every frame gets its own */
+		static uint16_t fired[256];
+		std::vector<uint32_t> firedAt;
+		std::vector<double> latency;
+		unsigned long fireFailed = 0;
+		unsigned long reordered = 0;
+		long lastUrgent = -1;
+
+		uint32_t startMicros = micros();
+		uint32_t lastMillis = millis();
+		while ((micros() - startMicros) < BENCH_DURATION_MS * 1000UL) {
+			if ((millis() != lastMillis) && (0 == (millis() % 10))) {
+				for (unsigned int n = 0; n <= burst; n++) {
+					uint16_t seq = (uint16_t)firedAt.size();
+					fired[seq % 256] = seq;
+					/* The last frame of a burst is more urgent than the others */
+					if (cm->Fire(&fired[seq % 256], sizeof(uint16_t), (n < burst) ? urgentId : alarmId)) {
+						firedAt.push_back(micros());
+					}
+					else {
+						fireFailed += 1;
+					}
+				}
+			}
+			lastMillis = millis();
+
+			cm->Update();
+
+			CAN_test_msg_t msg;
+			uint32_t timestamp;
+			while (peer->Read(msg, &timestamp)) {
+				if ((urgentId != msg.id) && (alarmId != msg.id)) {
+					continue;
+				}
+				uint16_t seq = (msg.buf[0] << 8) | msg.buf[1];
+				latency.push_back((double)(timestamp - firedAt[seq]));
+				if (urgentId == msg.id) {
+					if ((long)seq < lastUrgent) {
+						reordered += 1;
+					}
+					lastUrgent = seq;
+				}
+			}
+
+			Test_AdvanceMicros(BENCH_STEP_US);
+		}
+
+		double frameMicros = bus.FrameMicros(2);
+		BENCH_stats_t stats = BENCH_statistics(latency);
+		BENCH_report("fire@125k", "frames fired", (double)firedAt.size(), "frames");
+		BENCH_report("fire@125k", "frames delivered", (double)latency.size(), "frames");
+		BENCH_report("fire@125k", "Fire() rejected (queue full)", (double)fireFailed, "frames");
+		BENCH_report("fire@125k", "latency mean (Fire -> delivered)", stats.mean / frameMicros, "frame times");
+		BENCH_report("fire@125k", "latency max", stats.max / frameMicros, "frame times");
+		BENCH_check("fire@125k", "urgent frames out of Fire() order", (double)reordered, 0.0, "frames");
+		BENCH_report("fire@125k", "queued frames aborted", (double)cm->GetAbortedFrames(), "frames");
+		BENCH_report("fire@125k", "cyclic frames on bus", (double)bus.GetFrames() - latency.size(), "frames");
+
+		/* The only frame Fire() may take over is already on the bus: the
+		 * frame is sent once, the Fire() frame waits for its mailbox
+		 * without blocking Update() and still goes ahead of the queue.
+		 */
+		VirtualCanBus idleBus(125000);
+		node = idleBus.AddNode();
+		peer = idleBus.AddNode(VIRTUAL_CAN_TX_MAILBOXES, VIRTUAL_CAN_MAX_RX_FIFO_DEPTH);
+		Test_SetBus(&idleBus);
+		Reset(node, 125000);
+		uint16_t value = 0;
+		unsigned char flag = 0;
+		cm->Publish(&value, sizeof(value), 0x300, &flag, CYCLE_100, 0);
+		for (unsigned int i = 0; i < 6; i++) {
+			cm->Publish(&txValues[i], sizeof(txValues[i]), ProducerId(i), &txFlags[i], CYCLE_100, 200);
+		}
+		std::vector<unsigned int> ids;
+		startMicros = micros();
+		while ((micros() - startMicros) < 10000UL) {
+			if (300 == (micros() - startMicros)) {
+				cm->Fire(&fired[0], sizeof(uint16_t), urgentId);
+				cm->Fire(&fired[0], sizeof(uint16_t), alarmId);
+			}
+			cm->Update();
+
+			CAN_test_msg_t msg;
+			while (peer->Read(msg)) {
+				ids.push_back(msg.id);
+			}
+			Test_AdvanceMicros(BENCH_STEP_US);
+		}
+
+		unsigned long sentOnce = 0;
+		bool ahead = false;
+		for (unsigned int i = 0; i < ids.size(); i++) {
+			sentOnce += (0x300 == ids[i]) ? 1 : 0;
+			if (alarmId == ids[i]) {
+				ahead = (i + 1 < ids.size()) && (ProducerId(0) == ids[i + 1]);
+			}
+		}
+		BENCH_check("fire@125k", "frame on the bus taken over, times sent", (double)sentOnce, 1.0, "frames");
+		BENCH_check("fire@125k", "Fire() after it ahead of the queue", ahead ? 1.0 : 0.0, 1.0, "bool");
+		Test_SetBus(nullptr);
+	}
+
+	void BenchPriorityInversion(uint32_t updateInterval) {
+		/* 15 low priority producers load a 125 kbit/s bus to ~90%, the most
+		 * urgent producer runs at a period which drifts over their cycle.
+		 */
+		const unsigned int signals = 15;
+		const unsigned int topId = 0x050;
+		const uint32_t topCycle = 7300;
+		VirtualCanBus bus(125000);
+		VirtualCanNode* node = bus.AddNode();
+		VirtualCanNode* peer = bus.AddNode(VIRTUAL_CAN_TX_MAILBOXES, VIRTUAL_CAN_MAX_RX_FIFO_DEPTH);
+		Test_SetBus(&bus);
+		Test_AdvanceMillis(400 - (millis() % 400));
+		Reset(node, 125000);
+		for (unsigned int i = 0; i < signals; i++) {
+			cm->Publish(&txValues[i], sizeof(txValues[i]), ProducerId(i), &txFlags[i], CYCLE_10, 0);
+		}
+		uint16_t topValue = 0;
+		unsigned char topFlag = 0;
+		cm->Publish(&topValue, sizeof(topValue), topId, &topFlag, topCycle, 0);
+		uint32_t start = cm->scheduleStart;
+		bus.ResetStatistics();
+
+		std::vector<double> response;
+		uint32_t startMicros = micros();
+		while ((micros() - startMicros) < BENCH_DURATION_MS * 1000UL) {
+			if (0 == ((micros() - startMicros) % updateInterval)) {
+				cm->Update();
+			}
+
+			CAN_test_msg_t msg;
+			uint32_t timestamp;
+			while (peer->Read(msg, &timestamp)) {
+				if (topId == msg.id) {
+					/* Due time of the latest cycle before delivery */
+					uint32_t due = timestamp - ((timestamp - start) % topCycle);
+					response.push_back((double)(timestamp - due));
+				}
+			}
+
+			Test_AdvanceMicros(BENCH_STEP_US);
+		}
+
+		char group[32];
+		snprintf(group, sizeof(group), "inversion/%u", (unsigned int)updateInterval);
+		double frameMicros = bus.FrameMicros(2);
+		BENCH_stats_t stats = BENCH_statistics(response);
+		BENCH_report(group, "bus load", 100.0 * bus.GetLoad(), "%");
+		BENCH_report(group, "top priority frames delivered", (double)response.size(), "frames");
+		BENCH_report(group, "top priority response mean", stats.mean / frameMicros, "frame times");
+		BENCH_report(group, "top priority response worst case", stats.max / frameMicros, "frame times");
+		BENCH_report(group, "queued frames aborted", (double)cm->GetAbortedFrames(), "frames");
+		Test_SetBus(nullptr);
+	}
+
+	void BenchCoalesce(COMMUNICATION_TX_MODE txMode) {
+		/* 64 producers need ~150% of a 125 kbit/s bus */
+		const unsigned int signals = 64;
+		VirtualCanBus bus(125000);
+		VirtualCanNode* node = bus.AddNode();
+		VirtualCanNode* peer = bus.AddNode(VIRTUAL_CAN_TX_MAILBOXES, VIRTUAL_CAN_MAX_RX_FIFO_DEPTH);
+		Test_SetBus(&bus);
+		/* Start on a common tick of all cycles */
+		Test_AdvanceMillis(400 - (millis() % 400));
+		Reset(node, 125000, ORDER_MSB, RX_POLLING, txMode);
+		RegisterSignals(signals, 0);
+		bus.ResetStatistics();
+
+		/* Every signal carries the time it was sampled (100us ticks), the
+		 * peer derives the age of the value it receives.
+		 */
+		std::vector<double> age;
+		unsigned long due = 0;
+		unsigned long queued = 0;
+		unsigned int maxNodes = 0;
+
+		uint32_t startMicros = micros();
+		uint32_t lastMillis = millis() - 1;
+		while ((micros() - startMicros) < BENCH_DURATION_MS * 1000UL) {
+			if (millis() != lastMillis) {
+				lastMillis = millis();
+				for (unsigned int i = 0; i < signals; i++) {
+					due += (0 == (lastMillis % BENCH_cycleMillis[i % 5])) ? 1 : 0;
+				}
+			}
+
+			uint16_t tick = (uint16_t)(micros() / BENCH_STEP_US);
+			for (unsigned int i = 0; i < signals; i++) {
+				txValues[i] = tick;
+				txFlags[i] = 0;
+			}
+
+			cm->Update();
+
+			for (unsigned int i = 0; i < signals; i++) {
+				queued += txFlags[i];
+			}
+			if (cm->GetMessageUtilization() > maxNodes) {
+				maxNodes = cm->GetMessageUtilization();
+			}
+
+			CAN_test_msg_t msg;
+			uint32_t timestamp;
+			while (peer->Read(msg, &timestamp)) {
+				uint16_t value = (msg.buf[0] << 8) | msg.buf[1];
+				uint16_t delivered = (uint16_t)(timestamp / BENCH_STEP_US);
+				age.push_back((double)(uint16_t)(delivered - value) * BENCH_STEP_US);
+			}
+
+			Test_AdvanceMicros(BENCH_STEP_US);
+		}
+
+		unsigned long coalesced = 0;
+		for (unsigned int i = 0; i < signals; i++) {
+			coalesced += cm->GetCoalesced(ProducerId(i));
+		}
+
+		const char* group = (TX_COALESCE == txMode) ? "coalesce@125k" : "queue@125k";
+		BENCH_stats_t stats = BENCH_statistics(age);
+		BENCH_report(group, "frames due (64 producers)", (double)due, "frames");
+		BENCH_report(group, "frames on bus", (double)bus.GetFrames(), "frames");
+		BENCH_report(group, "frames coalesced", (double)coalesced, "frames");
+		BENCH_report(group, "frames queued or refreshed", (double)queued, "frames");
+		BENCH_report(group, "max queue nodes used", (double)maxNodes, "nodes");
+		BENCH_report(group, "value age at delivery mean", stats.mean, "us");
+		BENCH_report(group, "value age at delivery p99", stats.p99, "us");
+
+		/* Two Fire() of one Can ID before the next Update() are both sent */
+		const unsigned int fireId = 0x050;
+		uint16_t fired[2] = { 0x1111, 0x2222 };
+		cm->Fire(&fired[0], sizeof(fired[0]), fireId);
+		cm->Fire(&fired[1], sizeof(fired[1]), fireId);
+		unsigned int firedSeen = 0;
+		for (unsigned int t = 0; t < 100; t++) {
+			cm->Update();
+			CAN_test_msg_t msg;
+			while (peer->Read(msg)) {
+				firedSeen += (fireId == msg.id) ? 1 : 0;
+			}
+			Test_AdvanceMicros(BENCH_STEP_US);
+		}
+		BENCH_check(group, "Fire() frames merged", 2.0 - firedSeen, 0.0, "frames");
+		Test_SetBus(nullptr);
+	}
+
+	void BenchTransport(uint32_t baud) {
+		/* Largest messages in both directions, flow control with blocks of
+		 * 8 frames and no separation time, Update() every BENCH_STEP_US
+		 */
+		const unsigned int txId = 0x7E0;
+		const unsigned int rxId = 0x7E8;
+		const uint32_t length = COMMUNICATION_TP_MAX_LENGTH;
+		const unsigned long messages = 8;
+		const unsigned char blockSize = 8;
+		const uint32_t timeout = 10 * BENCH_DURATION_MS * 1000UL;
+		static unsigned char message[COMMUNICATION_TP_MAX_LENGTH];
+		for (uint32_t i = 0; i < length; i++) {
+			message[i] = BENCH_pattern(i);
+		}
+
+		VirtualCanBus bus(baud);
+		VirtualCanNode* node = bus.AddNode();
+		VirtualCanNode* peer = bus.AddNode(VIRTUAL_CAN_TX_MAILBOXES, VIRTUAL_CAN_MAX_RX_FIFO_DEPTH);
+		Test_SetBus(&bus);
+		Reset(node, baud);
+		CommunicationTransport tp;
+		tp.Begin(txId, rxId, blockSize, 0);
+		BENCH_sink_t sink = { 0, 0, 0 };
+		tp.SetReceiveSink(BENCH_sink, &sink);
+
+		CAN_test_msg_t flowControl = {};
+		flowControl.id = rxId;
+		flowControl.len = 8;
+		memset(flowControl.buf, COMMUNICATION_TP_PADDING, 8);
+		flowControl.buf[0] = COMMUNICATION_TP_FLOW_CONTROL | COMMUNICATION_TP_CTS;
+		flowControl.buf[1] = blockSize;
+		flowControl.buf[2] = 0;
+
+		/* Node sends, the peer checks every byte and grants the blocks */
+		unsigned long sent = 0;
+		unsigned long peerBytes = 0;
+		unsigned long peerErrors = 0;
+		unsigned long peerMessages = 0;
+		uint32_t peerLength = 0;
+		uint32_t peerOffset = 0;
+		unsigned char peerSequence = 0;
+		unsigned int peerBlock = 0;
+		uint32_t start = micros();
+		uint32_t end = start;
+		while ((peerMessages < messages) && ((micros() - start) < timeout)) {
+			if ((sent < messages) && (TP_BUSY != tp.GetTxStatus()) && tp.Send(message, length)) {
+				sent += 1;
+			}
+			cm->Update();
+			tp.Update();
+
+			CAN_test_msg_t msg;
+			uint32_t timestamp;
+			while (peer->Read(msg, &timestamp)) {
+				unsigned int pci = msg.buf[0] & 0xF0;
+				unsigned int first = 1;
+				if (txId != msg.id) {
+					continue;
+				}
+				if (COMMUNICATION_TP_FIRST == pci) {
+					peerLength = ((msg.buf[0] & 0x0F) << 8) | msg.buf[1];
+					peerOffset = 0;
+					peerSequence = 1;
+					peerBlock = 0;
+					first = 2;
+				}
+				else if (COMMUNICATION_TP_CONSECUTIVE == pci) {
+					if ((msg.buf[0] & 0x0F) != peerSequence) {
+						peerErrors += 1;
+					}
+					peerSequence = (peerSequence + 1) & 0x0F;
+					peerBlock += 1;
+				}
+				else {
+					continue;
+				}
+
+				for (unsigned int i = first; (i < 8) && (peerOffset < peerLength); i++) {
+					if (msg.buf[i] != BENCH_pattern(peerOffset)) {
+						peerErrors += 1;
+					}
+					peerOffset += 1;
+					peerBytes += 1;
+				}
+				if (peerOffset >= peerLength) {
+					peerMessages += 1;
+					end = timestamp;
+				}
+				else if ((COMMUNICATION_TP_FIRST == pci) || (blockSize == peerBlock)) {
+					peerBlock = 0;
+					peer->Write(flowControl);
+				}
+			}
+
+			Test_AdvanceMicros(BENCH_STEP_US);
+		}
+
+		double capacity = 8.0 * 1000000.0 / bus.FrameMicros(8);
+		double txThroughput = (end > start) ? (peerBytes * 1000000.0) / (end - start) : 0.0;
+
+		char group[32];
+		snprintf(group, sizeof(group), "isotp@%luk", (unsigned long)(baud / 1000));
+		BENCH_report(group, "send throughput", txThroughput, "bytes/s");
+		BENCH_report(group, "send share of bus payload capacity", 100.0 * txThroughput / capacity, "%");
+		BENCH_check(group, "send errors (sequence, content)", (double)peerErrors + (messages - peerMessages), 0.0, "errors");
+
+		/* Peer sends one frame at a time, node receives into the sink */
+		uint32_t offset = 0;
+		unsigned char sequence = 0;
+		unsigned int granted = 0;
+		bool waiting = false;
+		unsigned long started = 0;
+		start = micros();
+		end = start;
+		while ((sink.messages < messages) && ((micros() - start) < timeout)) {
+			if (0 == peer->GetPendingTx()) {
+				CAN_test_msg_t msg = {};
+				msg.id = rxId;
+				msg.len = 8;
+				memset(msg.buf, COMMUNICATION_TP_PADDING, 8);
+
+				if ((0 == offset) && (started < messages)) {
+					msg.buf[0] = COMMUNICATION_TP_FIRST | (length >> 8);
+					msg.buf[1] = length & 0xFF;
+					memcpy(&msg.buf[2], message, 6);
+					offset = 6;
+					sequence = 1;
+					waiting = true;
+					started += 1;
+					peer->Write(msg);
+				}
+				else if ((offset > 0) && !waiting) {
+					unsigned int bytes = std::min<uint32_t>(7, length - offset);
+					msg.buf[0] = COMMUNICATION_TP_CONSECUTIVE | sequence;
+					memcpy(&msg.buf[1], &message[offset], bytes);
+					offset += bytes;
+					sequence = (sequence + 1) & 0x0F;
+					if (offset >= length) {
+						offset = 0;
+					}
+					else if ((granted > 0) && (0 == --granted)) {
+						waiting = true;
+					}
+					peer->Write(msg);
+				}
+			}
+
+			unsigned long received = sink.messages;
+			cm->Update();
+			tp.Update();
+			if ((sink.messages == messages) && (received < messages)) {
+				end = micros();
+			}
+
+			CAN_test_msg_t msg;
+			while (peer->Read(msg)) {
+				if ((txId == msg.id) && ((COMMUNICATION_TP_FLOW_CONTROL | COMMUNICATION_TP_CTS) == msg.buf[0])) {
+					waiting = false;
+					granted = msg.buf[1];
+				}
+			}
+
+			Test_AdvanceMicros(BENCH_STEP_US);
+		}
+
+		double rxThroughput = (end > start) ? (sink.bytes * 1000000.0) / (end - start) : 0.0;
+		BENCH_report(group, "receive throughput (sink)", rxThroughput, "bytes/s");
+		BENCH_report(group, "receive share of bus payload capacity", 100.0 * rxThroughput / capacity, "%");
+		BENCH_check(group, "receive errors (content, incomplete)", (double)sink.errors + (messages - sink.messages), 0.0, "errors");
+		Test_SetBus(nullptr);
+	}
+
+	void BenchBulk(uint32_t baud, bool disturb) {
+		/* 256 KiB dump from the node to the peer. Disturbed: the peer loses
+		 * all frames for 20 ms and later goes away for a second, the sender
+		 * stops and is resumed.
+		 */
+		const unsigned int dataId = 0x700;
+		const unsigned int ackId = 0x6FF;
+		const uint32_t length = 256UL * 1024UL;
+		const uint32_t frames = (length + COMMUNICATION_BULK_FRAME_BYTES - 1) / COMMUNICATION_BULK_FRAME_BYTES;
+		static unsigned char dump[256UL * 1024UL];
+		for (uint32_t i = 0; i < length; i++) {
+			dump[i] = BENCH_pattern(i);
+		}
+
+		VirtualCanBus bus(baud);
+		VirtualCanNode* node = bus.AddNode();
+		VirtualCanNode* peer = bus.AddNode(VIRTUAL_CAN_TX_MAILBOXES, VIRTUAL_CAN_MAX_RX_FIFO_DEPTH);
+		Test_SetBus(&bus);
+		Reset(node, baud);
+		CommunicationBulk bulk;
+		CommunicationBulk extended;
+		BENCH_sink_t unused = { 0, 0, 0 };
+		bool idsRejected = !extended.BeginSender(COMMUNICATION_STD_IDS, ackId) && !extended.BeginReceiver(dataId, COMMUNICATION_STD_IDS, BENCH_sink, &unused);
+		bulk.BeginSender(dataId, ackId);
+
+		/* Peer: receiver with the whole transfer as bitmap */
+		std::vector<bool> received(frames, false);
+		uint32_t base = 0;
+		unsigned int unacked = 0;
+		uint32_t ackAt = 0;
+		unsigned long errors = 0;
+		unsigned long duplicates = 0;
+		unsigned long resumes = 0;
+		uint32_t resumedAt = 0;
+		auto ack = [&]() {
+			CAN_test_msg_t msg = {};
+			uint32_t bitmap = 0;
+			for (uint32_t j = 0; (j < 32) && (base + 1 + j < frames); j++) {
+				if (received[base + 1 + j]) {
+					bitmap |= (1UL << j);
+				}
+			}
+			msg.id = ackId;
+			msg.len = 8;
+			msg.buf[0] = COMMUNICATION_BULK_ACK;
+			msg.buf[1] = base >> 16;
+			msg.buf[2] = base >> 8;
+			msg.buf[3] = base;
+			msg.buf[4] = bitmap >> 24;
+			msg.buf[5] = bitmap >> 16;
+			msg.buf[6] = bitmap >> 8;
+			msg.buf[7] = bitmap;
+			peer->Write(msg);
+			unacked = 0;
+			ackAt = micros();
+		};
+
+		bulk.Send(dump, length);
+		uint32_t start = micros();
+		uint32_t end = start;
+		while ((base < frames) && ((micros() - start) < 60000000UL)) {
+			uint32_t elapsed = micros() - start;
+			bool lossy = disturb && (((elapsed >= 200000UL) && (elapsed < 220000UL)) || ((elapsed >= 500000UL) && (elapsed < 1500000UL)));
+
+			if ((TP_ERROR_TIMEOUT == bulk.GetTxStatus()) && !lossy && bulk.Resume()) {
+				resumes += 1;
+				resumedAt = bulk.GetAckedOffset();
+			}
+			cm->Update();
+			bulk.Update();
+
+			CAN_test_msg_t msg;
+			uint32_t timestamp;
+			while (peer->Read(msg, &timestamp)) {
+				if ((dataId != msg.id) || lossy) {
+					continue;
+				}
+				if (COMMUNICATION_BULK_START == msg.buf[0]) {
+					ack();
+					continue;
+				}
+				uint32_t slot = (msg.buf[0] - base) & COMMUNICATION_BULK_SEQUENCE_MASK;
+				uint32_t frame = base + slot;
+				if ((slot >= COMMUNICATION_BULK_WINDOW) || (frame >= frames) || received[frame]) {
+					duplicates += 1;
+					continue;
+				}
+				for (unsigned int i = 1; i < msg.len; i++) {
+					if (msg.buf[i] != BENCH_pattern(frame * COMMUNICATION_BULK_FRAME_BYTES + i - 1)) {
+						errors += 1;
+					}
+				}
+				received[frame] = true;
+				unacked += 1;
+				while ((base < frames) && received[base]) {
+					base += 1;
+				}
+				if (base >= frames) {
+					end = timestamp;
+				}
+				if ((base >= frames) || (unacked >= COMMUNICATION_BULK_ACK_FRAMES)) {
+					ack();
+				}
+			}
+			if ((unacked > 0) && ((micros() - ackAt) >= COMMUNICATION_BULK_ACK_MICROS)) {
+				ack();
+			}
+
+			Test_AdvanceMicros(BENCH_STEP_US);
+		}
+
+		double capacity = 8.0 * 1000000.0 / bus.FrameMicros(8);
+		double throughput = (end > start) ? (length * 1000000.0) / (end - start) : 0.0;
+
+		char group[32];
+		snprintf(group, sizeof(group), "bulk@%luk%s", (unsigned long)(baud / 1000), disturb ? "/lossy" : "");
+		BENCH_report(group, "throughput (256 KiB)", throughput, "bytes/s");
+		BENCH_report(group, "share of bus payload capacity", 100.0 * throughput / capacity, "%");
+		/* 7 of 8 bytes carry data, the receiver sends one acknowledgement
+		 * per ACK_FRAMES data frames
+		 */
+		double ceiling = capacity * COMMUNICATION_BULK_FRAME_BYTES / 8.0 * COMMUNICATION_BULK_ACK_FRAMES / (COMMUNICATION_BULK_ACK_FRAMES + 1.0);
+		BENCH_report(group, "share of protocol ceiling", 100.0 * throughput / ceiling, "%");
+		BENCH_report(group, "frames sent again", (double)bulk.GetRetransmits(), "frames");
+		BENCH_report(group, "duplicates at the receiver", (double)duplicates, "frames");
+		BENCH_check(group, "content errors, frames missing", (double)errors + (frames - base), 0.0, "errors");
+		BENCH_check(group, "Begin() with 29 bit ids rejected", (double)idsRejected, 1.0, "bool");
+		if (disturb) {
+			BENCH_report(group, "resumes after timeout", (double)resumes, "resumes");
+			BENCH_report(group, "resumed at offset", (double)resumedAt, "bytes");
+		}
+		Test_SetBus(nullptr);
+	}
+
+	void BenchSignals() {
+		/* 16 two byte and 16 one byte values every 10 ms, one frame per
+		 * value vs. packed into 6 frames (Intel and Motorola layouts)
+		 */
+		const unsigned int values = 32;
+		const unsigned int frames = 6;
+		const uint32_t duration = 1000000UL;
+		uint16_t words[16];
+		uint8_t bytes[16];
+		uint8_t flags[values];
+		double load[2];
+		std::vector<CAN_test_msg_t> captured(frames);
+
+		for (unsigned int packed = 0; packed < 2; packed++) {
+			VirtualCanBus bus(500000);
+			VirtualCanNode* node = bus.AddNode();
+			VirtualCanNode* peer = bus.AddNode(VIRTUAL_CAN_TX_MAILBOXES, VIRTUAL_CAN_MAX_RX_FIFO_DEPTH);
+			Test_SetBus(&bus);
+			Reset(node, 500000);
+
+			for (unsigned int i = 0; i < 16; i++) {
+				words[i] = 0x1234 + 0x1111 * i;
+				bytes[i] = 0xA0 + i;
+			}
+			if (packed) {
+				for (unsigned int k = 0; k < frames; k++) {
+					cm->PublishFrame(8, 0x200 + k, &flags[k], CYCLE_10);
+				}
+				for (unsigned int i = 0; i < 16; i++) {
+					/* Frames 0, 1 Intel, 2, 3 Motorola, MSB at bit 7 of the byte */
+					COMMUNICATION_BYTE_ORDER order = (i < 8) ? ORDER_LSB : ORDER_MSB;
+					unsigned char start = 16 * (i % 4) + ((i < 8) ? 0 : 7);
+					cm->PublishSignal(&words[i], SIGNAL_UINT16, 0x200 + i / 4, start, 16, order);
+				}
+				for (unsigned int i = 0; i < 16; i++) {
+					COMMUNICATION_BYTE_ORDER order = (i < 8) ? ORDER_LSB : ORDER_MSB;
+					unsigned char start = 8 * (i % 8) + ((i < 8) ? 0 : 7);
+					cm->PublishSignal(&bytes[i], SIGNAL_UINT8, 0x204 + i / 8, start, 8, order);
+				}
+			}
+			else {
+				for (unsigned int i = 0; i < 16; i++) {
+					cm->Publish(&words[i], 2, 0x200 + i, &flags[i], CYCLE_10);
+					cm->Publish(&bytes[i], 1, 0x210 + i, &flags[16 + i], CYCLE_10);
+				}
+			}
+
+			Test_AdvanceMillis(20);
+			bus.ResetStatistics();
+			uint32_t start = micros();
+			while ((micros() - start) < duration) {
+				cm->Update();
+				CAN_test_msg_t msg;
+				while (peer->Read(msg)) {
+					if (packed && (msg.id >= 0x200) && (msg.id < 0x200 + frames)) {
+						captured[msg.id - 0x200] = msg;
+					}
+				}
+				Test_AdvanceMicros(BENCH_STEP_US);
+			}
+			load[packed] = 100.0 * bus.GetLoad();
+			Test_SetBus(nullptr);
+		}
+
+		BENCH_report("signals", "bus load, one frame per value (32 frames / 10 ms)", load[0], "%");
+		BENCH_report("signals", "bus load, packed (6 frames / 10 ms)", load[1], "%");
+
+		/* Expected frame bytes: Intel little endian, Motorola big endian */
+		unsigned long layoutErrors = 0;
+		for (unsigned int i = 0; i < 16; i++) {
+			const CAN_test_msg_t& frame = captured[i / 4];
+			unsigned int at = 2 * (i % 4);
+			uint16_t value = (i < 8) ? (frame.buf[at] | (frame.buf[at + 1] << 8)) : ((frame.buf[at] << 8) | frame.buf[at + 1]);
+			layoutErrors += (value != words[i]) ? 1 : 0;
+			layoutErrors += (captured[4 + i / 8].buf[i % 8] != bytes[i]) ? 1 : 0;
+		}
+		BENCH_check("signals", "layout errors (packed frames)", (double)layoutErrors, 0.0, "errors");
+
+		/* Round trip of odd layouts with scaling and sign extension: the node
+		 * sends random values, then decodes its own frames as a subscriber.
+		 */
+		VirtualCanBus bus(1000000);
+		VirtualCanNode* node = bus.AddNode();
+		VirtualCanNode* peer = bus.AddNode(VIRTUAL_CAN_TX_MAILBOXES, VIRTUAL_CAN_MAX_RX_FIFO_DEPTH);
+		Test_SetBus(&bus);
+		Reset(node, 1000000);
+
+		typedef struct BENCH_odd_t {
+			int16_t position;
+			float temperature;
+			uint8_t enable;
+			int32_t counter;
+			float torque;
+		} BENCH_odd_t;
+
+		const unsigned int rounds = 2000;
+		std::vector<BENCH_odd_t> sent(rounds);
+		std::vector<CAN_test_msg_t> frameLog;
+		BENCH_odd_t tx;
+		uint8_t txFlag;
+		/* Only sent by Fire() within the test */
+		cm->PublishFrame(8, 0x300, &txFlag, 100000000UL, 99999999UL);
+		/* 12 bit signed Motorola across bytes 0 and 1 */
+		cm->PublishSignal(&tx.position, SIGNAL_INT16, 0x300, 3, 12, ORDER_MSB);
+		/* 10 bit unsigned, 0.1 deg resolution from -40 deg, bits 16..25 */
+		cm->PublishSignal(&tx.temperature, SIGNAL_UNSIGNED_FLOAT, 0x300, 16, 10, ORDER_LSB, 0.1f, -40.0f);
+		cm->PublishSignal(&tx.enable, SIGNAL_UINT8, 0x300, 26, 1, ORDER_LSB);
+		/* 20 bit signed Intel, bits 27..46 */
+		cm->PublishSignal(&tx.counter, SIGNAL_INT32, 0x300, 27, 20, ORDER_LSB);
+		/* 16 bit signed Motorola, 0.01 Nm, bytes 6 and 7 */
+		cm->PublishSignal(&tx.torque, SIGNAL_FLOAT, 0x300, 55, 16, ORDER_MSB, 0.01f);
+		bool overlap = cm->PublishSignal(&tx.enable, SIGNAL_UINT8, 0x300, 44, 4, ORDER_LSB);
+		bool outside = cm->PublishSignal(&tx.enable, SIGNAL_UINT8, 0x300, 60, 8, ORDER_LSB);
+
+		srand(18);
+		for (unsigned int r = 0; r < rounds; r++) {
+			tx.position = (rand() % 4096) - 2048;
+			tx.temperature = -40.0f + (rand() % 1024) * 0.1f;
+			tx.enable = rand() & 1;
+			tx.counter = (rand() % (1 << 20)) - (1 << 19);
+			tx.torque = ((rand() % 65536) - 32768) * 0.01f;
+			sent[r] = tx;
+			cm->Fire(0x300);
+			cm->Update();
+			Test_AdvanceMicros(BENCH_STEP_US * 2);
+			CAN_test_msg_t msg;
+			while (peer->Read(msg)) {
+				if (0x300 == msg.id) {
+					frameLog.push_back(msg);
+				}
+			}
+		}
+
+		const unsigned int iterations = 1000000;
+		uint32_t packedWords[2];
+		uint64_t packStart = BENCH_now();
+		for (unsigned int i = 0; i < iterations; i++) {
+			cm->PackSignals(cm->producers[0].signals, packedWords);
+			__asm__ volatile("" : : "r"(packedWords[0]), "r"(packedWords[1]) : "memory");
+		}
+		uint64_t packEnd = BENCH_now();
+
+		Reset(node, 1000000);
+		BENCH_odd_t rx;
+		uint8_t rxFlag[5];
+		cm->SubscribeSignal(&rx.position, SIGNAL_INT16, 0x300, 3, 12, ORDER_MSB, &rxFlag[0]);
+		cm->SubscribeSignal(&rx.temperature, SIGNAL_UNSIGNED_FLOAT, 0x300, 16, 10, ORDER_LSB, &rxFlag[1], 0.1f, -40.0f);
+		cm->SubscribeSignal(&rx.enable, SIGNAL_UINT8, 0x300, 26, 1, ORDER_LSB, &rxFlag[2]);
+		cm->SubscribeSignal(&rx.counter, SIGNAL_INT32, 0x300, 27, 20, ORDER_LSB, &rxFlag[3]);
+		cm->SubscribeSignal(&rx.torque, SIGNAL_FLOAT, 0x300, 55, 16, ORDER_MSB, &rxFlag[4], 0.01f);
+
+		unsigned long valueErrors = (frameLog.size() == rounds) ? 0 : 1;
+		for (unsigned int r = 0; (r < rounds) && (r < frameLog.size()); r++) {
+			rxFlag[0] = 0;
+			peer->Write(frameLog[r]);
+			for (unsigned int step = 0; (step < 10) && !rxFlag[0]; step++) {
+				Test_AdvanceMicros(BENCH_STEP_US);
+				cm->Update();
+			}
+			const BENCH_odd_t& expected = sent[r];
+			if ((rx.position != expected.position) || (rx.enable != expected.enable) || (rx.counter != expected.counter) ||
+				(fabsf(rx.temperature - expected.temperature) > 0.051f) || (fabsf(rx.torque - expected.torque) > 0.0051f)) {
+				valueErrors += 1;
+			}
+		}
+		BENCH_check("signals", "round trip errors (5 signals, 2000 frames)", (double)valueErrors, 0.0, "frames");
+		BENCH_check("signals", "layouts rejected (overlap, outside)", (double)(!overlap + !outside), 2.0, "signals");
+		BENCH_report("signals", "PackSignals() (5 signals, 2 scaled)", (double)(packEnd - packStart) / iterations, "ns/frame");
+		Test_SetBus(nullptr);
+	}
+
+	void BenchFrameTemplate() {
+		VirtualCanBus bus(1000000);
+		VirtualCanNode* node = bus.AddNode();
+		VirtualCanNode* peer = bus.AddNode(VIRTUAL_CAN_TX_MAILBOXES, VIRTUAL_CAN_MAX_RX_FIFO_DEPTH);
+		Test_SetBus(&bus);
+		Reset(node, 1000000);
+
+		/* Generic path: the same layout as runtime signals */
+		BENCH_frame_t generic;
+		BENCH_frame_t decoded;
+		uint8_t txFlag;
+		cm->PublishFrame(8, 0x310, &txFlag, 100000000UL, 99999999UL);
+		cm->PublishSignal(&generic.position, SIGNAL_INT16, 0x310, 3, 12, ORDER_MSB);
+		cm->PublishSignal(&generic.enable, SIGNAL_UINT8, 0x310, 16, 1, ORDER_LSB);
+		cm->PublishSignal(&generic.counter, SIGNAL_INT32, 0x310, 17, 20, ORDER_LSB);
+		cm->PublishSignal(&generic.speed, SIGNAL_UINT16, 0x310, 47, 16, ORDER_MSB);
+		cm->PublishSignal(&generic.current, SIGNAL_INT8, 0x310, 56, 8, ORDER_LSB);
+		unsigned char first = cm->producers[0].signals;
+
+		/* Random values, some outside their fields to compare saturation */
+		const unsigned int samples = 4096;
+		std::vector<BENCH_frame_t> values(samples);
+		srand(19);
+		for (BENCH_frame_t& v : values) {
+			v.position = (rand() % 6000) - 3000;
+			v.enable = rand() & 3;
+			v.counter = (rand() % (3 << 19)) - (3 << 18);
+			v.speed = rand();
+			v.current = rand();
+		}
+
+		unsigned long packMismatches = 0;
+		unsigned long unpackMismatches = 0;
+		for (const BENCH_frame_t& v : values) {
+			uint32_t expected[2];
+			uint32_t words[2];
+			generic = v;
+			cm->PackSignals(first, expected);
+			BENCH_framePack(v, words);
+			packMismatches += ((expected[0] != words[0]) || (expected[1] != words[1])) ? 1 : 0;
+
+			/* Generic receive path: every signal on its own */
+			uint64_t frame = ((uint64_t)words[0] << 32) | words[1];
+			for (unsigned char i = first; COMMUNICATION_NO_SIGNAL != i; i = cm->signals[i].next) {
+				COMMUNICATION_signal_t signal = cm->signals[i];
+				signal.ref = (unsigned char*)&decoded + ((unsigned char*)signal.ref - (unsigned char*)&generic);
+				uint64_t word = (ORDER_LSB == signal.byteOrder) ? __builtin_bswap64(frame) : frame;
+				CommunicationManager::SignalStore(signal, (uint32_t)(word >> signal.shift));
+			}
+			BENCH_frame_t unpacked;
+			BENCH_frameUnpack(words, unpacked);
+			unpackMismatches += ((unpacked.position != decoded.position) || (unpacked.enable != decoded.enable) || (unpacked.counter != decoded.counter) ||
+				(unpacked.speed != decoded.speed) || (unpacked.current != decoded.current)) ? 1 : 0;
+		}
+
+		const unsigned int rounds = 256;
+		uint32_t words[2 * samples];
+		uint64_t start = BENCH_now();
+		for (unsigned int r = 0; r < rounds; r++) {
+			for (unsigned int i = 0; i < samples; i++) {
+				generic = values[i];
+				cm->PackSignals(first, &words[2 * i]);
+			}
+		}
+		uint64_t genericPack = BENCH_now() - start;
+
+		start = BENCH_now();
+		for (unsigned int r = 0; r < rounds; r++) {
+			for (unsigned int i = 0; i < samples; i++) {
+				BENCH_framePack(values[i], &words[2 * i]);
+			}
+		}
+		uint64_t templatePack = BENCH_now() - start;
+
+		std::vector<COMMUNICATION_signal_t> table;
+		for (unsigned char i = first; COMMUNICATION_NO_SIGNAL != i; i = cm->signals[i].next) {
+			table.push_back(cm->signals[i]);
+		}
+		start = BENCH_now();
+		for (unsigned int r = 0; r < rounds; r++) {
+			for (unsigned int i = 0; i < samples; i++) {
+				uint64_t frame = ((uint64_t)words[2 * i] << 32) | words[2 * i + 1];
+				for (const COMMUNICATION_signal_t& signal : table) {
+					uint64_t word = (ORDER_LSB == signal.byteOrder) ? __builtin_bswap64(frame) : frame;
+					CommunicationManager::SignalStore(signal, (uint32_t)(word >> signal.shift));
+				}
+			}
+		}
+		uint64_t genericUnpack = BENCH_now() - start;
+
+		start = BENCH_now();
+		for (unsigned int r = 0; r < rounds; r++) {
+			for (unsigned int i = 0; i < samples; i++) {
+				BENCH_frameUnpack(&words[2 * i], decoded);
+				__asm__ volatile("" : : "r"(&decoded) : "memory");
+			}
+		}
+		uint64_t templateUnpack = BENCH_now() - start;
+
+		/* Through the manager: Publish<>() on the node, Subscribe<>() reads
+		 * the captured frame back
+		 */
+		Reset(node, 1000000);
+		BENCH_frame_t tx = values[7];
+		BENCH_frame_t rx = {};
+		uint8_t rxFlag;
+		cm->Publish<BENCH_frame>(&tx, 0x311, &txFlag, 100000000UL, 99999999UL);
+		cm->Fire(0x311);
+		CAN_test_msg_t captured = {};
+		for (unsigned int step = 0; step < 10; step++) {
+			cm->Update();
+			Test_AdvanceMicros(BENCH_STEP_US);
+			CAN_test_msg_t msg;
+			while (peer->Read(msg)) {
+				captured = msg;
+			}
+		}
+		Reset(node, 1000000);
+		cm->Subscribe<BENCH_frame>(&rx, 0x311, &rxFlag);
+		peer->Write(captured);
+		for (unsigned int step = 0; (step < 10) && !rxFlag; step++) {
+			Test_AdvanceMicros(BENCH_STEP_US);
+			cm->Update();
+		}
+		uint32_t expected[2];
+		uint32_t received[2];
+		BENCH_framePack(tx, expected);
+		BENCH_framePack(rx, received);
+		bool roundTrip = rxFlag && (expected[0] == received[0]) && (expected[1] == received[1]);
+
+		double frames = (double)rounds * samples;
+		BENCH_check("frame<>", "pack mismatches against PackSignals()", (double)packMismatches, 0.0, "frames");
+		BENCH_check("frame<>", "unpack mismatches against signals", (double)unpackMismatches, 0.0, "frames");
+		BENCH_check("frame<>", "Publish<>() / Subscribe<>() round trip errors", roundTrip ? 0.0 : 1.0, 0.0, "frames");
+		BENCH_report("frame<>", "pack, runtime signals (5 fields)", genericPack / frames, "ns/frame");
+		BENCH_report("frame<>", "pack, compile time layout", templatePack / frames, "ns/frame");
+		BENCH_report("frame<>", "unpack, runtime signals (5 fields)", genericUnpack / frames, "ns/frame");
+		BENCH_report("frame<>", "unpack, compile time layout", templateUnpack / frames, "ns/frame");
+		Test_SetBus(nullptr);
+	}
+
+	void BenchPhase(uint32_t phase) {
+		VirtualCanBus bus(1000000);
+		VirtualCanNode* node = bus.AddNode();
+		VirtualCanNode* peer = bus.AddNode(VIRTUAL_CAN_TX_MAILBOXES, VIRTUAL_CAN_MAX_RX_FIFO_DEPTH);
+		Test_SetBus(&bus);
+		Test_AdvanceMicros(400000 - (micros() % 400000));
+		Reset(node, 1000000);
+		RegisterSignals(BENCH_SIGNALS, 0, phase);
+		bus.ResetStatistics();
+
+		std::vector<std::deque<uint32_t> > txQueued(BENCH_SIGNALS);
+		std::vector<double> delay;
+		std::vector<double> busyPerMilli(BENCH_DURATION_MS + 20, 0.0);
+		unsigned int maxNodes = 0;
+		unsigned long queued = 0;
+
+		uint32_t startMicros = micros();
+		while ((micros() - startMicros) < BENCH_DURATION_MS * 1000UL) {
+			uint32_t now = micros();
+			cm->Update();
+
+			for (unsigned int i = 0; i < BENCH_SIGNALS; i++) {
+				if (txFlags[i]) {
+					txQueued[i].push_back(now);
+					txFlags[i] = 0;
+					queued += 1;
+				}
+			}
+			if (cm->GetMessageUtilization() > maxNodes) {
+				maxNodes = cm->GetMessageUtilization();
+			}
+
+			CAN_test_msg_t msg;
+			uint32_t timestamp;
+			while (peer->Read(msg, &timestamp)) {
+				unsigned int i = (msg.id - 0x100) / 2;
+				if (!txQueued[i].empty()) {
+					delay.push_back((double)(timestamp - txQueued[i].front()));
+					txQueued[i].pop_front();
+				}
+				busyPerMilli[(timestamp - startMicros) / 1000] += bus.FrameMicros(msg.len);
+			}
+
+			Test_AdvanceMicros(BENCH_STEP_US);
+		}
+
+		unsigned long due = 0;
+		for (unsigned int t = 0; t < BENCH_DURATION_MS; t++) {
+			for (unsigned int i = 0; i < BENCH_SIGNALS; i++) {
+				due += (cm->GetPhase(ProducerId(i)) / 1000 == t % BENCH_cycleMillis[i % 5]) ? 1 : 0;
+			}
+		}
+
+		const char* group = (COMMUNICATION_PHASE_AUTO == phase) ? "phase/auto" : "phase/aligned";
+		BENCH_stats_t stats = BENCH_statistics(delay);
+		BENCH_stats_t busy = BENCH_statistics(busyPerMilli);
+		BENCH_report(group, "max queue nodes left after Update()", (double)maxNodes, "nodes");
+		BENCH_report(group, "frames dropped (queue full)", (double)due - queued, "frames");
+		BENCH_report(group, "queueing delay mean (queued -> delivered)", stats.mean, "us");
+		BENCH_report(group, "queueing delay p99", stats.p99, "us");
+		BENCH_report(group, "queueing delay max", stats.max, "us");
+		BENCH_report(group, "bus load mean", bus.GetLoad() * 100.0, "%");
+		BENCH_report(group, "bus load peak (1ms window)", busy.max / 10.0, "%");
+		Test_SetBus(nullptr);
+	}
+
+	void BenchSnapshot() {
+		/* The producer's value changes every step while its frame waits
+		 * in the queue: the mailboxes hold more urgent frames of the
+		 * node, which wait behind a burst of the peer
+		 */
+		VirtualCanBus bus(500000);
+		VirtualCanNode* node = bus.AddNode();
+		VirtualCanNode* peer = bus.AddNode(VIRTUAL_CAN_TX_MAILBOXES, VIRTUAL_CAN_MAX_RX_FIFO_DEPTH);
+		Test_SetBus(&bus);
+		Reset(node, 500000);
+
+		uint32_t value = 0;
+		uint8_t flag = 0;
+		for (unsigned int i = 0; i < 16; i++) {
+			cm->Publish(&txValues[i], sizeof(txValues[i]), ProducerId(i), &txFlags[i], CYCLE_10, 0);
+		}
+		cm->Publish(&value, sizeof(value), 0x700, &flag, CYCLE_10, 0);
+
+		std::deque<uint32_t> due;
+		unsigned long frames = 0;
+		unsigned long newer = 0;
+		uint32_t start = micros();
+		while ((micros() - start) < 1000000UL) {
+			value += 1;
+			flag = 0;
+			cm->Update();
+			if (flag) {
+				due.push_back(value);
+			}
+
+			while (((micros() - start) % 10000UL < 5000UL) && (peer->GetPendingTx() < VIRTUAL_CAN_TX_MAILBOXES)) {
+				CAN_test_msg_t burst = {};
+				burst.id = 0x010;
+				burst.len = 8;
+				peer->Write(burst);
+			}
+
+			CAN_test_msg_t msg;
+			while (peer->Read(msg)) {
+				if ((0x700 != msg.id) || due.empty()) {
+					continue;
+				}
+				uint32_t sent = ((uint32_t)msg.buf[0] << 24) | ((uint32_t)msg.buf[1] << 16) | (msg.buf[2] << 8) | msg.buf[3];
+				newer += (sent != due.front()) ? 1 : 0;
+				due.pop_front();
+				frames += 1;
+			}
+			Test_AdvanceMicros(BENCH_STEP_US);
+		}
+
+		BENCH_report("snapshot", "frames queued behind a 5 ms burst", (double)frames, "frames");
+		BENCH_check("snapshot", "frames not carrying the value that was due", (double)newer, 0.0, "frames");
+
+		/* One identifier backlogged behind the burst: its frames leave in
+		 * the order they were queued, the subscriber ends up with the newest
+		 * value. The value only changes during the burst.
+		 */
+		Reset(node, 500000);
+		for (unsigned int i = 0; i < 16; i++) {
+			cm->Publish(&txValues[i], sizeof(txValues[i]), ProducerId(i), &txFlags[i], CYCLE_10, 0);
+		}
+		uint32_t level = 0;
+		cm->PublishOnChange(&level, sizeof(level), 0x700, &flag, 1000);
+
+		std::vector<uint32_t> queued;
+		std::vector<uint32_t> delivered;
+		start = micros();
+		while ((micros() - start) < 30000UL) {
+			uint32_t elapsed = micros() - start;
+			if (elapsed < 5000UL) {
+				level = elapsed / 1000 + 1;
+			}
+			flag = 0;
+			cm->Update();
+			if (flag) {
+				queued.push_back(level);
+			}
+
+			while ((elapsed < 5000UL) && (peer->GetPendingTx() < VIRTUAL_CAN_TX_MAILBOXES)) {
+				CAN_test_msg_t burst = {};
+				burst.id = 0x010;
+				burst.len = 8;
+				peer->Write(burst);
+			}
+
+			CAN_test_msg_t msg;
+			while (peer->Read(msg)) {
+				if (0x700 == msg.id) {
+					delivered.push_back(((uint32_t)msg.buf[0] << 24) | ((uint32_t)msg.buf[1] << 16) | (msg.buf[2] << 8) | msg.buf[3]);
+				}
+			}
+			Test_AdvanceMicros(BENCH_STEP_US);
+		}
+
+		unsigned long reordered = (queued.size() != delivered.size()) ? 1 : 0;
+		for (unsigned int i = 0; (i < queued.size()) && (i < delivered.size()); i++) {
+			reordered += (queued[i] != delivered[i]) ? 1 : 0;
+		}
+		bool newest = !delivered.empty() && (delivered.back() == level);
+		BENCH_report("snapshot", "frames of one id queued behind the burst", (double)queued.size(), "frames");
+		BENCH_check("snapshot", "frames of one id out of order", (double)reordered, 0.0, "frames");
+		BENCH_check("snapshot", "last delivered value is the newest", newest ? 1.0 : 0.0, 1.0, "bool");
+
+		/* Fire() copies the value, the buffer is reused before Update() */
+		unsigned long fireErrors = 0;
+		for (unsigned int n = 0; n < 100; n++) {
+			unsigned char buffer[8];
+			for (unsigned int i = 0; i < 8; i++) {
+				buffer[i] = n + i;
+			}
+			cm->Fire(buffer, 8, 0x050);
+			memset(buffer, 0xEE, sizeof(buffer));
+
+			bool received = false;
+			for (unsigned int step = 0; (step < 100) && !received; step++) {
+				cm->Update();
+				Test_AdvanceMicros(BENCH_STEP_US);
+				CAN_test_msg_t msg;
+				while (peer->Read(msg)) {
+					if (0x050 != msg.id) {
+						continue;
+					}
+					received = true;
+					/* ORDER_MSB: the last byte in memory is sent first */
+					for (unsigned int i = 0; i < 8; i++) {
+						fireErrors += (msg.buf[7 - i] != (unsigned char)(n + i)) ? 1 : 0;
+					}
+				}
+			}
+			fireErrors += received ? 0 : 1;
+		}
+
+		BENCH_check("snapshot", "Fire() payload errors, buffer reused", (double)fireErrors, 0.0, "errors");
+		BENCH_report("snapshot", "sizeof(COMMUNICATION_listNode_t)", (double)sizeof(COMMUNICATION_listNode_t), "bytes");
+		Test_SetBus(nullptr);
+	}
+
+	void BenchSnapshotRead() {
+		VirtualCanBus bus(1000000);
+		VirtualCanNode* node = bus.AddNode();
+		Test_SetBus(&bus);
+		Reset(node, 1000000, ORDER_LSB, RX_INTERRUPT);
+
+		/* Sequence number and its complement, as in BenchRxPreemption().
+		 * The snapshot and the plain value (interrupt callback) are both
+		 * written by the RX interrupt.
+		 */
+		typedef struct {
+			uint32_t seq;
+			uint32_t check;
+		} BENCH_value_t;
+		COMMUNICATION_snapshot_t snapshot;
+		BENCH_value_t plain = { 0, ~0U };
+		cm->SubscribeSnapshot(&snapshot, sizeof(BENCH_value_t), BENCH_SNAPSHOT_ID);
+		cm->Subscribe(&plain, sizeof(plain), BENCH_PLAIN_ID, BENCH_ignore, nullptr, CALLBACK_INTERRUPT);
+		BENCH_irqMasked = false;
+		BENCH_irqPending = false;
+		BENCH_irqDeferred = 0;
+
+		/* Read cost without a writer: the value as two words (32 bit MCU),
+		 * the seqlock, and a copy with the interrupt masked
+		 */
+		const unsigned int iterations = 1000000;
+		volatile uint32_t* words = (volatile uint32_t*)&plain;
+		BENCH_value_t value;
+		uint64_t start = BENCH_now();
+		for (unsigned int i = 0; i < iterations; i++) {
+			value.seq = words[0];
+			value.check = words[1];
+			__asm__ volatile("" : : "r"(&value) : "memory");
+		}
+		double plainNs = (double)(BENCH_now() - start) / iterations;
+
+		start = BENCH_now();
+		for (unsigned int i = 0; i < iterations; i++) {
+			CommunicationManager::ReadSnapshot(&snapshot, &value, sizeof(value));
+			__asm__ volatile("" : : "r"(&value) : "memory");
+		}
+		double snapshotNs = (double)(BENCH_now() - start) / iterations;
+
+		start = BENCH_now();
+		for (unsigned int i = 0; i < iterations; i++) {
+			ReadMasked(words, (uint32_t*)&value);
+			__asm__ volatile("" : : "r"(&value) : "memory");
+		}
+		double criticalNs = (double)(BENCH_now() - start) / iterations;
+
+		BENCH_report("snapshot-read", "plain two word copy", plainNs, "ns/read");
+		BENCH_report("snapshot-read", "ReadSnapshot() (seqlock)", snapshotNs, "ns/read");
+		BENCH_report("snapshot-read", "critical section (masked interrupt)", criticalNs, "ns/read");
+
+		/* A 20us timer signal delivers both frames like the controller, the
+		 * RX interrupt writes the subscribers while the loop keeps reading
+		 * them: unprotected, with the seqlock and in a critical section
+		 */
+		BENCH_snapshotSeq = 0;
+		struct sigaction action = {};
+		action.sa_handler = SnapshotInterrupt;
+		sigaction(SIGALRM, &action, nullptr);
+
+		timer_t timer;
+		struct sigevent event = {};
+		event.sigev_notify = SIGEV_SIGNAL;
+		event.sigev_signo = SIGALRM;
+		timer_create(CLOCK_MONOTONIC, &event, &timer);
+		struct itimerspec period = {};
+		period.it_interval.tv_nsec = 20000;
+		period.it_value.tv_nsec = 20000;
+		timer_settime(timer, 0, &period, nullptr);
+
+		unsigned long reads = 0;
+		unsigned long snapshotTorn = 0;
+		unsigned long plainTorn = 0;
+		unsigned long criticalTorn = 0;
+		unsigned long generations = 0;
+		unsigned long missed = 0;
+		uint32_t lastGeneration = 0;
+		while (BENCH_snapshotSeq < BENCH_SNAPSHOT_FRAMES) {
+			uint32_t generation = CommunicationManager::ReadSnapshot(&snapshot, &value, sizeof(value));
+			if ((0 != generation) && (value.check != ~value.seq)) {
+				snapshotTorn += 1;
+			}
+			if (generation != lastGeneration) {
+				generations += 1;
+				missed += generation - lastGeneration - 1;
+				lastGeneration = generation;
+			}
+
+			value.seq = words[0];
+			value.check = words[1];
+			if (value.check != ~value.seq) {
+				plainTorn += 1;
+			}
+
+			ReadMasked(words, (uint32_t*)&value);
+			if (value.check != ~value.seq) {
+				criticalTorn += 1;
+			}
+			reads += 1;
+		}
+
+		timer_delete(timer);
+		action.sa_handler = SIG_DFL;
+		sigaction(SIGALRM, &action, nullptr);
+
+		BENCH_report("snapshot-read", "reads while the RX interrupt writes", (double)reads, "reads");
+		BENCH_report("snapshot-read", "torn reads, plain subscriber", (double)plainTorn, "reads");
+		BENCH_check("snapshot-read", "torn reads, snapshot", (double)snapshotTorn, 0.0, "reads");
+		BENCH_check("snapshot-read", "torn reads, critical section", (double)criticalTorn, 0.0, "reads");
+		BENCH_report("snapshot-read", "interrupts delayed by the critical section", (double)BENCH_irqDeferred, "interrupts");
+		BENCH_report("snapshot-read", "updates seen by the reader", (double)generations, "updates");
+		BENCH_report("snapshot-read", "updates missed (generation gaps)", (double)missed, "updates");
+		BENCH_report("snapshot-read", "generation after the last frame", (double)CommunicationManager::GetGeneration(&snapshot), "updates");
+		Test_SetBus(nullptr);
+	}
+
+	void BenchReaction() {
+		/* Loop of examples/Subscriber with 1 ms of application work after
+		 * Update(), a peer sends the sensor value at random times. Latency
+		 * from the frame written by the peer to the reaction, it includes
+		 * the ~130 us the frame takes on the 500 kbit/s bus. Callbacks run
+		 * in the RX interrupt (default mode), a callback in Update() reacts
+		 * no earlier than the flag.
+		 */
+		const char* names[] = { "flag polling", "callback in RX interrupt", "functor in RX interrupt" };
+		const char* groups[] = { "reaction/flag", "reaction/isr", "reaction/functor" };
+		const unsigned int sensorId = 200;
+		const uint32_t work = 1000;
+
+		for (unsigned int variant = 0; variant < 3; variant++) {
+			VirtualCanBus bus(500000);
+			VirtualCanNode* node = bus.AddNode();
+			VirtualCanNode* peer = bus.AddNode();
+			Test_SetBus(&bus);
+			Reset(node, 500000, ORDER_MSB, (0 == variant) ? RX_POLLING : RX_INTERRUPT);
+
+			uint16_t sensorValue = 0;
+			uint8_t rxFlag = 0;
+			std::vector<double> latency;
+			BENCH_reaction_t reaction = { 0, &latency };
+			auto functor = [&](void*) { latency.push_back((double)(micros() - reaction.sentAt)); };
+			if (0 == variant) {
+				cm->Subscribe(&sensorValue, sizeof(sensorValue), sensorId, &rxFlag);
+			}
+			else if (2 == variant) {
+				cm->Subscribe(&sensorValue, sizeof(sensorValue), sensorId, &functor);
+			}
+			else {
+				cm->Subscribe(&sensorValue, sizeof(sensorValue), sensorId, BENCH_react, &reaction);
+			}
+
+			srand(23);
+			uint32_t start = micros();
+			uint32_t nextSend = start + 500;
+			while ((micros() - start) < BENCH_DURATION_MS * 1000UL) {
+				cm->Update();
+				if (1 == rxFlag) {
+					latency.push_back((double)(micros() - reaction.sentAt));
+					rxFlag = 0;
+				}
+
+				for (uint32_t t = 0; t < work; t += 10) {
+					if ((int32_t)(micros() - nextSend) >= 0) {
+						CAN_test_msg_t msg = {};
+						msg.id = sensorId;
+						msg.len = 2;
+						reaction.sentAt = micros();
+						peer->Write(msg);
+						nextSend += 2000 + rand() % 3000;
+					}
+					Test_AdvanceMicros(10);
+				}
+			}
+
+			BENCH_stats_t stats = BENCH_statistics(latency);
+			const char* group = groups[variant];
+			BENCH_report(group, names[variant], (double)latency.size(), "frames");
+			BENCH_report(group, "frame to reaction mean", stats.mean, "us");
+			BENCH_report(group, "frame to reaction p99", stats.p99, "us");
+			BENCH_report(group, "frame to reaction max", stats.max, "us");
+			Test_SetBus(nullptr);
+		}
+	}
+
+	void BenchOnChange(unsigned int mode) {
+		/* Publisher example: slowly drifting analog value (60 s sine, a step
+		 * of 200 at 30.017 s) with +-1 LSB noise, read by the loop every
+		 * millisecond
+		 */
+		VirtualCanBus bus(500000);
+		VirtualCanNode* node = bus.AddNode();
+		VirtualCanNode* peer = bus.AddNode(VIRTUAL_CAN_TX_MAILBOXES, VIRTUAL_CAN_MAX_RX_FIFO_DEPTH);
+		Test_SetBus(&bus);
+		Reset(node, 500000);
+
+		const char* group = "cyclic 40ms";
+		uint16_t sensorValue = 512;
+		uint8_t txFlag = 0;
+		if (0 == mode) {
+			cm->Publish(&sensorValue, sizeof(sensorValue), 200, &txFlag, CYCLE_40);
+		}
+		else if (1 == mode) {
+			group = "on change";
+			cm->PublishOnChange(&sensorValue, sizeof(sensorValue), 200, &txFlag, CYCLE_40, 1000000UL);
+		}
+		else {
+			group = "deadband 4";
+			cm->PublishOnChange(&sensorValue, SIGNAL_UINT16, 200, &txFlag, 4.0f, CYCLE_10, 1000000UL);
+		}
+		bus.ResetStatistics();
+
+		srand(11);
+		const uint32_t duration = 60000;
+		uint16_t received = 0;
+		uint32_t lastFrame = 0;
+		uint32_t minGap = 0xFFFFFFFFUL;
+		uint32_t maxGap = 0;
+		unsigned long frames = 0;
+		double error = 0.0;
+		uint32_t stepReaction = 0;
+		uint32_t start = millis();
+		while ((millis() - start) < duration) {
+			double t = (millis() - start) / 1000.0;
+			double level = 512.0 + 100.0 * sin(2.0 * M_PI * t / 60.0) + (((t >= 30.017) && (t < 40.0)) ? 200.0 : 0.0);
+			uint16_t exact = (uint16_t)lround(level);
+			sensorValue = exact + (rand() % 3) - 1;
+
+			cm->Update();
+
+			CAN_test_msg_t msg;
+			uint32_t timestamp;
+			while (peer->Read(msg, &timestamp)) {
+				received = (msg.buf[0] << 8) | msg.buf[1];
+				if (frames > 0) {
+					minGap = std::min(minGap, timestamp - lastFrame);
+					maxGap = std::max(maxGap, timestamp - lastFrame);
+				}
+				lastFrame = timestamp;
+				frames += 1;
+			}
+			error += abs((int)received - (int)exact);
+			if ((t >= 30.017) && (0 == stepReaction) && (received > 680)) {
+				stepReaction = millis() - start - 30017;
+			}
+
+			Test_AdvanceMicros(1000);
+		}
+
+		BENCH_report(group, "frames of CAN ID 200 (60 s)", (double)frames, "frames");
+		BENCH_report(group, "bus time at 500 kbit/s", frames * bus.FrameMicros(2) / (duration / 1000.0), "us/s");
+		BENCH_report(group, "shortest gap between frames", minGap / 1000.0, "ms");
+		BENCH_report(group, "longest gap between frames", maxGap / 1000.0, "ms");
+		BENCH_report(group, "mean error of the received value", error / duration, "LSB");
+		BENCH_report(group, "step received after", (double)stepReaction, "ms");
+		Test_SetBus(nullptr);
+	}
+
+	void BenchTxCache() {
+		/* 128 values of 8 bytes and 32 frames of 4 scaled signals, one in 16
+		 * changes between two rounds. Cost of queueing a frame and copying
+		 * it out of the list like the TX loop, packed every time vs. cached.
+		 * Single values are not cached, packing them costs about the copy.
+		 */
+		VirtualCanBus bus(1000000);
+		VirtualCanNode* node = bus.AddNode();
+		Test_SetBus(&bus);
+
+		static uint64_t values[BENCH_SIGNALS];
+		static float physical[BENCH_SIGNALS];
+		uint8_t dirty[BENCH_SIGNALS];
+		const char* names[] = { "8 byte values, packed", "4 signal frames, packed", "4 signal frames, cached" };
+		unsigned int rejected = 0;
+		for (unsigned int variant = 0; variant < 3; variant++) {
+			bool cached = (2 == variant);
+			bool signals = (variant >= 1);
+			Reset(node, 1000000);
+
+			unsigned int producers = signals ? BENCH_SIGNALS / 4 : BENCH_SIGNALS;
+			for (unsigned int i = 0; i < BENCH_SIGNALS; i++) {
+				values[i] = 0x0123456789ABCDEFULL + i;
+				physical[i] = 0.25f * i;
+			}
+			for (unsigned int k = 0; k < producers; k++) {
+				if (signals) {
+					cm->PublishFrame(8, ProducerId(k), &txFlags[k], BENCH_cycles[k % 5]);
+					for (unsigned int n = 0; n < 4; n++) {
+						cm->PublishSignal(&physical[4 * k + n], SIGNAL_FLOAT, ProducerId(k), 16 * n, 16, ORDER_LSB, 0.01f, -100.0f);
+					}
+				}
+				else {
+					cm->Publish(&values[k], 8, ProducerId(k), &txFlags[k], BENCH_cycles[k % 5]);
+					rejected += cm->CacheFrame(ProducerId(k), &dirty[k]) ? 0 : 1;
+				}
+				if (cached) {
+					cm->CacheFrame(ProducerId(k), &dirty[k]);
+				}
+			}
+
+			const unsigned int rounds = 4000;
+			const unsigned int batch = 64;
+			uint64_t ticks = 0;
+			volatile uint32_t sink = 0;
+			for (unsigned int r = 0; r < rounds; r++) {
+				for (unsigned int k = 0; k < producers; k++) {
+					if (0 == (k + r) % 16) {
+						values[k] += 1;
+						physical[(4 * k) % BENCH_SIGNALS] += 0.01f;
+						dirty[k] = 1;
+					}
+				}
+				for (unsigned int first = 0; first < producers; first += batch) {
+					uint64_t start = BENCH_ticks();
+					for (unsigned int k = first; (k < first + batch) && (k < producers); k++) {
+						cm->ListAdd(k, 0);
+					}
+					while (!cm->ListEmpty()) {
+						COMMUNICATION_listNode_t* head = cm->ListGetHead();
+						sink = sink + (head->words[0] ^ head->words[1]);
+						cm->ListRemoveHead();
+					}
+					ticks += BENCH_ticks() - start;
+				}
+			}
+
+			/* Cached frames carry the current values */
+			unsigned int stale = 0;
+			for (unsigned int k = 0; k < producers; k++) {
+				uint32_t packed[2];
+				uint32_t sent[2];
+				cm->PackProducer(cm->producers[k], packed);
+				cm->ProducerWords(k, sent);
+				stale += ((packed[0] != sent[0]) || (packed[1] != sent[1])) ? 1 : 0;
+			}
+
+			BENCH_report("tx cache", names[variant], (double)ticks / (rounds * producers), "cycles/frame");
+			if (cached) {
+				BENCH_check("tx cache", "stale frames", (double)stale, 0.0, "frames");
+			}
+		}
+		BENCH_check("tx cache", "single values cached", (double)(BENCH_SIGNALS - rejected), 0.0, "values");
+		BENCH_report("tx cache", "cache RAM", (double)(sizeof(cm->txCache) + sizeof(cm->cacheSlots)), "bytes");
+		Test_SetBus(nullptr);
+	}
+
+	void BenchRegistration() {
+		/* Runtime tables, see CommunicationStaticBenchmark for the static ones */
+		VirtualCanBus bus(1000000);
+		VirtualCanNode* node = bus.AddNode();
+		Test_SetBus(&bus);
+		Test_SetNode(node);
+
+		const unsigned int iterations = 1000;
+		uint64_t elapsed = 0;
+		for (unsigned int n = 0; n < iterations; n++) {
+			*cm = CommunicationManager();
+			uint64_t start = BENCH_now();
+			cm->Initialize(1000000);
+			RegisterSignals(BENCH_SIGNALS, BENCH_SIGNALS);
+			elapsed += BENCH_now() - start;
+		}
+
+		BENCH_report("registration", "sizeof(CommunicationManager)", (double)sizeof(CommunicationManager), "bytes RAM");
+		/* The largest tables, see the COMMUNICATION_* sizes and switches */
+		BENCH_report("registration", "producers, timers, events", (double)(sizeof(cm->producers) + sizeof(cm->timers) + sizeof(cm->events)), "bytes RAM");
+		BENCH_report("registration", "consumers, rx dispatch", (double)(sizeof(cm->consumers) + sizeof(cm->dispatch)), "bytes RAM");
+		BENCH_report("registration", "signals", (double)sizeof(cm->signals), "bytes RAM");
+		BENCH_report("registration", "tx queue (nodes, buckets)", (double)(sizeof(cm->nodes) + sizeof(cm->freeNodes) + sizeof(cm->queueTails) + sizeof(cm->queueIds) + sizeof(cm->queueBuckets) + sizeof(cm->queueWords)), "bytes RAM");
+		BENCH_report("registration", "tx cache", (double)(sizeof(cm->txCache) + sizeof(cm->cacheSlots)), "bytes RAM");
+		BENCH_report("registration", "tx statistics", (double)(sizeof(cm->coalesced) + sizeof(cm->latencyBuckets) + sizeof(cm->latencyMax)), "bytes RAM");
+		BENCH_report("registration", "rx ring", (double)sizeof(cm->rxRing), "bytes RAM");
+		BENCH_report("registration", "Initialize() + 128 Publish() + 128 Subscribe()", (double)elapsed / iterations / 1000.0, "us");
+		Test_SetBus(nullptr);
+	}
+
+	void BenchLoad() {
+		VirtualCanBus bus(1000000);
+		VirtualCanNode* node = bus.AddNode();
+		VirtualCanNode* peer = bus.AddNode(VIRTUAL_CAN_TX_MAILBOXES, VIRTUAL_CAN_MAX_RX_FIFO_DEPTH);
+		Test_SetBus(&bus);
+		Reset(node, 1000000);
+		RegisterSignals(BENCH_SIGNALS, BENCH_SIGNALS);
+		double projected = cm->GetProjectedLoad();
+
+		/* Let the window fill up, then compare against the bus */
+		std::vector<double> txLoad;
+		std::vector<double> rxLoad;
+		unsigned long txFrames = 0;
+		unsigned long rxFrames = 0;
+		for (unsigned int step = 0; step < 20000; step++) {
+			if (1000 == step) {
+				bus.ResetStatistics();
+				node->ResetStatistics();
+			}
+			if (0 == step % 50) {
+				for (unsigned int i = 0; i < BENCH_SIGNALS / 4; i++) {
+					CAN_test_msg_t msg = {};
+					msg.id = ConsumerId(i);
+					msg.len = 2;
+					peer->Write(msg);
+				}
+			}
+			cm->Update();
+			if ((step >= 1000) && (0 == step % 100)) {
+				txLoad.push_back(cm->GetTxLoad());
+				rxLoad.push_back(cm->GetRxLoad());
+			}
+			Test_AdvanceMicros(BENCH_STEP_US);
+		}
+		txFrames = node->GetTxFrames();
+		rxFrames = node->GetRxFrames();
+		double elapsed = 19000.0 * BENCH_STEP_US;
+
+		BENCH_stats_t tx = BENCH_statistics(txLoad);
+		BENCH_stats_t rx = BENCH_statistics(rxLoad);
+		BENCH_report("load", "projected tx load (Publish table)", projected, "%");
+		BENCH_report("load", "GetTxLoad() mean", tx.mean, "%");
+		BENCH_report("load", "GetTxLoad() max", tx.max, "%");
+		BENCH_report("load", "tx load on the bus", 100.0 * txFrames * bus.FrameMicros(2) / elapsed, "%");
+		BENCH_report("load", "GetRxLoad() mean", rx.mean, "%");
+		BENCH_report("load", "rx load on the bus", 100.0 * rxFrames * bus.FrameMicros(2) / elapsed, "%");
+		Test_SetBus(nullptr);
+
+		/* Worst case vs. actual stuff bits */
+		srand(3);
+		const unsigned int frames = 100000;
+		std::vector<uint32_t> payloads(frames * 2);
+		for (uint32_t& w : payloads) {
+			w = ((uint32_t)(rand() & 0xFFFF) << 16) | (rand() & 0xFFFF);
+		}
+		unsigned long exact = 0;
+		unsigned long worst = 0;
+		uint64_t start = BENCH_now();
+		for (unsigned int i = 0; i < frames; i++) {
+			exact += CommunicationManager::StuffedFrameBits(ProducerId(i % BENCH_SIGNALS), &payloads[i * 2], 8);
+		}
+		uint64_t end = BENCH_now();
+		for (unsigned int i = 0; i < frames; i++) {
+			worst += CommunicationManager::FrameBits(8);
+		}
+		BENCH_report("load", "exact stuffing, 8 byte random payload", (double)exact / frames, "bits");
+		BENCH_report("load", "worst case stuffing, 8 byte payload", (double)worst / frames, "bits");
+		BENCH_report("load", "exact stuffing cost", (double)(end - start) / frames, "ns/frame");
+
+		uint32_t zeros[2] = { 0, 0 };
+		BENCH_report("load", "exact stuffing, id 0, 8 zero bytes", (double)CommunicationManager::StuffedFrameBits(0, zeros, 8), "bits");
+	}
+
+	void BenchLatencyHistogram() {
+		VirtualCanBus bus(1000000);
+		VirtualCanNode* node = bus.AddNode();
+		VirtualCanNode* peer = bus.AddNode(VIRTUAL_CAN_TX_MAILBOXES, VIRTUAL_CAN_MAX_RX_FIFO_DEPTH);
+		Test_SetBus(&bus);
+		Reset(node, 1000000);
+		RegisterSignals(BENCH_SIGNALS, 0, 0);
+
+		/* Worst case: all cycles start together (phase 0), higher priority
+		 * background traffic of the peer (~40% load), main loop of the node
+		 * under test every millisecond
+		 */
+		for (unsigned int step = 0; step < 40000; step++) {
+			if (0 == step % 10) {
+				for (unsigned int i = 0; i < 3; i++) {
+					CAN_test_msg_t msg = {};
+					msg.id = 0x050 + i;
+					msg.len = 8;
+					peer->Write(msg);
+				}
+			}
+			if (0 == step % 10) {
+				cm->Update();
+			}
+			CAN_test_msg_t msg;
+			while (peer->Read(msg)) {
+			}
+			Test_AdvanceMicros(BENCH_STEP_US);
+		}
+
+		unsigned long buckets[COMMUNICATION_LATENCY_BUCKETS];
+		for (unsigned int c = 0; c < 5; c++) {
+			cm->GetCycleLatencyHistogram(BENCH_cycles[c], buckets);
+
+			unsigned long frames = 0;
+			unsigned long late = 0;
+			uint32_t max = 0;
+			for (unsigned int k = 0; k < COMMUNICATION_LATENCY_BUCKETS; k++) {
+				frames += buckets[k];
+				/* Upper bound of the bucket beyond the cycle time */
+				if ((2UL << k) > BENCH_cycleMillis[c] * 1000UL) {
+					late += buckets[k];
+				}
+			}
+			for (unsigned int i = c; i < BENCH_SIGNALS; i += 5) {
+				if (cm->GetMaxLatency(ProducerId(i)) > max) {
+					max = cm->GetMaxLatency(ProducerId(i));
+				}
+			}
+
+			char group[32];
+			snprintf(group, sizeof(group), "histogram/%ums", BENCH_cycleMillis[c]);
+			BENCH_report(group, "frames", (double)frames, "frames");
+			BENCH_report(group, "max queueing latency", (double)max, "us");
+			BENCH_report(group, "frames possibly later than the cycle time", (double)late, "frames");
+		}
+
+		unsigned long highest[COMMUNICATION_LATENCY_BUCKETS];
+		cm->GetLatencyHistogram(ProducerId(BENCH_SIGNALS - 1), highest);
+		for (unsigned int k = 0; k < COMMUNICATION_LATENCY_BUCKETS; k++) {
+			if (highest[k]) {
+				char name[64];
+				snprintf(name, sizeof(name), "id 0x%X, bucket %lu..%lu us", ProducerId(BENCH_SIGNALS - 1), (k ? 1UL << k : 0UL), (2UL << k) - 1);
+				BENCH_report("histogram", name, (double)highest[k], "frames");
+			}
+		}
+		Test_SetBus(nullptr);
+	}
+
+	void BenchLatency(uint32_t baud, uint32_t updateInterval, COMMUNICATION_RX_MODE rxMode = RX_POLLING) {
+		VirtualCanBus bus(baud);
+		VirtualCanNode* node = bus.AddNode();
+		VirtualCanNode* peer = bus.AddNode(VIRTUAL_CAN_TX_MAILBOXES, VIRTUAL_CAN_MAX_RX_FIFO_DEPTH);
+		Test_SetBus(&bus);
+		/* Start on a common tick of all cycles */
+		Test_AdvanceMillis(400 - (millis() % 400));
+		Reset(node, baud, ORDER_MSB, rxMode);
+		RegisterSignals(BENCH_SIGNALS, BENCH_SIGNALS);
+		bus.ResetStatistics();
+		node->ResetStatistics();
+		peer->ResetStatistics();
+
+		std::vector<std::deque<uint32_t> > txQueued(BENCH_SIGNALS);
+		/* The peer sends a sequence number per signal, so the due time of
+		 * every received value is known even if frames get lost.
+		 */
+		std::vector<std::vector<uint32_t> > peerDue(BENCH_SIGNALS);
+		std::deque<std::pair<unsigned int, uint16_t> > peerBacklog;
+		std::vector<double> txLatency;
+		std::vector<double> rxLatency;
+		std::vector<double> updateCost;
+		unsigned long lost = 0;
+
+		for (unsigned int i = 0; i < BENCH_SIGNALS; i++) {
+			txFlags[i] = 0;
+			rxFlags[i] = 0;
+		}
+
+		uint32_t startMicros = micros();
+		uint32_t lastMillis = millis() - 1;
+		while ((micros() - startMicros) < BENCH_DURATION_MS * 1000UL) {
+			uint32_t now = micros();
+
+			/* Peer node: queue due signals once per millisecond */
+			if (millis() != lastMillis) {
+				lastMillis = millis();
+				for (unsigned int i = 0; i < BENCH_SIGNALS; i++) {
+					if (0 == (lastMillis % BENCH_cycleMillis[i % 5])) {
+						peerBacklog.push_back(std::make_pair(i, (uint16_t)peerDue[i].size()));
+						peerDue[i].push_back(now);
+					}
+				}
+			}
+			while (!peerBacklog.empty()) {
+				CAN_test_msg_t msg = {};
+				msg.id = ConsumerId(peerBacklog.front().first);
+				msg.len = 2;
+				msg.buf[0] = peerBacklog.front().second >> 8;
+				msg.buf[1] = peerBacklog.front().second & 0xFF;
+				if (!peer->Write(msg)) {
+					break;
+				}
+				peerBacklog.pop_front();
+			}
+
+			/* Main loop of the node under test */
+			if (0 == ((now - startMicros) % updateInterval)) {
+				uint64_t start = BENCH_now();
+				cm->Update();
+				updateCost.push_back((double)(BENCH_now() - start));
+
+				for (unsigned int i = 0; i < BENCH_SIGNALS; i++) {
+					if (txFlags[i]) {
+						txQueued[i].push_back(now);
+						txFlags[i] = 0;
+					}
+					if (rxFlags[i]) {
+						rxLatency.push_back((double)(now - peerDue[i][rxValues[i]]));
+						rxFlags[i] = 0;
+					}
+				}
+			}
+
+			CAN_test_msg_t msg;
+			uint32_t timestamp;
+			while (peer->Read(msg, &timestamp)) {
+				unsigned int i = (msg.id - 0x100) / 2;
+				if (!txQueued[i].empty()) {
+					txLatency.push_back((double)(timestamp - txQueued[i].front()));
+					txQueued[i].pop_front();
+				}
+			}
+
+			Test_AdvanceMicros(BENCH_STEP_US);
+		}
+
+		for (unsigned int i = 0; i < BENCH_SIGNALS; i++) {
+			lost += txQueued[i].size();
+		}
+
+		char group[32];
+		snprintf(group, sizeof(group), "e2e@%luk/%lu%s", (unsigned long)(baud / 1000), (unsigned long)updateInterval, (RX_INTERRUPT == rxMode) ? "/isr" : "");
+
+		BENCH_stats_t update = BENCH_statistics(updateCost);
+		BENCH_report(group, "Update() mean", update.mean, "ns/call");
+		BENCH_report(group, "Update() max", update.max, "ns/call");
+
+		BENCH_stats_t tx = BENCH_statistics(txLatency);
+		BENCH_report(group, "tx latency mean (queued -> delivered)", tx.mean, "us");
+		BENCH_report(group, "tx latency p99", tx.p99, "us");
+		BENCH_report(group, "tx latency max", tx.max, "us");
+
+		BENCH_stats_t rx = BENCH_statistics(rxLatency);
+		BENCH_report(group, "rx latency mean (peer due -> dispatched)", rx.mean, "us");
+		BENCH_report(group, "rx latency p99", rx.p99, "us");
+		BENCH_report(group, "rx latency max", rx.max, "us");
+
+		BENCH_report(group, "bus load", bus.GetLoad() * 100.0, "%");
+		BENCH_report(group, "frames on bus", (double)bus.GetFrames(), "frames");
+		BENCH_report(group, "max queue nodes used", (double)cm->GetMaxMessageUtilization(), "nodes");
+		BENCH_report(group, "max frames sent per Update()", (double)cm->GetMaxMessagesSent(), "frames");
+		BENCH_report(group, "rx fifo overruns", (double)node->GetRxOverruns(), "frames");
+		BENCH_report(group, "rx ring overruns", (double)cm->GetRxOverruns(), "frames");
+		BENCH_report(group, "max rx ring utilization", (double)cm->GetMaxRxRingUtilization(), "frames");
+		BENCH_report(group, "tx frames still pending at end", (double)lost, "frames");
+		Test_SetBus(nullptr);
+	}
+};
+
+int main() {
+	CommunicationBenchmark bench;
+
+	bench.BenchUpdateIdle();
+	bench.BenchTimerWheel();
+	bench.BenchListAdd();
+	bench.BenchRxDispatch();
+	bench.BenchDispatchLookup();
+	bench.BenchByteOrder();
+	bench.BenchRxFilter();
+	/* 256 signals with 2 byte payload load a 1 Mbit/s bus to ~75% */
+	bench.BenchLatency(1000000, BENCH_STEP_US);
+	/* Slow main loop: Update() only every 2ms */
+	bench.BenchLatency(1000000, 2000);
+	bench.BenchLatency(1000000, 2000, RX_INTERRUPT);
+	bench.BenchRxPreemption();
+	bench.BenchLoad();
+	bench.BenchLatencyHistogram();
+	/* 128 producers due on the same tick vs. balanced phases */
+	bench.BenchPhase(0);
+	bench.BenchPhase(COMMUNICATION_PHASE_AUTO);
+	/* Most urgent producer behind full mailboxes, Update() every 0.1 / 1 ms */
+	bench.BenchPriorityInversion(BENCH_STEP_US);
+	bench.BenchPriorityInversion(1000);
+	/* Fire() bursts on a bus full of cyclic frames */
+	bench.BenchEmergency();
+	/* Overloaded bus, every cycle refreshes the pending frames */
+	bench.BenchCoalesce(TX_QUEUE);
+	bench.BenchCoalesce(TX_COALESCE);
+	/* 4095 byte transfers in both directions */
+	bench.BenchTransport(500000);
+	bench.BenchTransport(1000000);
+	/* Bulk dump through all mailboxes, clean and with a lossy receiver */
+	bench.BenchBulk(500000, false);
+	bench.BenchBulk(1000000, false);
+	bench.BenchBulk(1000000, true);
+	/* 32 small values, one frame each vs. packed into signal frames */
+	bench.BenchSignals();
+	/* Compile time frame layout against the runtime signals */
+	bench.BenchFrameTemplate();
+	/* Queued and fired frames carry the value of the moment they were queued */
+	bench.BenchSnapshot();
+	/* Reads of a value written by Update() in an interrupt */
+	bench.BenchSnapshotRead();
+	/* Flag polling against callbacks from Update() and the RX interrupt */
+	bench.BenchReaction();
+	/* Publisher example sent every 40ms, on change and with a deadband */
+	bench.BenchOnChange(0);
+	bench.BenchOnChange(1);
+	bench.BenchOnChange(2);
+	/* Mostly static producers packed every time vs. sent from the cache */
+	bench.BenchTxCache();
+	/* Runtime registration, the static tables are in CommunicationStaticBenchmark */
+	bench.BenchRegistration();
+
+	if (BENCH_failures) {
+		printf("%u correctness checks FAILED\n", BENCH_failures);
+		return 1;
+	}
+	return 0;
+}
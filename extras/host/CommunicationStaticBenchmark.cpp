@@ -0,0 +1,186 @@
+/************************************************************************
+ * CommunicationManager benchmark, static registration tables
+ *
+ * Same node as in the CommunicationBenchmark (128 producers, 128
+ * consumers), but built with COMMUNICATION_STATIC_TABLES: the tables are
+ * generated at compile time and Initialize() only picks the phases. Reports
+ * the RAM taken by the manager (COMMUNICATION_TX_STATISTICS 0), the size of
+ * the const tables and checks that every producer and consumer works over
+ * the VirtualCanBus.
+ *
+ */
+#include <stdio.h>
+#include <chrono>
+#include "CommunicationManager.h"
+#include "CommunicationTables.h"
+#include "VirtualCanBus.h"
+
+#if !COMMUNICATION_STATIC_TABLES
+#error "Build with -DCOMMUNICATION_STATIC_TABLES=1"
+#endif
+
+#define BENCH_SIGNALS 128
+/* The last consumers use extended identifiers */
+#define BENCH_EXT_SIGNALS 8
+#define BENCH_STEP_US 100
+
+static uint64_t BENCH_now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void BENCH_report(const char* group, const char* name, double value, const char* unit) {
+	printf("%-16s %-44s %12.1f %s\n", group, name, value, unit);
+}
+
+/* Correctness results are reported like the measurements, every one which
+ * differs from the expected value fails the run
+ */
+static unsigned int BENCH_failures = 0;
+
+static void BENCH_check(const char* group, const char* name, double value, double expected, const char* unit) {
+	BENCH_report(group, name, value, unit);
+	if (value != expected) {
+		printf("%-16s %-44s %12.1f expected, FAILED\n", group, name, expected);
+		BENCH_failures += 1;
+	}
+}
+
+static uint16_t BENCH_txValues[BENCH_SIGNALS];
+static uint8_t BENCH_txFlags[BENCH_SIGNALS];
+static uint16_t BENCH_rxValues[BENCH_SIGNALS];
+static uint8_t BENCH_rxFlags[BENCH_SIGNALS];
+
+/* Identifiers as in the CommunicationBenchmark */
+#define BENCH_PRODUCER_ID(i) (0x100 + 2 * (i))
+#define BENCH_CONSUMER_ID(i) (((i) < BENCH_SIGNALS - BENCH_EXT_SIGNALS) ? (0x101 + 2 * (i)) : (0x18DA0000UL + (i)))
+#define BENCH_CYCLE(i) ((((i) % 5) == 0) ? CYCLE_10 : (((i) % 5) == 1) ? CYCLE_20 : (((i) % 5) == 2) ? CYCLE_40 : (((i) % 5) == 3) ? CYCLE_80 : CYCLE_100)
+
+#define BENCH_X8(M, n) M(n) M(n + 1) M(n + 2) M(n + 3) M(n + 4) M(n + 5) M(n + 6) M(n + 7)
+#define BENCH_X32(M, n) BENCH_X8(M, n) BENCH_X8(M, n + 8) BENCH_X8(M, n + 16) BENCH_X8(M, n + 24)
+#define BENCH_X128(M) BENCH_X32(M, 0) BENCH_X32(M, 32) BENCH_X32(M, 64) BENCH_X32(M, 96)
+
+#define BENCH_PRODUCER(i) COMMUNICATION_PRODUCER(&BENCH_txValues[i], 2, BENCH_PRODUCER_ID(i), &BENCH_txFlags[i], BENCH_CYCLE(i), COMMUNICATION_PHASE_AUTO),
+/* Phases picked offline, Initialize() skips the balancing */
+#define BENCH_FIXED_PRODUCER(i) COMMUNICATION_PRODUCER(&BENCH_txValues[i], 2, BENCH_PRODUCER_ID(i), &BENCH_txFlags[i], BENCH_CYCLE(i), (((i) / 5) % 10) * 1000UL),
+#define BENCH_CONSUMER(i) COMMUNICATION_CONSUMER(&BENCH_rxValues[i], 2, BENCH_CONSUMER_ID(i), &BENCH_rxFlags[i]),
+
+static constexpr COMMUNICATION_producer_t BENCH_producers[] = {
+	BENCH_X128(BENCH_PRODUCER)
+};
+
+static constexpr COMMUNICATION_producer_t BENCH_fixedProducers[] = {
+	BENCH_X128(BENCH_FIXED_PRODUCER)
+};
+
+static constexpr COMMUNICATION_consumer_t BENCH_consumers[] = {
+	BENCH_X128(BENCH_CONSUMER)
+};
+
+static constexpr auto BENCH_dispatch = CommunicationDispatch(BENCH_consumers);
+
+static const COMMUNICATION_tables_t BENCH_tables = COMMUNICATION_TABLES(BENCH_producers, BENCH_dispatch);
+static const COMMUNICATION_tables_t BENCH_fixedTables = COMMUNICATION_TABLES(BENCH_fixedProducers, BENCH_dispatch);
+
+static_assert(BENCH_dispatch.stdDispatch[0x101] == 0, "dispatch tables are constexpr");
+
+/* Friend of the manager like the CommunicationBenchmark */
+class CommunicationBenchmark {
+private:
+	CommunicationManager* cm;
+
+public:
+	CommunicationBenchmark() {
+		cm = CommunicationManager::GetInstance();
+	}
+
+	void BenchStaticTables() {
+		BENCH_report("static tables", "sizeof(CommunicationManager)", (double)sizeof(CommunicationManager), "bytes RAM");
+		BENCH_report("static tables", "producer table", (double)sizeof(BENCH_producers), "bytes const");
+		BENCH_report("static tables", "consumer and dispatch tables", (double)sizeof(BENCH_dispatch), "bytes const");
+
+		VirtualCanBus bus(1000000);
+		VirtualCanNode* node = bus.AddNode();
+		VirtualCanNode* peer = bus.AddNode(VIRTUAL_CAN_TX_MAILBOXES, VIRTUAL_CAN_MAX_RX_FIFO_DEPTH);
+		Test_SetBus(&bus);
+		Test_SetNode(node);
+
+		const unsigned int iterations = 1000;
+		uint64_t elapsed[2] = { 0, 0 };
+		for (unsigned int fixed = 0; fixed < 2; fixed++) {
+			for (unsigned int n = 0; n < iterations; n++) {
+				*cm = CommunicationManager();
+				uint64_t start = BENCH_now();
+				cm->Initialize(fixed ? BENCH_fixedTables : BENCH_tables, 1000000);
+				elapsed[fixed] += BENCH_now() - start;
+			}
+		}
+		BENCH_report("static tables", "Initialize(), PHASE_AUTO", (double)elapsed[0] / iterations / 1000.0, "us");
+		BENCH_report("static tables", "Initialize(), fixed phases", (double)elapsed[1] / iterations / 1000.0, "us");
+
+		/* Runtime registration is refused */
+		uint16_t value = 0;
+		uint8_t flag = 0;
+		bool refused = !cm->Publish(&value, 2, 0x7F0, &flag, CYCLE_10) && !cm->Subscribe(&value, 2, 0x7F1, &flag);
+		BENCH_check("static tables", "runtime registration refused", refused ? 1.0 : 0.0, 1.0, "bool");
+
+		/* Every producer sends its value, every consumer receives one */
+		for (unsigned int i = 0; i < BENCH_SIGNALS; i++) {
+			BENCH_txValues[i] = 0x4000 + i;
+			BENCH_rxValues[i] = 0;
+		}
+		bool sent[BENCH_SIGNALS] = {};
+		unsigned long txErrors = 0;
+		unsigned int next = 0;
+		uint32_t start = micros();
+		while ((micros() - start) < 200000UL) {
+			cm->Update();
+			CAN_test_msg_t msg;
+			while (peer->Read(msg)) {
+				unsigned int i = (msg.id - 0x100) / 2;
+				if ((msg.id < 0x100) || (i >= BENCH_SIGNALS) || (msg.id & 1) || (msg.len != 2)) {
+					txErrors += 1;
+					continue;
+				}
+				txErrors += (((msg.buf[0] << 8) | msg.buf[1]) != BENCH_txValues[i]) ? 1 : 0;
+				sent[i] = true;
+			}
+			if ((next < BENCH_SIGNALS) && (0 == peer->GetPendingTx())) {
+				CAN_test_msg_t out = {};
+				out.id = BENCH_CONSUMER_ID(next);
+				out.ext = (out.id >= COMMUNICATION_STD_IDS) ? 1 : 0;
+				out.len = 2;
+				out.buf[0] = 0x80;
+				out.buf[1] = next;
+				peer->Write(out);
+				next += 1;
+			}
+			Test_AdvanceMicros(BENCH_STEP_US);
+		}
+
+		unsigned int producersSeen = 0;
+		unsigned int consumersUpdated = 0;
+		for (unsigned int i = 0; i < BENCH_SIGNALS; i++) {
+			producersSeen += sent[i] ? 1 : 0;
+			if (BENCH_rxFlags[i] && (BENCH_rxValues[i] == (0x8000 | i))) {
+				consumersUpdated += 1;
+			}
+		}
+		BENCH_check("static tables", "producers seen on the bus", (double)producersSeen, (double)BENCH_SIGNALS, "producers");
+		BENCH_check("static tables", "consumers updated", (double)consumersUpdated, (double)BENCH_SIGNALS, "consumers");
+		BENCH_check("static tables", "tx errors", (double)txErrors, 0.0, "errors");
+		Test_SetBus(nullptr);
+	}
+};
+
+int main() {
+	CommunicationBenchmark bench;
+
+	bench.BenchStaticTables();
+
+	if (BENCH_failures) {
+		printf("%u correctness checks FAILED\n", BENCH_failures);
+		return 1;
+	}
+	return 0;
+}
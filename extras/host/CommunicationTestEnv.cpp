@@ -0,0 +1,179 @@
+/************************************************************************
+ * Host test environment implementation
+ *
+ */
+#include <stdio.h>
+#include "CommunicationTestEnv.h"
+#include "VirtualCanBus.h"
+
+static uint32_t TEST_micros = 0;
+static VirtualCanBus* TEST_bus = nullptr;
+static VirtualCanNode* TEST_node = nullptr;
+/* Stands in for the data words of the RX FIFO message buffer */
+static uint32_t TEST_mailbox[2];
+
+TestSerial Serial;
+
+/************************************************************************
+ * Clock
+ */
+unsigned long millis() {
+	return TEST_micros / 1000;
+}
+
+unsigned long micros() {
+	return TEST_micros;
+}
+
+void Test_SetBus(VirtualCanBus* bus) {
+	TEST_bus = bus;
+	if (TEST_bus) {
+		TEST_bus->RunUntil(TEST_micros);
+	}
+}
+
+void Test_SetNode(VirtualCanNode* node) {
+	TEST_node = node;
+}
+
+VirtualCanNode* Test_GetNode() {
+	return TEST_node;
+}
+
+void Test_AdvanceMicros(uint32_t us) {
+	TEST_micros += us;
+	if (TEST_bus) {
+		TEST_bus->RunUntil(TEST_micros);
+	}
+}
+
+void Test_AdvanceMillis(uint32_t ms) {
+	Test_AdvanceMicros(ms * 1000);
+}
+
+/************************************************************************
+ * CAN hooks
+ */
+int Test_send(const CAN_test_msg_t& msg, int first) {
+	if (TEST_node) {
+		return TEST_node->Transmit(msg, (first > VIRTUAL_CAN_RESERVED_MAILBOX) ? first : (VIRTUAL_CAN_RESERVED_MAILBOX + 1));
+	}
+	return -1;
+}
+
+int Test_sendReserved(const CAN_test_msg_t& msg) {
+	if (TEST_node) {
+		return TEST_node->WriteReserved(msg);
+	}
+	return -1;
+}
+
+int Test_preempt(const CAN_test_msg_t& msg, uint8_t& aborted, uint32_t& abortedId, uint32_t keep) {
+	aborted = 0;
+	if (TEST_node) {
+		return TEST_node->Preempt(msg, aborted, abortedId, keep);
+	}
+	return -1;
+}
+
+int Test_abort(int mailbox) {
+	if (TEST_node) {
+		return TEST_node->Abort(mailbox);
+	}
+	return 0;
+}
+
+int Test_txPending(int mailbox) {
+	if (TEST_node) {
+		return TEST_node->TxPending(mailbox);
+	}
+	return 0;
+}
+
+int Test_receive(CAN_test_msg_t& msg) {
+	if (TEST_node) {
+		return TEST_node->Read(msg);
+	}
+	return 0;
+}
+
+int Test_peek(uint32_t& id, uint8_t& ext, uint8_t& len) {
+	const CAN_test_msg_t* msg = TEST_node ? TEST_node->Peek() : nullptr;
+	if (!msg) {
+		return 0;
+	}
+
+	id = msg->id;
+	ext = msg->ext;
+	len = msg->len;
+
+	/* Byte 0 is the most significant byte of word 0 like in the controller */
+	TEST_mailbox[0] = ((uint32_t)msg->buf[0] << 24) | ((uint32_t)msg->buf[1] << 16) | ((uint32_t)msg->buf[2] << 8) | msg->buf[3];
+	TEST_mailbox[1] = ((uint32_t)msg->buf[4] << 24) | ((uint32_t)msg->buf[5] << 16) | ((uint32_t)msg->buf[6] << 8) | msg->buf[7];
+	return 1;
+}
+
+const volatile uint32_t* Test_peekWords() {
+	return TEST_mailbox;
+}
+
+void Test_release() {
+	if (TEST_node) {
+		TEST_node->Release();
+	}
+}
+
+void Test_attachRxInterrupt(void (*handler)(void)) {
+	if (TEST_node) {
+		TEST_node->AttachRxInterrupt(handler);
+	}
+}
+
+void Test_setFilters(const CAN_test_filter_t* filters, const uint32_t* masks, uint8_t n) {
+	if (TEST_node) {
+		TEST_node->SetFilters(filters, masks, n);
+	}
+}
+
+/************************************************************************
+ * Serial
+ */
+static void TEST_printNumber(unsigned long val, bool negative, int base) {
+	if (HEX == base) {
+		printf("%s%lX", negative ? "-" : "", val);
+	}
+	else {
+		printf("%s%lu", negative ? "-" : "", val);
+	}
+}
+
+void TestSerial::print(const char* str) {
+	printf("%s", str);
+}
+
+void TestSerial::print(long val, int base) {
+	if (val < 0) {
+		TEST_printNumber((unsigned long)(-val), true, base);
+	}
+	else {
+		TEST_printNumber((unsigned long)val, false, base);
+	}
+}
+
+void TestSerial::print(unsigned long val, int base) {
+	TEST_printNumber(val, false, base);
+}
+
+void TestSerial::println(const char* str) {
+	printf("%s\n", str);
+}
+
+void TestSerial::println(long val, int base) {
+	print(val, base);
+	printf("\n");
+}
+
+void TestSerial::println(unsigned long val, int base) {
+	print(val, base);
+	printf("\n");
+}
@@ -0,0 +1,97 @@
+/************************************************************************
+ * Host test environment for the CommunicationManager
+ *
+ * Provides the pieces CommunicationManager expects when it is built with
+ * COMMUNICATION_TEST_ENV: a controllable clock (millis()/micros()), a Serial
+ * sink for the debug macros and the Test_send()/Test_receive() hooks which
+ * are routed to a node of the VirtualCanBus.
+ *
+ */
+#ifndef __COMMUNICATION_TEST_ENV_H__
+#define __COMMUNICATION_TEST_ENV_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/************************************************************************
+ * CAN message as seen by the CommunicationManager (mirrors CAN_message_t)
+ */
+typedef struct CAN_test_msg_t {
+	uint32_t id;
+	uint8_t ext;
+	uint8_t len;
+	uint16_t timeout;
+	uint8_t buf[8];
+} CAN_test_msg_t;
+
+/************************************************************************
+ * Acceptance filter as seen by the CommunicationManager (mirrors CAN_filter_t)
+ */
+typedef struct CAN_test_filter_t {
+	uint8_t rtr;
+	uint8_t ext;
+	uint32_t id;
+} CAN_test_filter_t;
+
+/* Returns the mailbox used or -1 like FlexCAN::writeWords() */
+int Test_send(const CAN_test_msg_t& msg, int first = 0);
+
+/* Same semantics as FlexCAN::writeReserved(), preempt() and txPending() */
+int Test_sendReserved(const CAN_test_msg_t& msg);
+int Test_preempt(const CAN_test_msg_t& msg, uint8_t& aborted, uint32_t& abortedId, uint32_t keep);
+int Test_txPending(int mailbox);
+int Test_abort(int mailbox);
+int Test_receive(CAN_test_msg_t& msg);
+
+/* Same semantics as FlexCAN::peek(), peekWords() and release() */
+int Test_peek(uint32_t& id, uint8_t& ext, uint8_t& len);
+const volatile uint32_t* Test_peekWords();
+void Test_release();
+
+/* Handler runs like the RX FIFO interrupt whenever a frame arrives */
+void Test_attachRxInterrupt(void (*handler)(void));
+
+/* Same semantics as FlexCAN::setFilters() */
+void Test_setFilters(const CAN_test_filter_t* filters, const uint32_t* masks, uint8_t n);
+
+/************************************************************************
+ * Controllable clock
+ *
+ * Time only moves when the host program advances it. Advancing the clock
+ * also lets the attached VirtualCanBus run up to the new point in time.
+ */
+class VirtualCanBus;
+class VirtualCanNode;
+
+unsigned long millis();
+unsigned long micros();
+
+void Test_SetBus(VirtualCanBus* bus);
+void Test_SetNode(VirtualCanNode* node);
+VirtualCanNode* Test_GetNode();
+void Test_AdvanceMicros(uint32_t us);
+void Test_AdvanceMillis(uint32_t ms);
+
+/************************************************************************
+ * Serial replacement used by the debug macros
+ */
+#define DEC 10
+#define HEX 16
+
+class TestSerial {
+public:
+	void print(const char* str);
+	void print(long val, int base = DEC);
+	void print(unsigned long val, int base = DEC);
+	void print(int val, int base = DEC) { print((long)val, base); }
+	void print(unsigned int val, int base = DEC) { print((unsigned long)val, base); }
+	void println(const char* str = "");
+	void println(long val, int base = DEC);
+	void println(unsigned long val, int base = DEC);
+	void println(int val, int base = DEC) { println((long)val, base); }
+	void println(unsigned int val, int base = DEC) { println((unsigned long)val, base); }
+};
+
+extern TestSerial Serial;
+
+#endif
@@ -0,0 +1,390 @@
+/************************************************************************
+ * VirtualCanBus implementation
+ *
+ */
+#include "VirtualCanBus.h"
+
+VirtualCanNode::VirtualCanNode() {
+	Configure(VIRTUAL_CAN_TX_MAILBOXES, VIRTUAL_CAN_RX_FIFO_DEPTH);
+}
+
+void VirtualCanNode::Configure(unsigned int txMailboxes, unsigned int rxFifoDepth) {
+	if (txMailboxes > VIRTUAL_CAN_TX_MAILBOXES) {
+		txMailboxes = VIRTUAL_CAN_TX_MAILBOXES;
+	}
+	if (rxFifoDepth > VIRTUAL_CAN_MAX_RX_FIFO_DEPTH) {
+		rxFifoDepth = VIRTUAL_CAN_MAX_RX_FIFO_DEPTH;
+	}
+
+	nTxMailboxes = txMailboxes;
+	for (unsigned int i = 0; i < VIRTUAL_CAN_TX_MAILBOXES; i++) {
+		txBusy[i] = false;
+	}
+	txOnWire = -1;
+
+	rxDepth = rxFifoDepth;
+	rxHead = 0;
+	rxCount = 0;
+	rxInterrupt = nullptr;
+	nRxFilters = 0;
+	rxFiltersEnabled = false;
+
+	ResetStatistics();
+}
+
+int VirtualCanNode::Write(const CAN_test_msg_t& msg, unsigned int first) {
+	return (Transmit(msg, first) >= 0) ? 1 : 0;
+}
+
+int VirtualCanNode::Transmit(const CAN_test_msg_t& msg, unsigned int first) {
+	for (unsigned int i = first; i < nTxMailboxes; i++) {
+		if (!txBusy[i]) {
+			txMailboxes[i].msg = msg;
+			txMailboxes[i].timestamp = micros();
+			txBusy[i] = true;
+			return i;
+		}
+	}
+
+	/* No mailbox available */
+	return -1;
+}
+
+int VirtualCanNode::WriteReserved(const CAN_test_msg_t& msg) {
+	if (txBusy[VIRTUAL_CAN_RESERVED_MAILBOX]) {
+		return -1;
+	}
+
+	txMailboxes[VIRTUAL_CAN_RESERVED_MAILBOX].msg = msg;
+	txMailboxes[VIRTUAL_CAN_RESERVED_MAILBOX].timestamp = micros();
+	txBusy[VIRTUAL_CAN_RESERVED_MAILBOX] = true;
+	return VIRTUAL_CAN_RESERVED_MAILBOX;
+}
+
+int VirtualCanNode::Preempt(const CAN_test_msg_t& msg, uint8_t& aborted, uint32_t& abortedId, uint32_t keep) {
+	int victim = -1;
+	uint32_t victimId = msg.id;
+
+	aborted = 0;
+	for (unsigned int i = VIRTUAL_CAN_RESERVED_MAILBOX + 1; i < nTxMailboxes; i++) {
+		if (!txBusy[i]) {
+			victim = i;
+			break;
+		}
+		if (!(keep & (1U << i)) && (txMailboxes[i].msg.id > victimId)) {
+			victim = i;
+			victimId = txMailboxes[i].msg.id;
+		}
+	}
+
+	if (victim < 0) {
+		return -1;
+	}
+
+	if (victim == txOnWire) {
+		/* Decided when the frame is complete, see Abort() */
+		aborted = 2;
+		return victim;
+	}
+
+	if (txBusy[victim]) {
+		aborted = 1;
+		abortedId = txMailboxes[victim].msg.id;
+		txAborted += 1;
+	}
+	txMailboxes[victim].msg = msg;
+	txMailboxes[victim].timestamp = micros();
+	txBusy[victim] = true;
+	return victim;
+}
+
+int VirtualCanNode::Abort(int mailbox) {
+	if (!TxPending(mailbox)) {
+		return 0;
+	}
+	if (mailbox == txOnWire) {
+		/* Decided when the frame is complete */
+		return -1;
+	}
+
+	txBusy[mailbox] = false;
+	txAborted += 1;
+	return 1;
+}
+
+int VirtualCanNode::TxPending(int mailbox) {
+	if ((mailbox < 0) || (mailbox >= (int)nTxMailboxes)) {
+		return 0;
+	}
+	return txBusy[mailbox] ? 1 : 0;
+}
+
+int VirtualCanNode::Read(CAN_test_msg_t& msg, uint32_t* timestamp) {
+	if (0 == rxCount) {
+		return 0;
+	}
+
+	msg = rxFifo[rxHead].msg;
+	if (timestamp) {
+		*timestamp = rxFifo[rxHead].timestamp;
+	}
+	rxHead = (rxHead + 1) % rxDepth;
+	rxCount -= 1;
+
+	return 1;
+}
+
+const CAN_test_msg_t* VirtualCanNode::Peek() {
+	if (0 == rxCount) {
+		return nullptr;
+	}
+
+	return &rxFifo[rxHead].msg;
+}
+
+void VirtualCanNode::Release() {
+	if (0 == rxCount) {
+		return;
+	}
+
+	rxHead = (rxHead + 1) % rxDepth;
+	rxCount -= 1;
+}
+
+int VirtualCanNode::Available() {
+	return (rxCount > 0) ? 1 : 0;
+}
+
+int VirtualCanNode::Inject(const CAN_test_msg_t& msg) {
+	unsigned long frames = rxFrames;
+	Deliver(msg, micros());
+	return (frames != rxFrames) ? 1 : 0;
+}
+
+void VirtualCanNode::AttachRxInterrupt(void (*handler)(void)) {
+	rxInterrupt = handler;
+}
+
+void VirtualCanNode::SetFilters(const CAN_test_filter_t* filters, const uint32_t* masks, uint8_t n) {
+	if (n > VIRTUAL_CAN_RX_FILTERS) {
+		n = VIRTUAL_CAN_RX_FILTERS;
+	}
+	for (unsigned int i = 0; i < n; i++) {
+		rxFilters[i] = filters[i];
+		rxMasks[i] = masks[i];
+	}
+	nRxFilters = n;
+	rxFiltersEnabled = true;
+}
+
+bool VirtualCanNode::Accept(const CAN_test_msg_t& msg) {
+	if (!rxFiltersEnabled) {
+		return true;
+	}
+
+	for (unsigned int i = 0; i < nRxFilters; i++) {
+		if ((rxFilters[i].ext ? 1 : 0) == (msg.ext ? 1 : 0)) {
+			if (0 == ((msg.id ^ rxFilters[i].id) & rxMasks[i])) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+unsigned int VirtualCanNode::GetPendingTx() {
+	unsigned int pending = 0;
+	for (unsigned int i = 0; i < nTxMailboxes; i++) {
+		if (txBusy[i]) {
+			pending += 1;
+		}
+	}
+	return pending;
+}
+
+unsigned long VirtualCanNode::GetTxFrames() {
+	return txFrames;
+}
+
+unsigned long VirtualCanNode::GetRxFrames() {
+	return rxFrames;
+}
+
+unsigned long VirtualCanNode::GetRxOverruns() {
+	return rxOverruns;
+}
+
+unsigned long VirtualCanNode::GetTxAborted() {
+	return txAborted;
+}
+
+unsigned long VirtualCanNode::GetRxFiltered() {
+	return rxFiltered;
+}
+
+void VirtualCanNode::ResetStatistics() {
+	txFrames = 0;
+	rxFrames = 0;
+	rxOverruns = 0;
+	rxFiltered = 0;
+	txAborted = 0;
+}
+
+void VirtualCanNode::Deliver(const CAN_test_msg_t& msg, uint32_t timestamp) {
+	if (!Accept(msg)) {
+		rxFiltered += 1;
+		return;
+	}
+
+	if (rxCount >= rxDepth) {
+		/* FIFO overflow: like the FlexCAN RX FIFO the newest frame is lost */
+		rxOverruns += 1;
+		return;
+	}
+
+	unsigned int tail = (rxHead + rxCount) % rxDepth;
+	rxFifo[tail].msg = msg;
+	rxFifo[tail].timestamp = timestamp;
+	rxCount += 1;
+	rxFrames += 1;
+
+	if (rxInterrupt) {
+		rxInterrupt();
+	}
+}
+
+VirtualCanBus::VirtualCanBus(uint32_t baud) {
+	nNodes = 0;
+	now = 0;
+	busy = false;
+	sender = nullptr;
+	senderMailbox = 0;
+	busyUntil = 0;
+	SetBaud(baud);
+	ResetStatistics();
+}
+
+void VirtualCanBus::SetBaud(uint32_t baud) {
+	this->baud = baud;
+}
+
+uint32_t VirtualCanBus::GetBaud() {
+	return baud;
+}
+
+VirtualCanNode* VirtualCanBus::AddNode(unsigned int txMailboxes, unsigned int rxFifoDepth) {
+	if (nNodes < VIRTUAL_CAN_MAX_NODES) {
+		VirtualCanNode* node = &nodes[nNodes++];
+		node->Configure(txMailboxes, rxFifoDepth);
+		return node;
+	}
+
+	/* Failed: Too many nodes */
+	return nullptr;
+}
+
+void VirtualCanBus::RunUntil(uint32_t time) {
+	while (true) {
+		if (busy) {
+			if ((int32_t)(busyUntil - time) > 0) {
+				/* Frame still on the wire */
+				return;
+			}
+			now = busyUntil;
+			Complete();
+		}
+
+		if (!StartNext()) {
+			break;
+		}
+	}
+
+	/* Bus is idle */
+	now = time;
+}
+
+uint32_t VirtualCanBus::GetTime() {
+	return now;
+}
+
+bool VirtualCanBus::StartNext() {
+	/* Arbitration: lowest identifier of all pending mailboxes wins */
+	VirtualCanNode* winner = nullptr;
+	unsigned int winnerMailbox = 0;
+
+	for (unsigned int n = 0; n < nNodes; n++) {
+		VirtualCanNode* node = &nodes[n];
+		for (unsigned int i = 0; i < node->nTxMailboxes; i++) {
+			if (node->txBusy[i]) {
+				if ((nullptr == winner) || (node->txMailboxes[i].msg.id < winner->txMailboxes[winnerMailbox].msg.id)) {
+					winner = node;
+					winnerMailbox = i;
+				}
+			}
+		}
+	}
+
+	if (nullptr == winner) {
+		return false;
+	}
+
+	uint32_t duration = FrameMicros(winner->txMailboxes[winnerMailbox].msg.len);
+
+	busy = true;
+	sender = winner;
+	sender->txOnWire = winnerMailbox;
+	senderMailbox = winnerMailbox;
+	busyUntil = now + duration;
+	busyMicros += duration;
+
+	return true;
+}
+
+void VirtualCanBus::Complete() {
+	const CAN_test_msg_t& msg = sender->txMailboxes[senderMailbox].msg;
+
+	for (unsigned int n = 0; n < nNodes; n++) {
+		if (&nodes[n] != sender) {
+			nodes[n].Deliver(msg, now);
+		}
+	}
+
+	sender->txBusy[senderMailbox] = false;
+	sender->txOnWire = -1;
+	sender->txFrames += 1;
+	frames += 1;
+	busy = false;
+}
+
+unsigned int VirtualCanBus::FrameBits(uint8_t len) {
+	if (len > 8) {
+		len = 8;
+	}
+
+	/* SOF, identifier, RTR, IDE, r0, DLC, data and CRC are subject to stuffing */
+	unsigned int stuffed = 34 + 8 * len;
+	/* CRC delimiter, ACK, EOF and interframe space */
+	return stuffed + (stuffed - 1) / 4 + 13;
+}
+
+uint32_t VirtualCanBus::FrameMicros(uint8_t len) {
+	return (FrameBits(len) * 1000000UL + baud - 1) / baud;
+}
+
+double VirtualCanBus::GetLoad() {
+	uint32_t elapsed = now - statisticsStart;
+	if (0 == elapsed) {
+		return 0.0;
+	}
+	return (double)busyMicros / (double)elapsed;
+}
+
+unsigned long VirtualCanBus::GetFrames() {
+	return frames;
+}
+
+void VirtualCanBus::ResetStatistics() {
+	statisticsStart = now;
+	busyMicros = 0;
+	frames = 0;
+}
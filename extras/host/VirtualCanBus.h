@@ -0,0 +1,159 @@
+/************************************************************************
+ * VirtualCanBus class
+ *
+ * In-process CAN bus for host builds. Every attached node owns a set of
+ * TX mailboxes and a bounded RX FIFO, just like the FlexCAN controller.
+ * Pending frames of all nodes take part in the arbitration, the lowest
+ * identifier wins and occupies the bus for the duration of its (worst-case
+ * stuffed) frame at the configured bitrate. A completed frame is delivered
+ * to every node except its sender.
+ *
+ */
+#ifndef __VIRTUAL_CAN_BUS_H__
+#define __VIRTUAL_CAN_BUS_H__
+
+#include "CommunicationTestEnv.h"
+
+#define VIRTUAL_CAN_MAX_NODES 8
+#define VIRTUAL_CAN_TX_MAILBOXES 8
+#define VIRTUAL_CAN_RX_FIFO_DEPTH 6
+#define VIRTUAL_CAN_MAX_RX_FIFO_DEPTH 256
+#define VIRTUAL_CAN_RX_FILTERS 8
+/* Like the FlexCAN driver, the first TX mailbox is kept for urgent frames */
+#define VIRTUAL_CAN_RESERVED_MAILBOX 0
+
+typedef struct VIRTUAL_CAN_frame_t {
+	CAN_test_msg_t msg;
+	uint32_t timestamp;
+} VIRTUAL_CAN_frame_t;
+
+class VirtualCanNode {
+	friend class VirtualCanBus;
+private:
+	VIRTUAL_CAN_frame_t txMailboxes[VIRTUAL_CAN_TX_MAILBOXES];
+	bool txBusy[VIRTUAL_CAN_TX_MAILBOXES];
+	unsigned int nTxMailboxes;
+	/* Mailbox on the wire or -1, it cannot be aborted anymore */
+	int txOnWire;
+	unsigned long txAborted;
+
+	VIRTUAL_CAN_frame_t rxFifo[VIRTUAL_CAN_MAX_RX_FIFO_DEPTH];
+	unsigned int rxDepth;
+	unsigned int rxHead;
+	unsigned int rxCount;
+
+	unsigned long txFrames;
+	unsigned long rxFrames;
+	unsigned long rxOverruns;
+	unsigned long rxFiltered;
+
+	void (*rxInterrupt)(void);
+
+	CAN_test_filter_t rxFilters[VIRTUAL_CAN_RX_FILTERS];
+	uint32_t rxMasks[VIRTUAL_CAN_RX_FILTERS];
+	unsigned int nRxFilters;
+	bool rxFiltersEnabled;
+
+	bool Accept(const CAN_test_msg_t& msg);
+
+	void Deliver(const CAN_test_msg_t& msg, uint32_t timestamp);
+
+public:
+	VirtualCanNode();
+
+	void Configure(unsigned int txMailboxes, unsigned int rxFifoDepth);
+
+	/* Returns 0 if all TX mailboxes from the first one on are occupied */
+	int Write(const CAN_test_msg_t& msg, unsigned int first = 0);
+
+	/* Like Write(), returns the mailbox used or -1 */
+	int Transmit(const CAN_test_msg_t& msg, unsigned int first = 0);
+
+	/* Same semantics as FlexCAN::writeReserved(), preempt() and txPending(),
+	 * an abort takes effect at once unless the frame is on the bus
+	 */
+	int WriteReserved(const CAN_test_msg_t& msg);
+	int Preempt(const CAN_test_msg_t& msg, uint8_t& aborted, uint32_t& abortedId, uint32_t keep = 0);
+	int TxPending(int mailbox);
+	/* Same semantics as FlexCAN::abort() */
+	int Abort(int mailbox);
+
+	/* Returns 0 if the RX FIFO is empty, timestamp is the delivery time in us */
+	int Read(CAN_test_msg_t& msg, uint32_t* timestamp = nullptr);
+
+	int Available();
+
+	/* Frame at the head of the RX FIFO or nullptr, it stays there until
+	 * Release() is called.
+	 */
+	const CAN_test_msg_t* Peek();
+	void Release();
+
+	/* Places a frame into the RX FIFO as if it was received from the bus */
+	int Inject(const CAN_test_msg_t& msg);
+
+	/* Handler is invoked after every frame put into the RX FIFO */
+	void AttachRxInterrupt(void (*handler)(void));
+
+	/* Acceptance filtering like FlexCAN::setFilters(), all frames pass
+	 * until it is called the first time.
+	 */
+	void SetFilters(const CAN_test_filter_t* filters, const uint32_t* masks, uint8_t n);
+
+	unsigned int GetPendingTx();
+
+	unsigned long GetTxFrames();
+	unsigned long GetRxFrames();
+	unsigned long GetRxOverruns();
+	/* Frames taken back by Preempt() */
+	unsigned long GetTxAborted();
+	/* Frames rejected by the acceptance filter */
+	unsigned long GetRxFiltered();
+
+	void ResetStatistics();
+};
+
+class VirtualCanBus {
+private:
+	VirtualCanNode nodes[VIRTUAL_CAN_MAX_NODES];
+	unsigned int nNodes;
+
+	uint32_t baud;
+	uint32_t now;
+
+	bool busy;
+	VirtualCanNode* sender;
+	unsigned int senderMailbox;
+	uint32_t busyUntil;
+
+	uint32_t statisticsStart;
+	unsigned long busyMicros;
+	unsigned long frames;
+
+	bool StartNext();
+	void Complete();
+
+public:
+	VirtualCanBus(uint32_t baud = 500000);
+
+	void SetBaud(uint32_t baud);
+	uint32_t GetBaud();
+
+	VirtualCanNode* AddNode(unsigned int txMailboxes = VIRTUAL_CAN_TX_MAILBOXES, unsigned int rxFifoDepth = VIRTUAL_CAN_RX_FIFO_DEPTH);
+
+	/* Runs arbitration and transmission up to the given point in time (us) */
+	void RunUntil(uint32_t time);
+
+	uint32_t GetTime();
+
+	/* Frame length in bits including worst-case stuffing and interframe space */
+	static unsigned int FrameBits(uint8_t len);
+	uint32_t FrameMicros(uint8_t len);
+
+	/* Share of time the bus was busy since the last ResetStatistics() (0..1) */
+	double GetLoad();
+	unsigned long GetFrames();
+	void ResetStatistics();
+};
+
+#endif